@@ -0,0 +1,570 @@
+#include "benchmark.hpp"
+
+#include <obs-module.h>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+
+#include "device-switcher.hpp"
+#include "level-engine.hpp"
+#include "spectrum-analyzer.hpp"
+#include "plugin-stats.hpp"
+#include "util/config-file.h"
+#include "util/platform.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define BENCHMARK_SOURCE_ID "device_switcher_bench"
+#define BENCHMARK_DEVICES 4
+#define BENCHMARK_ROWS 500
+#define BENCHMARK_TONE_NS 10000000ULL
+// A phase that does not settle within this time ends the run.
+#define BENCHMARK_TIMEOUT_NS 60000000000ULL
+
+// Stand in for a device source, it only has the device list the dock
+// looks for and produces nothing.
+struct BenchmarkSource {
+	obs_source_t *context;
+};
+
+static const char *benchmark_source_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return obs_module_text("BenchmarkSource");
+}
+
+static void *benchmark_source_create(obs_data_t *settings,
+				     obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	auto bench = new BenchmarkSource;
+	bench->context = source;
+	return bench;
+}
+
+static void benchmark_source_destroy(void *data)
+{
+	delete static_cast<BenchmarkSource *>(data);
+}
+
+static void benchmark_source_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_string(settings, "device_id", "bench-0");
+}
+
+static obs_properties_t *benchmark_source_properties(void *data)
+{
+	UNUSED_PARAMETER(data);
+	obs_properties_t *props = obs_properties_create();
+	obs_property_t *p = obs_properties_add_list(
+		props, "device_id", obs_module_text("BenchmarkDevice"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	for (int i = 0; i < BENCHMARK_DEVICES; i++) {
+		const auto id = "bench-" + std::to_string(i);
+		const auto name = "Benchmark Device " + std::to_string(i + 1);
+		obs_property_list_add_string(p, name.c_str(), id.c_str());
+	}
+	return props;
+}
+
+void benchmark_register()
+{
+	struct obs_source_info info = {};
+	info.id = BENCHMARK_SOURCE_ID;
+	info.type = OBS_SOURCE_TYPE_INPUT;
+	info.output_flags = OBS_SOURCE_AUDIO | OBS_SOURCE_CAP_DISABLED;
+	info.get_name = benchmark_source_get_name;
+	info.create = benchmark_source_create;
+	info.destroy = benchmark_source_destroy;
+	info.get_defaults = benchmark_source_defaults;
+	info.get_properties = benchmark_source_properties;
+	obs_register_source(&info);
+}
+
+// Highest resident size of the process so far, as tracked by the OS, so
+// short peaks between two samples are not missed.
+static uint64_t peak_resident_size()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return pmc.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return (uint64_t)usage.ru_maxrss;
+#else
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// User and system time of the whole process so far, the audio thread and
+// the tone included.
+static uint64_t process_cpu_time()
+{
+#ifdef _WIN32
+	FILETIME create, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel,
+			     &user))
+		return 0;
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) * 100;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+		       1000000000ULL +
+	       (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+		       1000ULL;
+#endif
+}
+
+static std::string benchmark_source_name(size_t i, bool renamed)
+{
+	auto name = "Device Switcher Benchmark " + std::to_string(i + 1);
+	if (renamed)
+		name += " renamed";
+	return name;
+}
+
+DockBenchmark::DockBenchmark(DeviceSwitcherDock *dock_) : dock(dock_)
+{
+	timer.setTimerType(Qt::PreciseTimer);
+	QObject::connect(&timer, &QTimer::timeout, [this] { Tick(); });
+}
+
+DockBenchmark::~DockBenchmark()
+{
+	timer.stop();
+	Cleanup();
+	levelEngine.SetEnabled(engineEnabled);
+}
+
+const char *DockBenchmark::PhaseName(Phase phase)
+{
+	switch (phase) {
+	case Phase::Create:
+		return "create";
+	case Phase::Load:
+		return "load";
+	case Phase::Save:
+		return "save";
+	case Phase::Rename:
+		return "rename";
+	case Phase::Remove:
+		return "remove";
+	case Phase::Volmeters:
+		return "meters_volmeter";
+	case Phase::Engine:
+		return "meters_engine";
+	default:
+		return "done";
+	}
+}
+
+size_t DockBenchmark::Rows() const
+{
+	size_t rows = 0;
+	for (auto w : dock->deviceWidgets) {
+		if (w->sourceType == BENCHMARK_SOURCE_ID)
+			rows++;
+	}
+	return rows;
+}
+
+bool DockBenchmark::Settled() const
+{
+	if (dock->PendingEvents())
+		return false;
+	switch (phase) {
+	case Phase::Create:
+	case Phase::Volmeters:
+	case Phase::Engine:
+		return Rows() == sources.size();
+	case Phase::Remove:
+		return Rows() == 0;
+	default:
+		return true;
+	}
+}
+
+bool DockBenchmark::Metering() const
+{
+	return phase == Phase::Volmeters || phase == Phase::Engine;
+}
+
+// Feeds every source a 1 kHz tone at -12 dBFS in 10 ms blocks, as a device
+// would, so the meters of the rows do their real work.
+void DockBenchmark::StartTone()
+{
+	toneRunning = true;
+	tone = std::thread([this, toneSources = sources] {
+		os_set_thread_name("device-switcher-benchmark-tone");
+		struct obs_audio_info oai = {};
+		const uint32_t rate = obs_get_audio_info(&oai)
+					      ? oai.samples_per_sec
+					      : 48000;
+		// 10 ms always holds whole periods of 1 kHz.
+		std::vector<float> samples(rate / 100);
+		for (size_t i = 0; i < samples.size(); i++)
+			samples[i] = 0.25f * sinf(2.0f * (float)M_PI * 1000.0f *
+						 (float)i / (float)rate);
+		struct obs_source_audio audio = {};
+		audio.data[0] = (const uint8_t *)samples.data();
+		audio.data[1] = audio.data[0];
+		audio.frames = (uint32_t)samples.size();
+		audio.speakers = SPEAKERS_STEREO;
+		audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
+		audio.samples_per_sec = rate;
+		uint64_t ts = os_gettime_ns();
+		while (toneRunning) {
+			audio.timestamp = ts;
+			for (auto source : toneSources)
+				obs_source_output_audio(source, &audio);
+			ts += BENCHMARK_TONE_NS;
+			os_sleepto_ns(ts);
+		}
+	});
+}
+
+void DockBenchmark::StopTone()
+{
+	toneRunning = false;
+	if (tone.joinable())
+		tone.join();
+}
+
+void DockBenchmark::Start()
+{
+	if (Running() || dock->collectionLoading)
+		return;
+	sizes.clear();
+	const char *list = dock->show_config
+				   ? config_get_string(dock->show_config,
+						       "General",
+						       "BenchmarkSizes")
+				   : nullptr;
+	const auto parts = QString::fromUtf8(list ? list : "10,100,1000,5000")
+				   .split(QStringLiteral(","));
+	for (const auto &part : parts) {
+		const auto size = part.trimmed().toULongLong();
+		if (size)
+			sizes.push_back(size);
+	}
+	if (sizes.empty())
+		return;
+	meterTime = dock->show_config
+			    ? config_get_uint(dock->show_config, "General",
+					      "BenchmarkMeterSeconds") *
+				      1000000000ULL
+			    : 0;
+	engineEnabled = levelEngine.Enabled();
+	results.clear();
+	sizeIndex = 0;
+	blog(LOG_INFO, "[Device Switcher] benchmark started, %d sizes",
+	     (int)sizes.size());
+	RunLevelKernels();
+	RunRowKernels();
+	StartPhase(Phase::Create);
+	timer.start(5);
+}
+
+// Cost of one 8 channel audio block in a plain scalar peak and RMS loop
+// and in the level engine kernels. obs_volmeter processing runs inside
+// libobs, the meter runs compare it with the engine per process instead.
+void DockBenchmark::RunLevelKernels()
+{
+	uint64_t scalar, simd, simdTruePeak;
+	LevelEngine::Benchmark(2000, scalar, simd, simdTruePeak);
+	const std::pair<const char *, uint64_t> kernels[] = {
+		{"levels_scalar_loop", scalar},
+		{"levels_engine", simd},
+		{"levels_engine_true_peak", simdTruePeak},
+	};
+	for (const auto &kernel : kernels) {
+		Result result;
+		result.sources = 1;
+		result.phase = kernel.first;
+		result.wall = kernel.second;
+		result.peak = peak_resident_size();
+		results.push_back(result);
+		blog(LOG_INFO,
+		     "[Device Switcher] benchmark %s: %.2f us per 8 channel block",
+		     kernel.first, kernel.second / 1000.0);
+	}
+
+	Result result;
+	result.sources = 1;
+	result.phase = "spectrum_fft";
+	result.wall = SpectrumAnalyzer::Benchmark(2000);
+	result.peak = peak_resident_size();
+	results.push_back(result);
+	blog(LOG_INFO,
+	     "[Device Switcher] benchmark spectrum_fft: %.2f us per analysis",
+	     result.wall / 1000.0);
+}
+
+// Construction time, memory and objects of a row, the full row against
+// the compact one, for the same source.
+void DockBenchmark::RunRowKernels()
+{
+	if (!dock->show_config)
+		return;
+	obs_source_t *source = obs_source_create_private(
+		BENCHMARK_SOURCE_ID, benchmark_source_name(0, false).c_str(),
+		nullptr);
+	obs_properties_t *props = obs_source_properties(source);
+	obs_property_t *prop = obs_properties_get(props, "device_id");
+	std::vector<DeviceWidget *> rows;
+	rows.reserve(BENCHMARK_ROWS);
+	for (const bool compact : {false, true}) {
+		config_set_bool(dock->show_config, BENCHMARK_SOURCE_ID,
+				"Compact", compact);
+		const uint64_t rss = os_get_proc_resident_size();
+		const uint64_t start = os_gettime_ns();
+		for (int i = 0; i < BENCHMARK_ROWS; i++)
+			rows.push_back(new DeviceWidget(
+				source, prop, dock->show_config, dock));
+		Result result;
+		result.sources = BENCHMARK_ROWS;
+		result.phase = compact ? "row_compact" : "row_full";
+		result.wall = os_gettime_ns() - start;
+		result.peak = peak_resident_size();
+		const uint64_t after = os_get_proc_resident_size();
+		result.rowBytes = after > rss ? (after - rss) / BENCHMARK_ROWS
+					      : 0;
+		result.rowObjects =
+			(int)rows.front()->findChildren<QObject *>().size() + 1;
+		qDeleteAll(rows);
+		rows.clear();
+		results.push_back(result);
+		blog(LOG_INFO,
+		     "[Device Switcher] benchmark %s: %.1f us, %d objects, %.1f KB per row",
+		     result.phase, result.wall / 1000.0 / BENCHMARK_ROWS,
+		     result.rowObjects, result.rowBytes / 1024.0);
+	}
+	config_remove_value(dock->show_config, BENCHMARK_SOURCE_ID, "Compact");
+	obs_properties_destroy(props);
+	obs_source_release(source);
+}
+
+void DockBenchmark::StartPhase(Phase next)
+{
+	phase = next;
+	if (phase == Phase::Done)
+		return;
+	dispatchStart = pluginStats.dispatch.total;
+	addStart = pluginStats.addDeviceSource.total;
+	meterStart = 0;
+	phaseStart = os_gettime_ns();
+
+	// The storm itself, every call emits the signal the dock handles.
+	size_t count = sizes[sizeIndex];
+	switch (phase) {
+	case Phase::Create:
+		sources.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			const auto name = benchmark_source_name(i, false);
+			sources.push_back(obs_source_create(BENCHMARK_SOURCE_ID,
+							    name.c_str(),
+							    nullptr, nullptr));
+		}
+		break;
+	case Phase::Load:
+		for (auto source : sources)
+			obs_source_load(source);
+		break;
+	case Phase::Save:
+		for (auto source : sources) {
+			dock->retainStore.Put(source);
+			obs_source_save(source);
+		}
+		break;
+	case Phase::Rename:
+		for (size_t i = 0; i < sources.size(); i++) {
+			const auto name = benchmark_source_name(i, true);
+			obs_source_set_name(sources[i], name.c_str());
+		}
+		break;
+	case Phase::Remove:
+		for (auto source : sources) {
+			obs_source_remove(source);
+			obs_source_release(source);
+		}
+		sources.clear();
+		break;
+	case Phase::Volmeters:
+	case Phase::Engine:
+		// Meters attach when their row is built. Beyond the slots of
+		// the table the engine falls back to volmeters, so both runs
+		// stay within it.
+		levelEngine.SetEnabled(phase == Phase::Engine);
+		count = std::min(count, (size_t)LEVEL_ENGINE_SLOTS);
+		sources.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			const auto name = benchmark_source_name(i, false) +
+					  " " + PhaseName(phase);
+			sources.push_back(obs_source_create(BENCHMARK_SOURCE_ID,
+							    name.c_str(),
+							    nullptr, nullptr));
+		}
+		StartTone();
+		break;
+	default:
+		break;
+	}
+	emitTime = os_gettime_ns() - phaseStart;
+}
+
+void DockBenchmark::EndPhase()
+{
+	if (phase == Phase::Save)
+		dock->retainStore.Flush();
+	const uint64_t ts = os_gettime_ns();
+
+	Result result;
+	result.sources = sizes[sizeIndex];
+	result.phase = PhaseName(phase);
+	result.wall = ts - phaseStart;
+	result.ui = emitTime + (pluginStats.dispatch.total - dispatchStart);
+	result.peak = peak_resident_size();
+	if (Metering()) {
+		StopTone();
+		result.sources = sources.size();
+		result.wall = ts - meterStart;
+		result.cpu = process_cpu_time() - cpuStart;
+		results.push_back(result);
+		blog(LOG_INFO,
+		     "[Device Switcher] benchmark %d rows %s: %.1f ms CPU per second, peak %.1f MB",
+		     (int)result.sources, PhaseName(phase),
+		     result.wall ? result.cpu * 1000.0 / result.wall : 0.0,
+		     result.peak / 1048576.0);
+		for (auto source : sources) {
+			obs_source_remove(source);
+			obs_source_release(source);
+		}
+		sources.clear();
+	} else {
+		results.push_back(result);
+		blog(LOG_INFO,
+		     "[Device Switcher] benchmark %d sources %s: %.1f ms, ui %.1f ms, add rows %.1f ms, %.0f/s, peak %.1f MB",
+		     (int)result.sources, PhaseName(phase),
+		     result.wall / 1000000.0, result.ui / 1000000.0,
+		     (pluginStats.addDeviceSource.total - addStart) / 1000000.0,
+		     result.wall ? result.sources * 1000000000.0 / result.wall
+				 : 0.0,
+		     result.peak / 1048576.0);
+	}
+
+	if (phase != Phase::Engine && (phase != Phase::Remove || meterTime)) {
+		StartPhase((Phase)((int)phase + 1));
+		return;
+	}
+	Cleanup();
+	levelEngine.SetEnabled(engineEnabled);
+	if (++sizeIndex < sizes.size()) {
+		StartPhase(Phase::Create);
+		return;
+	}
+	phase = Phase::Done;
+	timer.stop();
+	Report();
+}
+
+void DockBenchmark::Tick()
+{
+	if (!Running())
+		return;
+	// The meters run on the tone for a fixed time once all rows are up.
+	if (Metering() && meterStart) {
+		if (os_gettime_ns() - meterStart >= meterTime)
+			EndPhase();
+		return;
+	}
+	if (Settled()) {
+		if (!Metering()) {
+			EndPhase();
+			return;
+		}
+		meterStart = os_gettime_ns();
+		cpuStart = process_cpu_time();
+		return;
+	}
+	if (os_gettime_ns() - phaseStart < BENCHMARK_TIMEOUT_NS)
+		return;
+	blog(LOG_WARNING,
+	     "[Device Switcher] benchmark %d sources %s did not settle, %d rows, %d events pending",
+	     (int)sizes[sizeIndex], PhaseName(phase), (int)Rows(),
+	     (int)dock->PendingEvents());
+	timer.stop();
+	phase = Phase::Done;
+	Cleanup();
+	levelEngine.SetEnabled(engineEnabled);
+	Report();
+}
+
+void DockBenchmark::Cleanup()
+{
+	StopTone();
+	for (auto source : sources) {
+		obs_source_remove(source);
+		obs_source_release(source);
+	}
+	sources.clear();
+	if (sizeIndex >= sizes.size())
+		return;
+	// The save phase retained every source, under its first name.
+	for (size_t i = 0; i < sizes[sizeIndex]; i++) {
+		dock->retainStore.Remove(
+			benchmark_source_name(i, false).c_str());
+		dock->retainStore.Remove(
+			benchmark_source_name(i, true).c_str());
+	}
+}
+
+void DockBenchmark::Report()
+{
+	if (char *path = obs_module_config_path("")) {
+		os_mkdirs(path);
+		bfree(path);
+	}
+	char *file = obs_module_config_path("benchmark.csv");
+	if (!file)
+		return;
+	QFile f(QString::fromUtf8(file));
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate |
+		    QIODevice::Text)) {
+		blog(LOG_WARNING, "[Device Switcher] failed to write %s", file);
+		bfree(file);
+		return;
+	}
+	QTextStream out(&f);
+	out << "sources,phase,wall_ms,ui_ms,per_second,peak_rss_mb,row_kb,"
+	       "row_objects,cpu_ms_per_s\n";
+	for (const auto &r : results) {
+		out << r.sources << "," << r.phase << ","
+		    << r.wall / 1000000.0 << "," << r.ui / 1000000.0 << ","
+		    << (r.wall ? r.sources * 1000000000.0 / r.wall : 0.0)
+		    << "," << r.peak / 1048576.0 << ","
+		    << r.rowBytes / 1024.0 << "," << r.rowObjects << ","
+		    << (r.wall ? r.cpu * 1000.0 / r.wall : 0.0) << "\n";
+	}
+	blog(LOG_INFO, "[Device Switcher] benchmark written to %s", file);
+	bfree(file);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QTimer>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "obs.h"
+
+class DeviceSwitcherDock;
+
+void benchmark_register();
+
+// Drives the dock through storms of synthetic device sources: created,
+// loaded, saved while retained, renamed and removed, for each of the
+// configured source counts. The real signal handlers, event queue, rows and
+// retain store do the work, so regressions in the signal path show up
+// without real devices. Runs on the UI thread, in OBS or headless against
+// the fakes in tools/fake-obs (tools/dock-benchmark.cpp).
+//
+// In OBS each size then runs its rows on a test tone for a fixed time,
+// first metered by obs_volmeter and then by the level engine, and records
+// the CPU time of the whole process per second.
+class DockBenchmark {
+	enum class Phase {
+		Create,
+		Load,
+		Save,
+		Rename,
+		Remove,
+		Volmeters,
+		Engine,
+		Done
+	};
+
+	struct Result {
+		size_t sources = 0;
+		const char *phase = nullptr;
+		uint64_t wall = 0;
+		uint64_t ui = 0; // signal emission and event dispatch
+		uint64_t peak = 0; // process high-water mark so far
+		uint64_t rowBytes = 0; // resident growth per row
+		int rowObjects = 0;
+		uint64_t cpu = 0; // process CPU time over wall
+	};
+
+	DeviceSwitcherDock *dock;
+	QTimer timer;
+	std::vector<size_t> sizes;
+	size_t sizeIndex = 0;
+	Phase phase = Phase::Done;
+	std::vector<obs_source_t *> sources;
+	uint64_t phaseStart = 0;
+	uint64_t emitTime = 0;
+	uint64_t dispatchStart = 0;
+	uint64_t addStart = 0;
+	uint64_t meterTime = 0;
+	uint64_t meterStart = 0;
+	uint64_t cpuStart = 0;
+	bool engineEnabled = false;
+	std::thread tone;
+	std::atomic<bool> toneRunning{false};
+	std::vector<Result> results;
+
+	static const char *PhaseName(Phase phase);
+	void RunLevelKernels();
+	void RunRowKernels();
+	size_t Rows() const;
+	bool Settled() const;
+	bool Metering() const;
+	void StartTone();
+	void StopTone();
+	void StartPhase(Phase next);
+	void EndPhase();
+	void Tick();
+	void Cleanup();
+	void Report();
+
+public:
+	explicit DockBenchmark(DeviceSwitcherDock *dock);
+	~DockBenchmark();
+
+	DockBenchmark(const DockBenchmark &) = delete;
+	DockBenchmark &operator=(const DockBenchmark &) = delete;
+
+	bool Running() const { return phase != Phase::Done; }
+	void Start();
+};
@@ -0,0 +1,245 @@
+#include "compact-row.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <QPainter>
+#include <QWidget>
+
+#include "util/platform.h"
+#include "plugin-stats.hpp"
+#include "volume-meter.hpp"
+
+// The scale and ballistics of the full meter.
+#define COMPACT_MINIMUM_DB -60.0f
+#define COMPACT_WARNING_DB -20.0f
+#define COMPACT_ERROR_DB -9.0f
+#define COMPACT_DECAY_DB 11.76f
+#define COMPACT_IDLE_NS 500000000ULL
+
+CompactRow::CompactRow(QWidget *row_) : row(row_)
+{
+	peak = -INFINITY;
+	displayPeak = -INFINITY;
+}
+
+CompactRow::~CompactRow()
+{
+	Detach();
+}
+
+void CompactRow::Detach()
+{
+	if (volmeter) {
+		obs_volmeter_remove_callback(volmeter, OBSVolumeLevel, this);
+		obs_volmeter_destroy(volmeter);
+		volmeter = nullptr;
+		pluginStats.volmeters--;
+	}
+	levelEngine.Detach(levelSlot);
+	levelSlot = -1;
+	if (updateTimer) {
+		updateTimer->RemoveWidget(row);
+		updateTimer.reset();
+	}
+	peak = -INFINITY;
+	displayPeak = -INFINITY;
+	updated = 0;
+}
+
+void CompactRow::SetSource(obs_source_t *source)
+{
+	Detach();
+	if (!source)
+		return;
+	if (levelEngine.Enabled())
+		levelSlot = levelEngine.Attach(source);
+	if (levelSlot < 0) {
+		volmeter = obs_volmeter_create(OBS_FADER_LOG);
+		pluginStats.volmeters++;
+		obs_volmeter_attach_source(volmeter, source);
+		obs_volmeter_add_callback(volmeter, OBSVolumeLevel, this);
+	}
+	updateTimer = VolumeMeter::SharedTimer();
+	updateTimer->AddWidget(row);
+}
+
+void CompactRow::OBSVolumeLevel(void *data,
+				const float magnitude[MAX_AUDIO_CHANNELS],
+				const float peak[MAX_AUDIO_CHANNELS],
+				const float inputPeak[MAX_AUDIO_CHANNELS])
+{
+	UNUSED_PARAMETER(magnitude);
+	UNUSED_PARAMETER(inputPeak);
+	auto row = static_cast<CompactRow *>(data);
+	float max = -INFINITY;
+	for (int ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+		if (peak[ch] > max)
+			max = peak[ch];
+	}
+	// Keep the loudest block until the next paint picks it up.
+	float current = row->peak.load(std::memory_order_relaxed);
+	while (max > current &&
+	       !row->peak.compare_exchange_weak(current, max,
+						std::memory_order_relaxed))
+		;
+	row->updated.store(os_gettime_ns(), std::memory_order_release);
+}
+
+QRect CompactRow::PartRect(const QRect &rect, Part part) const
+{
+	const int h = rect.height();
+	const int muteWidth = audio ? h : 0;
+	const int w = rect.width() - muteWidth;
+	const int name = metered ? w * 3 / 10 : w * 4 / 10;
+	const int device = metered ? w * 3 / 10 : w - name;
+	switch (part) {
+	case Part::Name:
+		return QRect(rect.left(), rect.top(), name, h);
+	case Part::Device:
+		return QRect(rect.left() + name, rect.top(), device, h);
+	case Part::Meter:
+		if (!metered)
+			return QRect();
+		return QRect(rect.left() + name + device, rect.top(),
+			     w - name - device, h);
+	case Part::Mute:
+		if (!audio)
+			return QRect();
+		return QRect(rect.right() - muteWidth + 1, rect.top(),
+			     muteWidth, h);
+	default:
+		return QRect();
+	}
+}
+
+CompactRow::Part CompactRow::HitTest(const QRect &rect,
+				     const QPoint &pos) const
+{
+	for (Part part : {Part::Mute, Part::Meter, Part::Device, Part::Name}) {
+		if (PartRect(rect, part).contains(pos))
+			return part;
+	}
+	return Part::None;
+}
+
+float CompactRow::FaderAt(const QRect &rect, int x) const
+{
+	const QRect meter = PartRect(rect, Part::Meter).adjusted(3, 0, -3, 0);
+	if (meter.width() <= 0)
+		return fader;
+	return std::clamp((float)(x - meter.left()) / meter.width(), 0.0f,
+			  1.0f);
+}
+
+static inline int MeterX(const QRect &meter, float db)
+{
+	const float f = (std::clamp(db, COMPACT_MINIMUM_DB, 0.0f) -
+			 COMPACT_MINIMUM_DB) /
+			-COMPACT_MINIMUM_DB;
+	return meter.left() + (int)(f * meter.width());
+}
+
+void CompactRow::Paint(QPainter &painter, const QRect &rect,
+		       const QPalette &palette, const QString &name)
+{
+	const uint64_t ts = os_gettime_ns();
+	const float elapsed =
+		lastRedraw ? (ts - lastRedraw) * 0.000000001f : 0.0f;
+	lastRedraw = ts;
+
+	painter.fillRect(rect, palette.color(QPalette::Window));
+	const QFontMetrics metrics = painter.fontMetrics();
+	const QColor text = palette.color(QPalette::WindowText);
+	const QColor error(0xff, 0x4c, 0x4c);
+
+	QRect part = PartRect(rect, Part::Name).adjusted(4, 0, -4, 0);
+	painter.setPen(text);
+	painter.drawText(part, Qt::AlignVCenter | Qt::AlignLeft,
+			 metrics.elidedText(name, Qt::ElideRight,
+					    part.width()));
+
+	part = PartRect(rect, Part::Device).adjusted(2, 2, -2, -2);
+	if (!device.isEmpty()) {
+		painter.fillRect(part, palette.color(QPalette::Button));
+		painter.setPen(palette.color(QPalette::ButtonText));
+		const int arrow = part.height() / 2;
+		const QRect label = part.adjusted(4, 0, -arrow - 6, 0);
+		painter.drawText(label, Qt::AlignVCenter | Qt::AlignLeft,
+				 metrics.elidedText(device, Qt::ElideRight,
+						    label.width()));
+		const int x = part.right() - arrow - 3;
+		const int y = part.center().y() - arrow / 4;
+		const QPoint points[3] = {QPoint(x, y),
+					  QPoint(x + arrow, y),
+					  QPoint(x + arrow / 2, y + arrow / 2)};
+		painter.setBrush(palette.color(QPalette::ButtonText));
+		painter.setPen(Qt::NoPen);
+		painter.drawPolygon(points, 3);
+		painter.setBrush(Qt::NoBrush);
+	}
+
+	const QRect meter =
+		PartRect(rect, Part::Meter).adjusted(3, 4, -3, -4);
+	if (metered && meter.width() > 0) {
+		float level = -INFINITY;
+		if (levelSlot >= 0) {
+			if (levelEngine.Read(levelSlot, reading)) {
+				for (int ch = 0; ch < reading.channels; ch++)
+					level = std::max(level,
+							 reading.peak[ch]);
+				updated = reading.updated;
+			}
+		} else {
+			level = peak.exchange(-INFINITY,
+					      std::memory_order_relaxed);
+		}
+		if (ts - updated.load(std::memory_order_acquire) >
+		    COMPACT_IDLE_NS)
+			displayPeak = -INFINITY;
+		else if (level >= displayPeak || std::isnan(displayPeak))
+			displayPeak = level;
+		else
+			displayPeak = std::max(
+				displayPeak - COMPACT_DECAY_DB * elapsed, level);
+
+		const int warning = MeterX(meter, COMPACT_WARNING_DB);
+		const int error_ = MeterX(meter, COMPACT_ERROR_DB);
+		const int peakX = MeterX(meter, displayPeak);
+		const int top = meter.top();
+		const int height = meter.height();
+		painter.fillRect(meter.left(), top, warning - meter.left(),
+				 height, QColor(0x26, 0x7f, 0x26));
+		painter.fillRect(warning, top, error_ - warning, height,
+				 QColor(0x7f, 0x7f, 0x26));
+		painter.fillRect(error_, top, meter.right() + 1 - error_,
+				 height, QColor(0x7f, 0x26, 0x26));
+		if (displayPeak > COMPACT_MINIMUM_DB) {
+			painter.fillRect(meter.left(), top,
+					 std::min(peakX, warning) - meter.left(),
+					 height, QColor(0x4c, 0xff, 0x4c));
+			if (peakX > warning)
+				painter.fillRect(warning, top,
+						 std::min(peakX, error_) -
+							 warning,
+						 height,
+						 QColor(0xff, 0xff, 0x4c));
+			if (peakX > error_)
+				painter.fillRect(error_, top, peakX - error_,
+						 height, error);
+		}
+		const int faderX = meter.left() + (int)(fader * meter.width());
+		painter.fillRect(std::min(faderX, meter.right() - 1),
+				 meter.top() - 2, 2, meter.height() + 4, text);
+	}
+
+	part = PartRect(rect, Part::Mute).adjusted(4, 4, -4, -4);
+	if (audio && part.width() > 0) {
+		painter.setPen(text);
+		if (muted) {
+			painter.fillRect(part, error);
+			painter.drawLine(part.topLeft(), part.bottomRight());
+			painter.drawLine(part.topRight(), part.bottomLeft());
+		}
+		painter.drawRect(part.adjusted(0, 0, -1, -1));
+	}
+}
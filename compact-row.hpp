@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QPalette>
+#include <QRect>
+#include <QSharedPointer>
+#include <QString>
+#include <atomic>
+
+#include "obs.h"
+#include "level-engine.hpp"
+
+class QPainter;
+class QWidget;
+class VolumeMeterTimer;
+
+// What a compact row shows, painted by the row widget itself: the name,
+// the device, one meter bar of the loudest channel with the
+// volume fader marker, and mute. The row creates no child widgets, it
+// hit-tests clicks with Part and opens editors only when asked. Levels
+// come from the level engine when enabled, otherwise a volmeter of its
+// own.
+class CompactRow {
+public:
+	enum class Part { None, Name, Device, Meter, Mute };
+
+	QString device;
+	bool switchable = false; // device shown and switched from the row
+	float fader = 1.0f; // 0..1 on the volume slider scale
+	bool muted = false;
+	bool audio = false;
+	bool metered = false;
+	// Context menu entries, the show settings of the full row.
+	bool properties = false;
+	bool filters = false;
+	bool restart = false;
+	bool monitor = false;
+	bool retain = false;
+
+	explicit CompactRow(QWidget *row);
+	~CompactRow();
+
+	CompactRow(const CompactRow &) = delete;
+	CompactRow &operator=(const CompactRow &) = delete;
+
+	// Meters another source, or none.
+	void SetSource(obs_source_t *source);
+
+	int Height(int fontHeight) const { return fontHeight + 6; }
+	QRect PartRect(const QRect &rect, Part part) const;
+	Part HitTest(const QRect &rect, const QPoint &pos) const;
+	// The fader position for a click at x inside the meter.
+	float FaderAt(const QRect &rect, int x) const;
+	void Paint(QPainter &painter, const QRect &rect,
+		   const QPalette &palette, const QString &name);
+
+private:
+	QWidget *row;
+	QSharedPointer<VolumeMeterTimer> updateTimer;
+	obs_volmeter_t *volmeter = nullptr;
+	int levelSlot = -1;
+	LevelReading reading;
+	// Loudest channel since the last paint, from the audio thread.
+	std::atomic<float> peak;
+	std::atomic<uint64_t> updated{0};
+	float displayPeak;
+	uint64_t lastRedraw = 0;
+
+	void Detach();
+	static void OBSVolumeLevel(void *data,
+				   const float magnitude[MAX_AUDIO_CHANNELS],
+				   const float peak[MAX_AUDIO_CHANNELS],
+				   const float inputPeak[MAX_AUDIO_CHANNELS]);
+};
@@ -0,0 +1,101 @@
+#include "device-probe.hpp"
+
+#include <cstring>
+#include <obs-module.h>
+
+#include "util/platform.h"
+
+static const char *device_probe_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return obs_module_text("DeviceProbe");
+}
+
+static void *device_probe_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	auto probe = new DeviceProbe;
+	probe->context = source;
+	return probe;
+}
+
+static void device_probe_destroy(void *data)
+{
+	delete static_cast<DeviceProbe *>(data);
+}
+
+static struct obs_source_frame *
+device_probe_filter_video(void *data, struct obs_source_frame *frame)
+{
+	auto probe = static_cast<DeviceProbe *>(data);
+	const uint64_t ts = os_gettime_ns();
+	probe->frames.fetch_add(1, std::memory_order_relaxed);
+	probe->lastFrame.store(ts, std::memory_order_relaxed);
+	const uint64_t armed = probe->armedAt.load(std::memory_order_acquire);
+	if (armed && ts >= armed) {
+		uint64_t none = 0;
+		probe->firstFrame.compare_exchange_strong(
+			none, ts, std::memory_order_relaxed);
+	}
+	std::lock_guard<std::mutex> lock(probe->forwardMutex);
+	if (auto target = obs_weak_source_get_source(probe->forward)) {
+		obs_source_output_video(target, frame);
+		obs_source_release(target);
+	}
+	return frame;
+}
+
+void DeviceProbe::SetForward(obs_weak_source_t *target)
+{
+	obs_weak_source_addref(target);
+	std::lock_guard<std::mutex> lock(forwardMutex);
+	obs_weak_source_release(forward);
+	forward = target;
+}
+
+void device_probe_register()
+{
+	struct obs_source_info info = {};
+	info.id = DEVICE_PROBE_ID;
+	info.type = OBS_SOURCE_TYPE_FILTER;
+	info.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_CAP_DISABLED;
+	info.get_name = device_probe_get_name;
+	info.create = device_probe_create;
+	info.destroy = device_probe_destroy;
+	info.filter_video = device_probe_filter_video;
+	obs_register_source(&info);
+}
+
+bool device_probe_is_probe(obs_source_t *filter)
+{
+	const char *id = obs_source_get_unversioned_id(filter);
+	return id && strcmp(id, DEVICE_PROBE_ID) == 0;
+}
+
+static void find_probe(obs_source_t *parent, obs_source_t *filter,
+		       void *param)
+{
+	UNUSED_PARAMETER(parent);
+	auto found = static_cast<obs_source_t **>(param);
+	if (!*found && device_probe_is_probe(filter))
+		*found = obs_source_get_ref(filter);
+}
+
+obs_source_t *device_probe_attach(obs_source_t *source)
+{
+	obs_source_t *filter = nullptr;
+	obs_source_enum_filters(source, find_probe, &filter);
+	if (filter)
+		return filter;
+	filter = obs_source_create_private(
+		DEVICE_PROBE_ID, obs_module_text("DeviceProbe"), nullptr);
+	if (filter)
+		obs_source_filter_add(source, filter);
+	return filter;
+}
+
+DeviceProbe *device_probe_get(obs_source_t *filter)
+{
+	return filter ? static_cast<DeviceProbe *>(obs_obj_get_data(filter))
+		      : nullptr;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+#include "obs.h"
+
+#define DEVICE_PROBE_ID "device_switcher_probe"
+
+// State of the pass-through probe filter. Frames are counted on the
+// thread that outputs them; once armed the first frame at or after the
+// armed time is recorded. When forward is set, every frame is also
+// output on that source.
+struct DeviceProbe {
+	obs_source_t *context = nullptr;
+	// Holds a reference of its own, the mutex keeps it alive while a
+	// frame is output on it.
+	std::mutex forwardMutex;
+	obs_weak_source_t *forward = nullptr;
+	std::atomic<uint64_t> frames{0};
+	std::atomic<uint64_t> lastFrame{0};
+	std::atomic<uint64_t> armedAt{0};
+	std::atomic<uint64_t> firstFrame{0};
+
+	void Arm(uint64_t ts)
+	{
+		firstFrame.store(0, std::memory_order_relaxed);
+		armedAt.store(ts, std::memory_order_release);
+	}
+	void Disarm() { armedAt.store(0, std::memory_order_release); }
+	// Outputs every frame on target from now on, or on nothing. Returns
+	// once a frame being output on the previous target is done.
+	void SetForward(obs_weak_source_t *target);
+	~DeviceProbe() { obs_weak_source_release(forward); }
+};
+
+void device_probe_register();
+
+// Returns a reference to the probe filter on source, creating and adding
+// it when there is none yet.
+obs_source_t *device_probe_attach(obs_source_t *source);
+DeviceProbe *device_probe_get(obs_source_t *filter);
+bool device_probe_is_probe(obs_source_t *filter);
@@ -0,0 +1,205 @@
+#include "device-scheduler.hpp"
+
+#include "device-switcher.hpp"
+#include "util/config-file.h"
+#include "util/platform.h"
+
+#define SCHEDULER_DEFAULT_LIMIT 2
+#define SCHEDULER_MAX_ATTEMPTS 3
+#define SCHEDULER_BACKOFF_NS 1000000000ULL
+
+DeviceScheduler::DeviceScheduler(DeviceSwitcherDock *dock) : dock(dock) {}
+
+DeviceScheduler::~DeviceScheduler()
+{
+	for (auto &job : jobs) {
+		obs_data_release(job.settings);
+		obs_data_array_release(job.filters);
+	}
+}
+
+int DeviceScheduler::Limit(const std::string &bus) const
+{
+	config_t *config = dock->show_config;
+	int limit = SCHEDULER_DEFAULT_LIMIT;
+	if (config && config_has_user_value(config, "Scheduler", bus.c_str()))
+		limit = (int)config_get_int(config, "Scheduler", bus.c_str());
+	else if (config &&
+		 config_has_user_value(config, "Scheduler", "Default"))
+		limit = (int)config_get_int(config, "Scheduler", "Default");
+	return limit > 0 ? limit : 1;
+}
+
+uint64_t DeviceScheduler::Begin(const char *label, DeviceBatchDone done)
+{
+	const uint64_t id = ++nextBatch;
+	Batch &batch = batches[id];
+	batch.label = label ? label : "";
+	batch.done = std::move(done);
+	batch.start = os_gettime_ns();
+	return id;
+}
+
+void DeviceScheduler::Add(uint64_t batch, uint64_t widgetId, const char *name,
+			  const char *bus, obs_data_t *settings,
+			  obs_data_array_t *filters)
+{
+	const auto it = batches.find(batch);
+	if (it == batches.end())
+		return;
+	Job job;
+	job.batch = batch;
+	job.widgetId = widgetId;
+	job.name = name ? name : "";
+	job.bus = bus ? bus : "";
+	job.settings = settings;
+	obs_data_addref(settings);
+	job.filters = filters;
+	obs_data_array_addref(filters);
+	job.queued = os_gettime_ns();
+	jobs.push_back(std::move(job));
+	it->second.remaining++;
+}
+
+void DeviceScheduler::Commit(uint64_t batch)
+{
+	const auto it = batches.find(batch);
+	if (it == batches.end())
+		return;
+	it->second.committed = true;
+	FinishBatches(os_gettime_ns());
+}
+
+bool DeviceScheduler::Start(Job &job, uint64_t ts)
+{
+	DeviceWidget *w = dock->deviceWidgets.value(job.widgetId);
+	obs_source_t *s = w ? obs_weak_source_get_source(w->source) : nullptr;
+	if (!s)
+		return false;
+	if (job.filters)
+		dock->LoadFilters(s, job.filters);
+	job.timeouts = w->switchHistogram.timeouts;
+	w->ApplySettings(s, job.settings);
+	obs_source_release(s);
+	job.state = JobState::Opening;
+	job.started = ts;
+	job.attempts++;
+	opening[job.bus]++;
+	return true;
+}
+
+bool DeviceScheduler::Poll(Job &job, uint64_t ts)
+{
+	DeviceWidget *w = dock->deviceWidgets.value(job.widgetId);
+	if (!w) {
+		Finish(job, false, ts);
+		return true;
+	}
+	if (!w->switchStart) {
+		if (w->switchHistogram.timeouts != job.timeouts &&
+		    Retry(job, ts))
+			return false;
+		Finish(job, w->switchHistogram.timeouts == job.timeouts, ts);
+		return true;
+	}
+	if (w->measureVideo && w->switchApplied) {
+		obs_source_t *s = obs_weak_source_get_source(w->source);
+		const bool showing = s && obs_source_showing(s);
+		obs_source_release(s);
+		// Hidden sources do not render, so their frames can not be
+		// seen; applied settings are all there is to wait for.
+		if (!showing) {
+			w->EndSwitchMeasure();
+			Finish(job, true, ts);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DeviceScheduler::Retry(Job &job, uint64_t ts)
+{
+	if (job.attempts >= SCHEDULER_MAX_ATTEMPTS)
+		return false;
+	DeviceWidget *w = dock->deviceWidgets.value(job.widgetId);
+	obs_source_t *s = w ? obs_weak_source_get_source(w->source) : nullptr;
+	if (!s)
+		return false;
+	blog(LOG_WARNING,
+	     "[Device Switcher] '%s' did not open, attempt %d of %d",
+	     job.name.c_str(), job.attempts, SCHEDULER_MAX_ATTEMPTS);
+	// Close the device, so applying the settings again reopens it.
+	auto clear = obs_data_create();
+	obs_data_set_string(clear, w->settingName.c_str(), "");
+	obs_source_update(s, clear);
+	obs_data_release(clear);
+	obs_source_release(s);
+	opening[job.bus]--;
+	job.state = JobState::Backoff;
+	job.retryAt = ts + (SCHEDULER_BACKOFF_NS << (job.attempts - 1));
+	return true;
+}
+
+void DeviceScheduler::Finish(Job &job, bool live, uint64_t ts)
+{
+	if (job.state == JobState::Opening)
+		opening[job.bus]--;
+	job.state = JobState::Done;
+	const auto it = batches.find(job.batch);
+	if (it != batches.end()) {
+		DeviceJobResult result;
+		result.name = job.name;
+		result.live = live;
+		result.attempts = job.attempts;
+		if (job.started) {
+			result.wait = job.started - job.queued;
+			result.open = ts - job.started;
+		}
+		it->second.results.push_back(std::move(result));
+		it->second.remaining--;
+	}
+	obs_data_release(job.settings);
+	job.settings = nullptr;
+	obs_data_array_release(job.filters);
+	job.filters = nullptr;
+}
+
+void DeviceScheduler::FinishBatches(uint64_t ts)
+{
+	std::vector<Batch> done;
+	for (auto it = batches.begin(); it != batches.end();) {
+		if (it->second.committed && !it->second.remaining) {
+			done.push_back(std::move(it->second));
+			it = batches.erase(it);
+		} else {
+			++it;
+		}
+	}
+	// Callbacks may start new batches.
+	for (auto &batch : done) {
+		if (batch.done)
+			batch.done(batch.label, batch.results, ts - batch.start);
+	}
+}
+
+bool DeviceScheduler::Tick(uint64_t ts)
+{
+	for (auto it = jobs.begin(); it != jobs.end();) {
+		Job &job = *it;
+		if (job.state == JobState::Opening && Poll(job, ts)) {
+			it = jobs.erase(it);
+			continue;
+		}
+		if (job.state == JobState::Backoff && ts >= job.retryAt)
+			job.state = JobState::Queued;
+		if (job.state == JobState::Queued &&
+		    opening[job.bus] < Limit(job.bus) && !Start(job, ts)) {
+			Finish(job, false, ts);
+			it = jobs.erase(it);
+			continue;
+		}
+		++it;
+	}
+	FinishBatches(ts);
+	return !jobs.empty();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "obs.h"
+
+class DeviceSwitcherDock;
+
+// Outcome of one source in a batch.
+struct DeviceJobResult {
+	std::string name;
+	bool live = false;
+	int attempts = 0;
+	uint64_t wait = 0; // queued until the device was opened
+	uint64_t open = 0; // opened until the first frame or audio block
+};
+
+typedef std::function<void(const std::string &label,
+			   const std::vector<DeviceJobResult> &results,
+			   uint64_t total)>
+	DeviceBatchDone;
+
+// Applies device settings to the rows of a batch. Devices on the same bus
+// are opened with at most the configured number in flight, independent
+// buses open in parallel. A device that does not come up is closed and
+// tried again after a growing delay. Runs on the UI thread and is driven
+// by Tick.
+class DeviceScheduler {
+	enum class JobState { Queued, Opening, Backoff, Done };
+
+	struct Job {
+		uint64_t batch = 0;
+		uint64_t widgetId = 0;
+		std::string name;
+		std::string bus;
+		obs_data_t *settings = nullptr;
+		obs_data_array_t *filters = nullptr;
+		JobState state = JobState::Queued;
+		int attempts = 0;
+		uint64_t queued = 0;
+		uint64_t started = 0;
+		uint64_t retryAt = 0;
+		uint32_t timeouts = 0;
+	};
+
+	struct Batch {
+		std::string label;
+		DeviceBatchDone done;
+		uint64_t start = 0;
+		size_t remaining = 0;
+		bool committed = false;
+		std::vector<DeviceJobResult> results;
+	};
+
+	DeviceSwitcherDock *dock;
+	std::list<Job> jobs;
+	std::map<uint64_t, Batch> batches;
+	std::map<std::string, int> opening;
+	uint64_t nextBatch = 0;
+
+	bool Start(Job &job, uint64_t ts);
+	bool Poll(Job &job, uint64_t ts);
+	bool Retry(Job &job, uint64_t ts);
+	void Finish(Job &job, bool live, uint64_t ts);
+	void FinishBatches(uint64_t ts);
+
+public:
+	explicit DeviceScheduler(DeviceSwitcherDock *dock);
+	~DeviceScheduler();
+
+	DeviceScheduler(const DeviceScheduler &) = delete;
+	DeviceScheduler &operator=(const DeviceScheduler &) = delete;
+
+	uint64_t Begin(const char *label, DeviceBatchDone done);
+	void Add(uint64_t batch, uint64_t widgetId, const char *name,
+		 const char *bus, obs_data_t *settings,
+		 obs_data_array_t *filters);
+	// No more jobs follow, the batch completes once its jobs are done.
+	void Commit(uint64_t batch);
+
+	// Returns false once there is nothing left to do.
+	bool Tick(uint64_t ts);
+	size_t Pending() const { return jobs.size(); }
+	int Limit(const std::string &bus) const;
+};
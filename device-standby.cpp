@@ -0,0 +1,156 @@
+#include "device-standby.hpp"
+
+#include "device-probe.hpp"
+
+DeviceStandby::DeviceStandby(obs_source_t *primary, const char *settingName,
+			     const char *deviceId)
+	: primary(obs_source_get_weak_source(primary)), deviceId(deviceId)
+{
+	obs_get_audio_info(&audioInfo);
+
+	auto settings = obs_data_create();
+	if (auto current = obs_source_get_settings(primary)) {
+		obs_data_apply(settings, current);
+		obs_data_release(current);
+	}
+	obs_data_set_string(settings, settingName, deviceId);
+	std::string name = obs_source_get_name(primary);
+	name += " (standby)";
+	source = obs_source_create_private(obs_source_get_id(primary),
+					   name.c_str(), settings);
+	obs_data_release(settings);
+	if (!source) {
+		blog(LOG_WARNING,
+		     "[Device Switcher] failed to create standby for '%s'",
+		     obs_source_get_name(primary));
+		return;
+	}
+	// Sources that close their device when hidden must stay open.
+	obs_source_inc_showing(source);
+
+	const uint32_t flags = obs_source_get_output_flags(source);
+	if (flags & OBS_SOURCE_VIDEO)
+		probe = device_probe_attach(source);
+	if (flags & OBS_SOURCE_AUDIO)
+		obs_source_add_audio_capture_callback(source, AudioCaptured,
+						      this);
+}
+
+DeviceStandby::~DeviceStandby()
+{
+	Deactivate();
+	if (source) {
+		obs_source_remove_audio_capture_callback(source, AudioCaptured,
+							 this);
+		obs_source_dec_showing(source);
+		obs_source_release(source);
+	}
+	obs_source_release(probe);
+	if (texrender) {
+		obs_enter_graphics();
+		gs_texrender_destroy(texrender);
+		obs_leave_graphics();
+	}
+	obs_weak_source_release(primary);
+}
+
+uint64_t DeviceStandby::Frames() const
+{
+	uint64_t frames = audioBlocks.load(std::memory_order_relaxed);
+	if (auto p = device_probe_get(probe))
+		frames += p->frames.load(std::memory_order_relaxed);
+	return frames;
+}
+
+void DeviceStandby::Activate()
+{
+	if (!source || active)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(primaryMutex);
+		active = true;
+		if (auto p = device_probe_get(probe))
+			p->SetForward(primary);
+	}
+	if (device_probe_get(probe)) {
+		// Async frames only pass the filters when the source renders.
+		if (!texrender) {
+			obs_enter_graphics();
+			texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+			obs_leave_graphics();
+		}
+		obs_add_main_render_callback(Render, this);
+	}
+}
+
+void DeviceStandby::Deactivate()
+{
+	if (!active)
+		return;
+	if (auto p = device_probe_get(probe)) {
+		// Removing the callback waits for a running render to finish.
+		obs_remove_main_render_callback(Render, this);
+		p->SetForward(nullptr);
+	}
+	// Once the lock is taken no audio block is output on the primary
+	// anymore, it may reopen its own device right after.
+	std::lock_guard<std::mutex> lock(primaryMutex);
+	active = false;
+}
+
+void DeviceStandby::Retarget(obs_source_t *primary)
+{
+	Deactivate();
+	std::lock_guard<std::mutex> lock(primaryMutex);
+	obs_weak_source_release(this->primary);
+	this->primary = obs_source_get_weak_source(primary);
+}
+
+void DeviceStandby::Render(void *param, uint32_t cx, uint32_t cy)
+{
+	UNUSED_PARAMETER(cx);
+	UNUSED_PARAMETER(cy);
+	auto standby = static_cast<DeviceStandby *>(param);
+	uint32_t width = obs_source_get_width(standby->source);
+	uint32_t height = obs_source_get_height(standby->source);
+	if (!width || !height)
+		width = height = 1;
+	// The output is not used, a single pixel target is enough to make
+	// the frames pass the probe.
+	gs_texrender_reset(standby->texrender);
+	if (gs_texrender_begin(standby->texrender, 1, 1)) {
+		gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f,
+			 100.0f);
+		obs_source_video_render(standby->source);
+		gs_texrender_end(standby->texrender);
+	}
+}
+
+void DeviceStandby::AudioCaptured(void *param, obs_source_t *source,
+				  const struct audio_data *audio_data,
+				  bool muted)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(muted);
+	auto standby = static_cast<DeviceStandby *>(param);
+	standby->audioBlocks.fetch_add(1, std::memory_order_relaxed);
+	if (!standby->active.load(std::memory_order_acquire))
+		return;
+	std::lock_guard<std::mutex> lock(standby->primaryMutex);
+	if (!standby->active.load(std::memory_order_relaxed))
+		return;
+	auto target = obs_weak_source_get_source(standby->primary);
+	if (!target)
+		return;
+	// Captured audio is already converted to the output format.
+	struct obs_source_audio audio = {};
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		audio.data[i] = audio_data->data[i];
+	audio.frames = audio_data->frames;
+	audio.timestamp = audio_data->timestamp;
+	audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
+	audio.speakers = standby->audioInfo.speakers;
+	audio.samples_per_sec = standby->audioInfo.samples_per_sec;
+	obs_source_output_audio(target, &audio);
+	obs_source_release(target);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "obs.h"
+
+// Keeps a backup device open in a private source of the same type as the
+// primary, so a row can fail over to it without waiting for the device to
+// open. While active, the frames and audio of the backup are output on
+// the primary source, the primary itself stays in the scenes unchanged.
+class DeviceStandby {
+	// Guards primary and the audio output on it, so Retarget and
+	// Deactivate wait for a block being forwarded.
+	std::mutex primaryMutex;
+	obs_weak_source_t *primary = nullptr;
+	obs_source_t *source = nullptr;
+	obs_source_t *probe = nullptr;
+	std::string deviceId;
+	std::atomic<bool> active{false};
+	std::atomic<uint64_t> audioBlocks{0};
+	gs_texrender_t *texrender = nullptr;
+	struct obs_audio_info audioInfo = {};
+
+	static void AudioCaptured(void *param, obs_source_t *source,
+				  const struct audio_data *audio_data,
+				  bool muted);
+	static void Render(void *param, uint32_t cx, uint32_t cy);
+
+public:
+	DeviceStandby(obs_source_t *primary, const char *settingName,
+		      const char *deviceId);
+	~DeviceStandby();
+
+	DeviceStandby(const DeviceStandby &) = delete;
+	DeviceStandby &operator=(const DeviceStandby &) = delete;
+
+	const std::string &DeviceId() const { return deviceId; }
+	bool Active() const { return active; }
+	// Frames and audio blocks received from the standby device.
+	uint64_t Frames() const;
+
+	void Activate();
+	void Deactivate();
+	// Forwards to another primary from now on, the standby stays open.
+	void Retarget(obs_source_t *primary);
+};
@@ -1,14 +1,27 @@
 #include "device-switcher.hpp"
+#include <algorithm>
 #include <obs-module.h>
+#include <QAction>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QContextMenuEvent>
+#include <QFile>
+#include <QInputDialog>
 #include <QLabel>
 #include <QMainWindow>
+#include <QMenu>
+#include <QMouseEvent>
+#include <QPainter>
 #include <QPushButton>
 #include <QScrollArea>
+#include <QStringList>
+#include <QTextStream>
 #include <QVBoxLayout>
 
+#include "plugin-stats.hpp"
+#include "trace.hpp"
 #include "version.h"
+#include "device-probe.hpp"
 #include "volume-meter.hpp"
 #include "util/config-file.h"
 #include "util/platform.h"
@@ -24,10 +37,24 @@ OBS_MODULE_USE_DEFAULT_LOCALE("device-switcher", "en-US")
 /* equals -log10f(-LOG_RANGE_DB + LOG_OFFSET_DB) */
 #define LOG_RANGE_VAL -2.00860017176191756f
 
+// Position of a volume on the log scale of the volume slider, 0..1.
+static float VolumeToFader(float mul)
+{
+	const float db = obs_mul_to_db(mul);
+	if (db >= 0.0f)
+		return 1.0f;
+	if (db <= -96.0f)
+		return 0.0f;
+	return (-log10f(-db + LOG_OFFSET_DB) - LOG_RANGE_VAL) /
+	       (LOG_OFFSET_VAL - LOG_RANGE_VAL);
+}
+
 bool obs_module_load()
 {
 	blog(LOG_INFO, "[Device Switcher] loaded version %s", PROJECT_VERSION);
 
+	device_probe_register();
+
 	const auto main_window =
 		static_cast<QMainWindow *>(obs_frontend_get_main_window());
 	obs_frontend_push_ui_translation(obs_module_get_string);
@@ -37,7 +64,11 @@ bool obs_module_load()
 	return true;
 }
 
-void obs_module_unload() {}
+void obs_module_unload()
+{
+	levelExport.Close();
+	telemetry.Stop();
+}
 
 MODULE_EXPORT const char *obs_module_description(void)
 {
@@ -52,61 +83,64 @@ MODULE_EXPORT const char *obs_module_name(void)
 #define QT_UTF8(str) QString::fromUtf8(str)
 #define QT_TO_UTF8(str) str.toUtf8().constData()
 
+void DeviceSwitcherDock::PostSourceEvent(PluginEventType type,
+					 obs_source_t *source)
+{
+	PluginEvent event = {};
+	event.type = type;
+	event.source = obs_source_get_weak_source(source);
+	events.Push(event);
+}
+
 void DeviceSwitcherDock::add_source(void *p, calldata_t *calldata)
 {
+	ProfileScope scope("DeviceSwitcherDock::add_source");
 	auto source = (obs_source_t *)calldata_ptr(calldata, "source");
 	if (!is_device_source(source))
 		return;
 
-	QString deviceName = QString::fromUtf8(obs_source_get_name(source));
-
-	QMetaObject::invokeMethod((DeviceSwitcherDock *)p, "AddDeviceSource",
-				  Qt::QueuedConnection,
-				  Q_ARG(QString, deviceName));
+	static_cast<DeviceSwitcherDock *>(p)->PostSourceEvent(
+		PluginEventType::AddSource, source);
 }
 
 void DeviceSwitcherDock::remove_source(void *p, calldata_t *calldata)
 {
+	ProfileScope scope("DeviceSwitcherDock::remove_source");
 	auto source = (obs_source_t *)calldata_ptr(calldata, "source");
 	if (!is_device_source(source))
 		return;
 
-	QString deviceName = QT_UTF8(obs_source_get_name(source));
-
-	QMetaObject::invokeMethod((DeviceSwitcherDock *)p, "RemoveDeviceSource",
-				  Qt::QueuedConnection,
-				  Q_ARG(QString, deviceName));
+	static_cast<DeviceSwitcherDock *>(p)->PostSourceEvent(
+		PluginEventType::RemoveSource, source);
 }
 
 void DeviceSwitcherDock::rename_source(void *p, calldata_t *calldata)
 {
-	auto prev_name = calldata_string(calldata, "prev_name");
+	ProfileScope scope("DeviceSwitcherDock::rename_source");
+	auto source = (obs_source_t *)calldata_ptr(calldata, "source");
 	auto new_name = calldata_string(calldata, "new_name");
-	if (!prev_name || !new_name)
-		return;
-	QString prevDeviceName = QT_UTF8(prev_name);
-	QString newDeviceName = QT_UTF8(new_name);
-	if (prevDeviceName.isEmpty() || newDeviceName.isEmpty())
+	if (!source || !new_name || !*new_name)
 		return;
-	QMetaObject::invokeMethod((DeviceSwitcherDock *)p, "RenameDeviceSource",
-				  Qt::QueuedConnection,
-				  Q_ARG(QString, prevDeviceName),
-				  Q_ARG(QString, newDeviceName));
+	static_cast<DeviceSwitcherDock *>(p)->PostSourceEvent(
+		PluginEventType::RenameSource, source);
 }
 
 void DeviceSwitcherDock::save_source(void *p, calldata_t *calldata)
 {
+	ProfileScope scope("DeviceSwitcherDock::save_source");
 	auto source = (obs_source_t *)calldata_ptr(calldata, "source");
 	if (!is_device_source(source))
 		return;
 	add_source(p, calldata);
 	auto dock = (DeviceSwitcherDock *)p;
-	if (!dock->retain_config)
+	// Saves can run on any thread, so the rows are not looked at, the
+	// store captures a failed over source with the device its row
+	// published for saving. Not retained, or a Put is still queued that
+	// captured it already. The writer checks again, a queued Remove may
+	// still drop it.
+	if (!dock->retainStore.Has(obs_source_get_name(source)))
 		return;
-	QString deviceName = QT_UTF8(obs_source_get_name(source));
-	if (!dock->HasSourceSettings(deviceName))
-		return;
-	dock->SaveSourceSettings(source);
+	dock->retainStore.Refresh(source);
 }
 
 bool DeviceSwitcherDock::is_device_source(obs_source_t *source)
@@ -132,237 +166,257 @@ bool DeviceSwitcherDock::add_monitoring_device(void *data, const char *name,
 					       const char *id)
 {
 	const auto dock = static_cast<DeviceSwitcherDock *>(data);
-	dock->monitoringCombo->addItem(QString::fromUtf8(name),
-				       QString::fromUtf8(id));
+	const auto deviceId = QString::fromUtf8(id);
+	dock->monitoringDeviceIndex.insert(deviceId,
+					   dock->monitoringCombo->count());
+	dock->monitoringCombo->addItem(QString::fromUtf8(name), deviceId);
 	return true;
 }
 
+struct MonitoringDeviceTask {
+	DeviceSwitcherDock *dock;
+	uint64_t generation;
+	config_t *config;
+	std::string name;
+	std::string id;
+};
+
+void DeviceSwitcherDock::set_monitoring_device(void *param)
+{
+	auto task = static_cast<MonitoringDeviceTask *>(param);
+	// Only the latest selection matters, skip anything superseded while
+	// it was waiting in the queue.
+	if (task->generation == task->dock->monitoringGeneration.load()) {
+		obs_set_audio_monitoring_device(task->name.c_str(),
+						task->id.c_str());
+		if (task->config) {
+			config_set_string(task->config, "Audio",
+					  "MonitoringDeviceName",
+					  task->name.c_str());
+			config_set_string(task->config, "Audio",
+					  "MonitoringDeviceId",
+					  task->id.c_str());
+			config_save(task->config);
+		}
+	}
+	delete task;
+}
+
+void DeviceSwitcherDock::RefreshMonitoringDevices()
+{
+	if (!monitoringCombo)
+		return;
+	QSignalBlocker blocker(monitoringCombo);
+	monitoringCombo->clear();
+	monitoringDeviceIndex.clear();
+	monitoringDeviceIndex.insert(QStringLiteral("default"), 0);
+	monitoringCombo->addItem(QString::fromUtf8(obs_module_text("Default")),
+				 QStringLiteral("default"));
+	obs_enum_audio_monitoring_devices(add_monitoring_device, this);
+}
+
+void DeviceSwitcherDock::SelectMonitoringDevice(const QString &id)
+{
+	if (!monitoringCombo)
+		return;
+	auto it = monitoringDeviceIndex.constFind(id);
+	if (it == monitoringDeviceIndex.constEnd()) {
+		// An unknown id means the device list changed since the last
+		// enumeration, so this is the only time we enumerate again.
+		RefreshMonitoringDevices();
+		it = monitoringDeviceIndex.constFind(id);
+	}
+	QSignalBlocker blocker(monitoringCombo);
+	monitoringCombo->setCurrentIndex(
+		it == monitoringDeviceIndex.constEnd() ? 0 : it.value());
+}
+
 void DeviceSwitcherDock::frontend_event(enum obs_frontend_event event,
 					void *data)
 {
-	if (event == OBS_FRONTEND_EVENT_PROFILE_CHANGED) {
+	if (event == OBS_FRONTEND_EVENT_PROFILE_CHANGING) {
+		// Pending writes hold the config of the profile being left.
+		const auto dock = static_cast<DeviceSwitcherDock *>(data);
+		if (dock && dock->taskQueue)
+			os_task_queue_wait(dock->taskQueue);
+	} else if (event == OBS_FRONTEND_EVENT_PROFILE_CHANGED) {
 		const auto dock = static_cast<DeviceSwitcherDock *>(data);
 		if (dock && dock->monitoringCombo) {
 			const char *name;
 			const char *id;
 			obs_get_audio_monitoring_device(&name, &id);
-			dock->monitoringCombo->setCurrentText(
-				QString::fromUtf8(name));
+			dock->SelectMonitoringDevice(QString::fromUtf8(id));
 		}
+	} else if (event == OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGING) {
+		const auto dock = static_cast<DeviceSwitcherDock *>(data);
+		dock->collectionLoading = true;
+		dock->virtualCamKeeper.CollectionChanging();
+	} else if (event == OBS_FRONTEND_EVENT_FINISHED_LOADING) {
+		const auto dock = static_cast<DeviceSwitcherDock *>(data);
+		// Sources of the collection may still wait in the queue.
+		dock->DispatchEvents();
+		dock->collectionLoading = false;
+		dock->CommitLoadBatch();
 	} else if (event == OBS_FRONTEND_EVENT_SCENE_COLLECTION_CHANGED) {
-		if (obs_frontend_virtualcam_active()) {
-			obs_frontend_stop_virtualcam();
-			const auto dock =
-				static_cast<DeviceSwitcherDock *>(data);
-			dock->restart_virtual_camera = true;
-		}
+		const auto dock = static_cast<DeviceSwitcherDock *>(data);
+		dock->DispatchEvents();
+		dock->collectionLoading = false;
+		dock->DropUnboundRows();
+		dock->CommitLoadBatch();
+		dock->virtualCamKeeper.CollectionChanged();
+	} else if (event == OBS_FRONTEND_EVENT_SCENE_CHANGED ||
+		   event == OBS_FRONTEND_EVENT_PREVIEW_SCENE_CHANGED) {
+		const auto dock = static_cast<DeviceSwitcherDock *>(data);
+		for (auto w : dock->deviceWidgets)
+			w->UpdateActivation();
 	} else if (event == OBS_FRONTEND_EVENT_VIRTUALCAM_STARTED) {
 		const auto dock = static_cast<DeviceSwitcherDock *>(data);
 		if (dock->virtualCamera)
 			dock->virtualCamera->setChecked(true);
-		dock->restart_virtual_camera = false;
+		dock->virtualCamKeeper.Started();
 	} else if (event == OBS_FRONTEND_EVENT_VIRTUALCAM_STOPPED) {
 		const auto dock = static_cast<DeviceSwitcherDock *>(data);
 		if (dock->virtualCamera)
 			dock->virtualCamera->setChecked(false);
-		if (dock->restart_virtual_camera) {
-			obs_frontend_start_virtualcam();
-		}
-	}
-}
-
-bool DeviceSwitcherDock::HasSourceSettings(QString sourceName)
-{
-	if (!retain_config)
-		return false;
-	const auto array = obs_data_get_array(retain_config, "sources");
-	if (!array)
-		return false;
-	bool found = false;
-	auto count = obs_data_array_count(array);
-	for (size_t i = 0; i < count; i++) {
-		auto item = obs_data_array_item(array, i);
-		if (!item)
-			continue;
-		auto name =
-			QString::fromUtf8(obs_data_get_string(item, "name"));
-		obs_data_release(item);
-		if (name == sourceName) {
-			found = true;
-			break;
-		}
+		dock->virtualCamKeeper.Stopped();
 	}
-	obs_data_array_release(array);
-	return found;
 }
 
-void DeviceSwitcherDock::SaveSourceSettings(obs_source_t *source)
+// The collection holds the live settings of failed over sources, so the
+// devices they fail back to are saved alongside and opened on load.
+// Retained sources get theirs from the retain store instead.
+void DeviceSwitcherDock::frontend_save(obs_data_t *save_data, bool saving,
+				       void *data)
 {
-	if (!retain_config || !source)
+	const auto dock = static_cast<DeviceSwitcherDock *>(data);
+	if (saving) {
+		auto array = obs_data_array_create();
+		dock->retainStore.SaveDevices(array);
+		obs_data_set_array(save_data, "device-switcher-devices", array);
+		obs_data_array_release(array);
 		return;
-	auto array = obs_data_get_array(retain_config, "sources");
-	if (!array) {
-		array = obs_data_array_create();
-		obs_data_set_array(retain_config, "sources", array);
 	}
-	obs_data_t *t = nullptr;
-	auto source_name = obs_source_get_name(source);
-	auto count = obs_data_array_count(array);
+	auto array = obs_data_get_array(save_data, "device-switcher-devices");
+	const size_t count = obs_data_array_count(array);
 	for (size_t i = 0; i < count; i++) {
 		auto item = obs_data_array_item(array, i);
-		if (!item)
-			continue;
-		auto name = obs_data_get_string(item, "name");
-		if (strcmp(name, source_name) == 0) {
-			t = item;
-			break;
+		const char *name = obs_data_get_string(item, "name");
+		const char *setting = obs_data_get_string(item, "setting");
+		const char *device = obs_data_get_string(item, "device");
+		auto source = dock->retainStore.Has(name)
+				      ? nullptr
+				      : obs_get_source_by_name(name);
+		if (source) {
+			auto settings = obs_source_get_settings(source);
+			const bool differs =
+				strcmp(obs_data_get_string(settings, setting),
+				       device) != 0;
+			obs_data_release(settings);
+			if (differs) {
+				auto update = obs_data_create();
+				obs_data_set_string(update, setting, device);
+				obs_source_update(source, update);
+				obs_data_release(update);
+			}
+			obs_source_release(source);
 		}
 		obs_data_release(item);
 	}
-	if (t == nullptr) {
-		t = obs_data_create();
-		obs_data_set_string(t, "name", source_name);
-		obs_data_array_push_back(array, t);
-	}
-	obs_data_set_string(t, "id", obs_source_get_unversioned_id(source));
 	obs_data_array_release(array);
-	auto s = obs_data_get_obj(t, "settings");
-	if (s == nullptr) {
-		s = obs_data_create();
-		obs_data_set_obj(t, "settings", s);
-	}
-	if (const auto settings = obs_source_get_settings(source)) {
-		obs_data_apply(s, settings);
-		obs_data_release(settings);
-	}
-	obs_data_release(s);
-	obs_data_array_t *filters = obs_data_array_create();
-	obs_source_enum_filters(source, SaveFilterSettings, filters);
-	obs_data_set_array(t, "filters", filters);
-	obs_data_array_release(filters);
-	obs_data_release(t);
 }
 
-void DeviceSwitcherDock::SaveFilterSettings(obs_source_t *source,
-					    obs_source_t *filter, void *param)
+bool DeviceSwitcherDock::HasSourceSettings(QString sourceName)
 {
-	UNUSED_PARAMETER(source);
-	auto array = static_cast<obs_data_array_t *>(param);
-	obs_data_t *t = nullptr;
-	auto source_name = obs_source_get_name(filter);
-	auto count = obs_data_array_count(array);
-	for (size_t i = 0; i < count; i++) {
-		auto item = obs_data_array_item(array, i);
-		if (!item)
-			continue;
-		auto name = obs_data_get_string(item, "name");
-		if (strcmp(name, source_name) == 0) {
-			t = item;
-			break;
-		}
-		obs_data_release(item);
-	}
-	if (t == nullptr) {
-		t = obs_data_create();
-		obs_data_set_string(t, "name", source_name);
-		obs_data_array_push_back(array, t);
-	}
-	obs_data_set_string(t, "id", obs_source_get_unversioned_id(filter));
-	auto s = obs_data_get_obj(t, "settings");
-	if (s == nullptr) {
-		s = obs_data_create();
-		obs_data_set_obj(t, "settings", s);
-	}
+	return retainStore.Has(QT_TO_UTF8(sourceName));
+}
 
-	if (auto settings = obs_source_get_settings(filter)) {
-		obs_data_apply(s, settings);
-		obs_data_release(settings);
-	}
-	obs_data_release(t);
-	obs_data_release(s);
+void DeviceSwitcherDock::SaveSourceSettings(obs_source_t *source)
+{
+	retainStore.Put(source);
 }
 
 void DeviceSwitcherDock::RemoveSourceSettings(QString sourceName)
 {
-	if (!retain_config)
+	retainStore.Remove(QT_TO_UTF8(sourceName));
+}
+
+void DeviceSwitcherDock::LoadSourceSettings(DeviceWidget *w,
+					    obs_source_t *source)
+{
+	ProfileScope scope("DeviceSwitcherDock::LoadSourceSettings");
+	if (!source)
 		return;
-	const auto array = obs_data_get_array(retain_config, "sources");
-	if (!array)
+	const auto t = retainStore.Get(obs_source_get_name(source));
+	if (!t || t->id != obs_source_get_unversioned_id(source))
 		return;
-	auto count = obs_data_array_count(array);
-	for (size_t i = 0; i < count; i++) {
-		auto item = obs_data_array_item(array, i);
-		if (!item)
+
+	// Opening every device of a collection at once makes devices on a
+	// shared bus fail, so the scheduler paces them.
+	if (!loadBatch)
+		loadBatch = scheduler.Begin(
+			obs_module_text("CollectionLoad"),
+			[this](const std::string &label,
+			       const std::vector<DeviceJobResult> &results,
+			       uint64_t total) {
+				ShowBatchReport(label, results, total);
+			});
+	scheduler.Add(loadBatch, w->id, obs_source_get_name(source),
+		      DeviceBus(w).c_str(), t->settings, t->filters);
+	if (!collectionLoading)
+		CommitLoadBatch();
+	if (scheduler.Pending() && !schedulerTimer.isActive())
+		schedulerTimer.start(16);
+}
+
+void DeviceSwitcherDock::DropUnboundRows()
+{
+	if (!reconcile.start)
+		return;
+	int removed = 0;
+	for (auto w : deviceWidgets.values()) {
+		if (w->source)
 			continue;
-		auto name =
-			QString::fromUtf8(obs_data_get_string(item, "name"));
-		obs_data_release(item);
-		if (name == sourceName) {
-			obs_data_array_erase(array, i);
-			obs_data_array_release(array);
-			return;
-		}
+		mainLayout->removeWidget(w);
+		delete w;
+		removed++;
 	}
-	obs_data_array_release(array);
+	blog(LOG_INFO,
+	     "[Device Switcher] collection switch: %d rows kept, %d created, %d removed in %.1f ms",
+	     reconcile.kept, reconcile.created, removed,
+	     (os_gettime_ns() - reconcile.start) / 1000000.0);
+	reconcile.start = 0;
+	reconcile.kept = 0;
+	reconcile.created = 0;
 }
 
-void DeviceSwitcherDock::LoadSourceSettings(obs_source_t *source)
+void DeviceSwitcherDock::CommitLoadBatch()
 {
-	if (!retain_config || !source)
+	if (!loadBatch)
 		return;
-	auto array = obs_data_get_array(retain_config, "sources");
-	if (!array) {
-		array = obs_data_array_create();
-		obs_data_set_array(retain_config, "sources", array);
-	}
-	obs_data_t *t = nullptr;
-	auto source_name = obs_source_get_name(source);
-	auto count = obs_data_array_count(array);
+	const uint64_t batch = loadBatch;
+	loadBatch = 0;
+	scheduler.Commit(batch);
+}
+
+void DeviceSwitcherDock::LoadFilters(obs_source_t *source,
+				     obs_data_array_t *filters)
+{
+	obs_source_enum_filters(source, RemoveFilter, filters);
+	auto count = obs_data_array_count(filters);
 	for (size_t i = 0; i < count; i++) {
-		auto item = obs_data_array_item(array, i);
+		auto item = obs_data_array_item(filters, i);
 		if (!item)
 			continue;
-		auto name = obs_data_get_string(item, "name");
-		if (strcmp(name, source_name) == 0) {
-			t = item;
-			break;
-		}
+		LoadFilter(source, item);
 		obs_data_release(item);
 	}
-	obs_data_array_release(array);
-	if (t == nullptr)
-		return;
-
-	if (strcmp(obs_data_get_string(t, "id"),
-		   obs_source_get_unversioned_id(source)) != 0) {
-		obs_data_release(t);
-		return;
-	}
-	auto s = obs_data_get_obj(t, "settings");
-	if (s) {
-		obs_source_update(source, s);
-		obs_data_release(s);
-	}
-
-	auto filters = obs_data_get_array(t, "filters");
-	if (filters) {
-		obs_source_enum_filters(source, RemoveFilter, filters);
-		auto count = obs_data_array_count(filters);
-		for (size_t i = 0; i < count; i++) {
-			auto item = obs_data_array_item(filters, i);
-			if (!item)
-				continue;
-			LoadFilter(source, item);
-			obs_data_release(item);
-		}
-		obs_data_array_release(filters);
-	}
-	obs_data_release(t);
 }
 
 void DeviceSwitcherDock::RemoveFilter(obs_source_t *source,
 				      obs_source_t *filter, void *param)
 {
+	if (device_probe_is_probe(filter))
+		return;
 	auto array = (obs_data_array_t *)param;
 	auto source_name = obs_source_get_name(filter);
 	auto count = obs_data_array_count(array);
@@ -441,7 +495,7 @@ DeviceSwitcherDock::DeviceSwitcherDock(QWidget *parent)
 	: QDockWidget(parent),
 	  mainLayout(new QVBoxLayout(this)),
 	  monitoringCombo(nullptr),
-	  retain_config(nullptr)
+	  scheduler(this)
 {
 	setFeatures(DockWidgetMovable | DockWidgetFloatable);
 	setWindowTitle(QT_UTF8(obs_module_text("DeviceSwitcher")));
@@ -464,6 +518,14 @@ DeviceSwitcherDock::DeviceSwitcherDock(QWidget *parent)
 
 	setWidget(scrollArea);
 
+	taskQueue = os_task_queue_create();
+
+	// All signal bridges feed one queue, drained once per UI tick.
+	eventTimer.setTimerType(Qt::PreciseTimer);
+	connect(&eventTimer, &QTimer::timeout, this,
+		&DeviceSwitcherDock::DispatchEvents);
+	eventTimer.start(16);
+
 	char *config_file = obs_module_file("config/config.ini");
 	if (!config_file) {
 		config_file = obs_module_config_path("config.ini");
@@ -472,6 +534,36 @@ DeviceSwitcherDock::DeviceSwitcherDock(QWidget *parent)
 		config_open(&show_config, config_file, CONFIG_OPEN_EXISTING);
 		bfree(config_file);
 	}
+	if (show_config && config_get_bool(show_config, "General", "Trace")) {
+		if (char *path = obs_module_config_path("")) {
+			os_mkdirs(path);
+			bfree(path);
+		}
+		if (char *file = obs_module_config_path("trace.json")) {
+			trace_start(file);
+			bfree(file);
+		}
+	}
+	if (show_config &&
+	    config_get_bool(show_config, "General", "LevelExport"))
+		levelExport.Open();
+	if (show_config &&
+	    config_get_bool(show_config, "General", "Telemetry"))
+		telemetry.Start(
+			config_get_uint(show_config, "General",
+					"TelemetryFileSize") *
+				1024 * 1024,
+			(int)config_get_uint(show_config, "General",
+					     "TelemetryFiles"),
+			config_get_uint(show_config, "General",
+					"TelemetryLevelInterval") *
+				1000000ULL);
+	levelEngine.SetEnabled(show_config &&
+			       config_get_bool(show_config, "General",
+					       "LevelEngine"));
+	if (show_config &&
+	    config_get_bool(show_config, "General", "VirtualCameraKeep"))
+		virtualCamKeeper.SetMode(VirtualCamKeeper::Mode::Keep);
 	if (!show_config ||
 	    !config_has_user_value(show_config, "General", "VirtualCamera") ||
 	    config_get_bool(show_config, "General", "VirtualCamera")) {
@@ -514,42 +606,139 @@ DeviceSwitcherDock::DeviceSwitcherDock(QWidget *parent)
 			mainLayout->addLayout(nameRow);
 
 		monitoringCombo = new QComboBox(w);
-		monitoringCombo->addItem(
-			QString::fromUtf8(obs_module_text("Default")),
-			QString::fromUtf8("default"));
-		obs_enum_audio_monitoring_devices(add_monitoring_device, this);
+		RefreshMonitoringDevices();
 		const char *name;
 		const char *id;
 		obs_get_audio_monitoring_device(&name, &id);
-		monitoringCombo->setCurrentText(QString::fromUtf8(name));
+		SelectMonitoringDevice(QString::fromUtf8(id));
+
+		auto refresh = new QAction(
+			QString::fromUtf8(obs_module_text("RefreshDevices")),
+			monitoringCombo);
+		connect(refresh, &QAction::triggered, [this] {
+			const auto id =
+				monitoringCombo->currentData().toString();
+			RefreshMonitoringDevices();
+			SelectMonitoringDevice(id);
+		});
+		monitoringCombo->addAction(refresh);
+		monitoringCombo->setContextMenuPolicy(Qt::ActionsContextMenu);
 
 		auto comboIndexChanged = static_cast<void (QComboBox::*)(int)>(
 			&QComboBox::currentIndexChanged);
 		connect(monitoringCombo, comboIndexChanged, [this](int index) {
-			auto id = monitoringCombo->itemData(index)
-					  .toString()
-					  .toUtf8();
-			auto name = monitoringCombo->itemText(index).toUtf8();
-			obs_set_audio_monitoring_device(name.constData(),
-							id.constData());
-			const auto config = obs_frontend_get_profile_config();
-			if (!config)
-				return config_set_string(config, "Audio",
-							 "MonitoringDeviceName",
-							 name.constData());
-			config_set_string(config, "Audio", "MonitoringDeviceId",
-					  id.constData());
-			config_save(config);
+			if (index < 0)
+				return;
+			// Switching recreates every monitoring output, keep
+			// that and the profile write off the UI thread.
+			auto task = new MonitoringDeviceTask;
+			task->dock = this;
+			task->generation = ++monitoringGeneration;
+			task->config = obs_frontend_get_profile_config();
+			task->name = QT_TO_UTF8(monitoringCombo->itemText(index));
+			task->id = QT_TO_UTF8(
+				monitoringCombo->itemData(index).toString());
+			if (!os_task_queue_queue_task(taskQueue,
+						      set_monitoring_device,
+						      task))
+				delete task;
 		});
 		mainLayout->addWidget(monitoringCombo);
 	}
+	auto exportLatency = new QAction(
+		QString::fromUtf8(obs_module_text("ExportSwitchLatency")), this);
+	connect(exportLatency, &QAction::triggered, this,
+		&DeviceSwitcherDock::ExportSwitchLatency);
+	addAction(exportLatency);
+	auto restartSelected = new QAction(
+		QString::fromUtf8(obs_module_text("RestartSelected")), this);
+	connect(restartSelected, &QAction::triggered, this,
+		&DeviceSwitcherDock::RestartSelected);
+	addAction(restartSelected);
+	auto saveProfile = new QAction(
+		QString::fromUtf8(obs_module_text("SaveDeviceProfile")), this);
+	connect(saveProfile, &QAction::triggered, this,
+		&DeviceSwitcherDock::SaveDeviceProfile);
+	addAction(saveProfile);
+	applyProfileMenu = new QMenu(this);
+	auto applyProfile = new QAction(
+		QString::fromUtf8(obs_module_text("ApplyDeviceProfile")), this);
+	applyProfile->setMenu(applyProfileMenu);
+	addAction(applyProfile);
+	deleteProfileMenu = new QMenu(this);
+	auto deleteProfile = new QAction(
+		QString::fromUtf8(obs_module_text("DeleteDeviceProfile")),
+		this);
+	deleteProfile->setMenu(deleteProfileMenu);
+	addAction(deleteProfile);
+	if (show_config &&
+	    config_get_bool(show_config, "General", "Benchmark")) {
+		benchmark_register();
+		benchmark = std::make_unique<DockBenchmark>(this);
+		auto runBenchmark = new QAction(
+			QString::fromUtf8(obs_module_text("RunBenchmark")),
+			this);
+		connect(runBenchmark, &QAction::triggered,
+			[this] { benchmark->Start(); });
+		addAction(runBenchmark);
+	}
+	setContextMenuPolicy(Qt::ActionsContextMenu);
+
+	batchLabel = new QLabel(w);
+	batchLabel->hide();
+	mainLayout->addWidget(batchLabel);
+	schedulerTimer.setTimerType(Qt::PreciseTimer);
+	connect(&schedulerTimer, &QTimer::timeout, this,
+		&DeviceSwitcherDock::RunScheduler);
+
+	if (show_config && config_get_bool(show_config, "General", "Stats")) {
+		const auto statsName = new QLabel(w);
+		statsName->setText(QString::fromUtf8(obs_module_text("Stats")));
+		mainLayout->addWidget(statsName);
+		statsLabel = new QLabel(w);
+		statsLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+		mainLayout->addWidget(statsLabel);
+		connect(&statsTimer, &QTimer::timeout, this,
+			&DeviceSwitcherDock::UpdateStats);
+		statsTimer.start(500);
+	}
+
+	failoverWindow =
+		(show_config && config_has_user_value(show_config, "General",
+						      "FailoverWindow")
+			 ? config_get_uint(show_config, "General",
+					   "FailoverWindow")
+			 : 2000) *
+		1000000ULL;
+	failbackHold =
+		(show_config && config_has_user_value(show_config, "General",
+						      "FailbackHold")
+			 ? config_get_uint(show_config, "General",
+					   "FailbackHold")
+			 : 10000) *
+		1000000ULL;
+	connect(&healthTimer, &QTimer::timeout, this,
+		&DeviceSwitcherDock::CheckHealth);
+	healthTimer.start(250);
+
 	if (char *file = obs_module_config_path("config.json")) {
-		retain_config =
+		retainStore.Load(file);
+		bfree(file);
+	}
+	if (char *file = obs_module_config_path("devices.json")) {
+		devicePrefs = obs_data_create_from_json_file_safe(file, "bak");
+		bfree(file);
+	}
+	if (!devicePrefs)
+		devicePrefs = obs_data_create();
+	if (char *file = obs_module_config_path("profiles.json")) {
+		deviceProfiles =
 			obs_data_create_from_json_file_safe(file, "bak");
 		bfree(file);
 	}
-	if (!retain_config)
-		retain_config = obs_data_create();
+	if (!deviceProfiles)
+		deviceProfiles = obs_data_create();
+	UpdateProfileMenus();
 
 	auto sh = obs_get_signal_handler();
 	signal_handler_connect(sh, "source_create", add_source, this);
@@ -560,149 +749,596 @@ DeviceSwitcherDock::DeviceSwitcherDock(QWidget *parent)
 	signal_handler_connect(sh, "source_rename", rename_source, this);
 
 	obs_frontend_add_event_callback(frontend_event, this);
+	obs_frontend_add_save_callback(frontend_save, this);
 }
 
 DeviceSwitcherDock::~DeviceSwitcherDock()
 {
-	if (retain_config) {
-		if (char *file = obs_module_config_path("config.json")) {
-			if (!obs_data_save_json_safe(retain_config, file, "tmp",
-						     "bak")) {
-				if (char *path = obs_module_config_path("")) {
-					os_mkdirs(path);
-					bfree(path);
-				}
-				obs_data_save_json_safe(retain_config, file,
-							"tmp", "bak");
+	trace_stop();
+	os_task_queue_destroy(taskQueue);
+	taskQueue = nullptr;
+	if (char *file = obs_module_config_path("config.json")) {
+		if (!retainStore.Save(file)) {
+			if (char *path = obs_module_config_path("")) {
+				os_mkdirs(path);
+				bfree(path);
 			}
-			bfree(file);
+			retainStore.Save(file);
 		}
-		obs_data_release(retain_config);
+		bfree(file);
+	}
+	if (char *file = obs_module_config_path("devices.json")) {
+		obs_data_save_json_safe(devicePrefs, file, "tmp", "bak");
+		bfree(file);
 	}
 	config_close(show_config);
 	obs_frontend_remove_event_callback(frontend_event, this);
+	obs_frontend_remove_save_callback(frontend_save, this);
 
 	auto sh = obs_get_signal_handler();
 	signal_handler_disconnect(sh, "source_create", add_source, this);
 	signal_handler_disconnect(sh, "source_load", add_source, this);
+	signal_handler_disconnect(sh, "source_save", save_source, this);
 	signal_handler_disconnect(sh, "source_destroy", remove_source, this);
 	signal_handler_disconnect(sh, "source_remove", remove_source, this);
 	signal_handler_disconnect(sh, "source_rename", rename_source, this);
+
+	// Rows unregister themselves from the dock, so remove them while
+	// the dock members are still alive.
+	eventTimer.stop();
+	healthTimer.stop();
+	const auto rows = deviceWidgets.values();
+	qDeleteAll(rows);
+
+	PluginEvent event;
+	while (events.Pop(event))
+		obs_weak_source_release(event.source);
+	obs_data_release(devicePrefs);
+	obs_data_release(deviceProfiles);
 }
 
-void DeviceSwitcherDock::AddDeviceSource(QString sourceName)
+void DeviceSwitcherDock::DispatchEvents()
 {
-	const auto count = mainLayout->count();
-	for (int i = count - 1; i >= 0; i--) {
-		QLayoutItem *item = mainLayout->itemAt(i);
-		if (!item)
-			continue;
-		const auto *w = item->widget();
-		if (w && w->objectName() == sourceName) {
-			return;
+	if (!events.Depth())
+		return;
+	ProfileScope scope("DeviceSwitcherDock::DispatchEvents",
+			   &pluginStats.dispatch);
+	PluginEvent event;
+	while (events.Pop(event)) {
+		switch (event.type) {
+		case PluginEventType::AddSource:
+			AddDeviceSource(event.source);
+			break;
+		case PluginEventType::RemoveSource:
+			RemoveDeviceSource(event.source);
+			break;
+		case PluginEventType::RenameSource:
+			RenameDeviceSource(event.source);
+			break;
+		case PluginEventType::RowUpdate:
+			if (auto w = deviceWidgets.value(event.widgetId))
+				w->ApplyPendingUpdate();
+			break;
+		case PluginEventType::RowActivation:
+			if (auto w = deviceWidgets.value(event.widgetId))
+				w->UpdateActivation();
+			break;
+		case PluginEventType::RowPresence:
+			if (auto w = deviceWidgets.value(event.widgetId))
+				w->PrimaryListed(event.listed);
+			break;
 		}
+		obs_weak_source_release(event.source);
 	}
-	auto source = obs_get_source_by_name(sourceName.toUtf8().constData());
-	if (!source)
-		return;
-	obs_source_release(source);
+}
 
-	auto props = obs_source_properties(source);
-	if (!props)
-		return;
+static inline QString Text(const char *lookup)
+{
+	return QString::fromUtf8(obs_module_text(lookup));
+}
 
-	auto prop = obs_properties_get(props, "device_id");
-	if (!prop)
-		prop = obs_properties_get(props, "video_device_id");
+static QString FormatDuration(DurationWindow &window, const DurationStat &stat)
+{
+	uint64_t samples;
+	double ms = window.Update(stat, &samples);
+	if (!samples)
+		ms = stat.last.load(std::memory_order_relaxed) / 1000000.0;
+	return Text("StatsDuration").arg(ms, 0, 'f', 2);
+}
 
-	if (!prop) {
-		obs_properties_destroy(props);
+static QString FormatLatency(const char *lookup, const QString &name,
+			     const DurationStat &stat)
+{
+	return Text(lookup)
+		.arg(name)
+		.arg(stat.last / 1000000.0, 0, 'f', 2)
+		.arg(stat.max / 1000000.0, 0, 'f', 2);
+}
+
+void DeviceSwitcherDock::UpdateStats()
+{
+	if (!statsLabel || !statsLabel->isVisible())
 		return;
+
+	uint64_t ticks;
+	const double interval =
+		statsWindows.meterInterval.Update(pluginStats.meterInterval,
+						  &ticks);
+	QStringList lines;
+	lines << Text("StatsMeters")
+			 .arg(interval > 0.0 ? 1000.0 / interval : 0.0, 0, 'f',
+			      1)
+			 .arg(FormatDuration(statsWindows.meterTick,
+					     pluginStats.meterTick))
+			 .arg(FormatDuration(statsWindows.meterPaint,
+					     pluginStats.meterPaint))
+			 .arg(pluginStats.volmeters.load());
+	lines << Text("StatsEvents")
+			 .arg(PendingEvents())
+			 .arg(FormatDuration(statsWindows.dispatch,
+					     pluginStats.dispatch));
+	lines << Text("StatsAddSource")
+			 .arg(FormatDuration(statsWindows.addDeviceSource,
+					     pluginStats.addDeviceSource))
+			 .arg(FormatDuration(statsWindows.sourceProperties,
+					     pluginStats.sourceProperties));
+	lines << Text("StatsRetain")
+			 .arg(FormatDuration(statsWindows.retainCapture,
+					     pluginStats.retainCapture))
+			 .arg(FormatDuration(statsWindows.retainApply,
+					     pluginStats.retainApply));
+	// The meter callback is only the part after the volmeter in libobs,
+	// the engine block includes all of the metering, so the two are not
+	// comparable.
+	lines << Text("StatsLevels")
+			 .arg(FormatDuration(statsWindows.volmeterLevels,
+					     pluginStats.volmeterLevels))
+			 .arg(FormatDuration(statsWindows.levelEngine,
+					     pluginStats.levelEngine))
+			 .arg(FormatDuration(statsWindows.loudness,
+					     pluginStats.loudness))
+			 .arg(FormatDuration(statsWindows.spectrum,
+					     pluginStats.spectrum));
+	const auto &downtime = virtualCamKeeper.Downtime();
+	if (downtime.count.load(std::memory_order_relaxed))
+		lines << Text("StatsVirtualCamera")
+				 .arg(downtime.last / 1000000.0, 0, 'f', 2)
+				 .arg(downtime.max / 1000000.0, 0, 'f', 2);
+	int collapsed = 0;
+	for (auto w : deviceWidgets) {
+		if (w->collapsed)
+			collapsed++;
 	}
+	if (collapsed)
+		lines << Text("StatsCollapsed")
+				 .arg(collapsed)
+				 .arg(deviceWidgets.size());
+	for (auto w : deviceWidgets) {
+		if (w->switchLatency.count.load(std::memory_order_relaxed))
+			lines << FormatLatency("StatsSwitch", w->objectName(),
+					       w->switchLatency);
+	}
+	for (auto w : deviceWidgets) {
+		if (w->failoverLatency.count.load(std::memory_order_relaxed))
+			lines << FormatLatency("StatsFailover",
+					       w->objectName(),
+					       w->failoverLatency);
+	}
+	for (auto w : deviceWidgets) {
+		if (w->restartDuration.count.load(std::memory_order_relaxed))
+			lines << FormatLatency("StatsRestart", w->objectName(),
+					       w->restartDuration);
+	}
+	statsLabel->setText(lines.join(QChar('\n')));
+}
 
-	const auto propCount = obs_property_list_item_count(prop);
-	if (propCount == 0) {
-		obs_properties_destroy(props);
-		return;
+void DeviceSwitcherDock::CheckHealth()
+{
+	const uint64_t ts = os_gettime_ns();
+	for (auto w : deviceWidgets)
+		w->CheckHealth(ts);
+}
+
+void DeviceSwitcherDock::RunScheduler()
+{
+	if (!scheduler.Tick(os_gettime_ns()))
+		schedulerTimer.stop();
+}
+
+std::string DeviceSwitcherDock::DeviceBus(DeviceWidget *w)
+{
+	auto prefs = obs_data_get_obj(devicePrefs, QT_TO_UTF8(w->objectName()));
+	std::string bus = obs_data_get_string(prefs, "bus");
+	obs_data_release(prefs);
+	if (!bus.empty())
+		return bus;
+	// Without a configured bus, sources of one type share a limit.
+	auto s = obs_weak_source_get_source(w->source);
+	if (s) {
+		bus = obs_source_get_unversioned_id(s);
+		obs_source_release(s);
 	}
+	return bus;
+}
 
-	LoadSourceSettings(source);
+void DeviceSwitcherDock::SaveDeviceProfiles()
+{
+	if (char *path = obs_module_config_path("")) {
+		os_mkdirs(path);
+		bfree(path);
+	}
+	if (char *file = obs_module_config_path("profiles.json")) {
+		obs_data_save_json_safe(deviceProfiles, file, "tmp", "bak");
+		bfree(file);
+	}
+}
 
-	auto w = new DeviceWidget(source, prop, show_config, this);
-	mainLayout->addWidget(w);
-	obs_properties_destroy(props);
+void DeviceSwitcherDock::UpdateProfileMenus()
+{
+	applyProfileMenu->clear();
+	deleteProfileMenu->clear();
+	for (obs_data_item_t *item = obs_data_first(deviceProfiles); item;
+	     obs_data_item_next(&item)) {
+		const QString name = QT_UTF8(obs_data_item_get_name(item));
+		connect(applyProfileMenu->addAction(name), &QAction::triggered,
+			[this, name] { ApplyDeviceProfile(name); });
+		connect(deleteProfileMenu->addAction(name),
+			&QAction::triggered, [this, name] {
+				obs_data_erase(deviceProfiles,
+					       QT_TO_UTF8(name));
+				SaveDeviceProfiles();
+				UpdateProfileMenus();
+			});
+	}
+	applyProfileMenu->setEnabled(!applyProfileMenu->isEmpty());
+	deleteProfileMenu->setEnabled(!deleteProfileMenu->isEmpty());
 }
 
-void DeviceSwitcherDock::RemoveDeviceSource(QString sourceName)
+void DeviceSwitcherDock::SaveDeviceProfile()
 {
-	const auto count = mainLayout->count();
-	for (int i = 0; i < count; i++) {
-		QLayoutItem *item = mainLayout->itemAt(i);
-		if (!item)
+	bool ok = false;
+	const QString name = QInputDialog::getText(
+		this, QString::fromUtf8(obs_module_text("SaveDeviceProfile")),
+		QString::fromUtf8(obs_module_text("ProfileName")),
+		QLineEdit::Normal, QString(), &ok);
+	if (!ok || name.trimmed().isEmpty())
+		return;
+
+	auto array = obs_data_array_create();
+	for (auto w : deviceWidgets) {
+		auto s = obs_weak_source_get_source(w->source);
+		if (!s)
 			continue;
-		auto *w = item->widget();
-		if (w && w->objectName() == sourceName) {
-			mainLayout->removeItem(item);
-			delete w;
-			break;
-		}
+		auto settings = obs_source_get_settings(s);
+		auto item = obs_data_create();
+		obs_data_set_string(item, "name", obs_source_get_name(s));
+		obs_data_set_string(item, "setting", w->settingName.c_str());
+		obs_data_set_string(item, "device",
+				    obs_data_get_string(settings,
+							w->settingName.c_str()));
+		obs_data_release(settings);
+		// Retained sources bring their filters along.
+		const auto retained = retainStore.Get(obs_source_get_name(s));
+		if (retained && retained->filters)
+			obs_data_set_array(item, "filters", retained->filters);
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+		obs_source_release(s);
 	}
+	auto profile = obs_data_create();
+	obs_data_set_array(profile, "sources", array);
+	obs_data_set_obj(deviceProfiles, QT_TO_UTF8(name.trimmed()), profile);
+	obs_data_release(profile);
+	obs_data_array_release(array);
+	SaveDeviceProfiles();
+	UpdateProfileMenus();
 }
 
-void DeviceSwitcherDock::RenameDeviceSource(QString prevDeviceName,
-					    QString newDeviceName)
+void DeviceSwitcherDock::ApplyDeviceProfile(const QString &name)
 {
-	const auto count = mainLayout->count();
-	for (int i = 0; i < count; i++) {
-		QLayoutItem *item = mainLayout->itemAt(i);
-		if (!item)
-			continue;
-		auto *w = item->widget();
-		if (w && w->objectName() == prevDeviceName) {
-			w->setObjectName(newDeviceName);
-			auto subItem = w->layout()->itemAt(0);
-			if (subItem) {
-				auto lw = subItem->widget();
-				auto l = dynamic_cast<QLabel *>(lw);
-				if (l)
-					l->setText(newDeviceName);
+	auto profile = obs_data_get_obj(deviceProfiles, QT_TO_UTF8(name));
+	if (!profile)
+		return;
+	const uint64_t batch = scheduler.Begin(
+		QT_TO_UTF8(name),
+		[this](const std::string &label,
+		       const std::vector<DeviceJobResult> &results,
+		       uint64_t total) {
+			ShowBatchReport(label, results, total);
+		});
+	auto array = obs_data_get_array(profile, "sources");
+	const size_t count = obs_data_array_count(array);
+	for (size_t i = 0; i < count; i++) {
+		auto item = obs_data_array_item(array, i);
+		const QString sourceName =
+			QT_UTF8(obs_data_get_string(item, "name"));
+		DeviceWidget *row = nullptr;
+		for (auto w : deviceWidgets) {
+			if (w->objectName() == sourceName) {
+				row = w;
+				break;
 			}
-			break;
 		}
+		if (row) {
+			auto settings = obs_data_create();
+			obs_data_set_string(
+				settings, obs_data_get_string(item, "setting"),
+				obs_data_get_string(item, "device"));
+			auto filters = obs_data_get_array(item, "filters");
+			scheduler.Add(batch, row->id, QT_TO_UTF8(sourceName),
+				      DeviceBus(row).c_str(), settings,
+				      filters);
+			obs_data_array_release(filters);
+			obs_data_release(settings);
+		}
+		obs_data_release(item);
 	}
+	obs_data_array_release(array);
+	obs_data_release(profile);
+	scheduler.Commit(batch);
+	if (scheduler.Pending() && !schedulerTimer.isActive())
+		schedulerTimer.start(16);
 }
 
-DeviceWidget::DeviceWidget(obs_source_t *source, obs_property_t *prop,
-			   config_t *sc, DeviceSwitcherDock *parent)
-	: QWidget(parent)
+void DeviceSwitcherDock::ShowBatchReport(
+	const std::string &label, const std::vector<DeviceJobResult> &results,
+	uint64_t total)
 {
-	dock = parent;
-	this->source = obs_source_get_weak_source(source);
-	auto sn = obs_source_get_name(source);
-	auto st = obs_source_get_unversioned_id(source);
-	const QString sourceName = QString::fromUtf8(sn);
+	size_t live = 0;
+	QString details;
+	for (const auto &result : results) {
+		if (result.live)
+			live++;
+		blog(LOG_INFO,
+		     "[Device Switcher] '%s' %s: %s after %d attempt(s), waited %.1f ms, opened in %.1f ms",
+		     label.c_str(), result.name.c_str(),
+		     result.live ? "live" : "failed", result.attempts,
+		     result.wait / 1000000.0, result.open / 1000000.0);
+		if (!details.isEmpty())
+			details += QStringLiteral("\n");
+		details += QString::fromUtf8(obs_module_text(
+					   result.live ? "BatchSourceLive"
+						       : "BatchSourceFailed"))
+				   .arg(QT_UTF8(result.name.c_str()))
+				   .arg(result.wait / 1000000.0, 0, 'f', 1)
+				   .arg(result.open / 1000000.0, 0, 'f', 1)
+				   .arg(result.attempts);
+	}
+	blog(LOG_INFO, "[Device Switcher] '%s' %zu of %zu sources live in %.1f ms",
+	     label.c_str(), live, results.size(), total / 1000000.0);
+	batchLabel->setText(QString::fromUtf8(obs_module_text("BatchReport"))
+				    .arg(QT_UTF8(label.c_str()))
+				    .arg(live)
+				    .arg(results.size())
+				    .arg(total / 1000000.0, 0, 'f', 1));
+	batchLabel->setToolTip(details);
+	batchLabel->show();
+}
 
-	setObjectName(sourceName);
-	setContentsMargins(0, 0, 0, 0);
+obs_data_t *DeviceSwitcherDock::GetDevicePrefs(const QString &sourceName)
+{
+	const auto name = sourceName.toUtf8();
+	auto prefs = obs_data_get_obj(devicePrefs, name.constData());
+	if (!prefs) {
+		prefs = obs_data_create();
+		obs_data_set_obj(devicePrefs, name.constData(), prefs);
+	}
+	return prefs;
+}
 
-	auto l = new QVBoxLayout(this);
-	l->setContentsMargins(0, 0, 0, 0);
+void DeviceSwitcherDock::RestartSelected()
+{
+	// Every row runs its own restart, so slow devices do not hold up
+	// the others.
+	for (auto w : deviceWidgets) {
+		if (w->selected)
+			w->Restart();
+	}
+}
 
-	const auto nameRow = new QHBoxLayout;
-	if (GetShowSetting(sc, st, sn, "Icon")) {
-		const auto iconLabel = new QLabel(this);
-		auto icon = GetIconFromType(
-			obs_source_get_icon_type(obs_source_get_id(source)));
-		iconLabel->setPixmap(icon.pixmap(16, 16));
-		nameRow->addWidget(iconLabel);
+void DeviceSwitcherDock::ExportSwitchLatency()
+{
+	if (char *path = obs_module_config_path("")) {
+		os_mkdirs(path);
+		bfree(path);
 	}
-	const auto nameLabel = new QLabel(this);
+	char *file = obs_module_config_path("switch-latency.csv");
+	if (!file)
+		return;
+	QFile f(QT_UTF8(file));
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate |
+		    QIODevice::Text)) {
+		blog(LOG_WARNING, "[Device Switcher] failed to write %s", file);
+		bfree(file);
+		return;
+	}
+	QTextStream out(&f);
+	out << "source,samples,timeouts,last_ms,min_ms,avg_ms,max_ms";
+	for (int i = 0; i < LatencyHistogram::Buckets - 1; i++)
+		out << ",lt_" << LatencyHistogram::bounds[i] << "_ms";
+	out << ",ge_" << LatencyHistogram::bounds[LatencyHistogram::Buckets - 2]
+	    << "_ms\n";
+	for (auto w : deviceWidgets) {
+		const auto &h = w->switchHistogram;
+		QString name = w->objectName();
+		name.replace(QStringLiteral("\""), QStringLiteral("\"\""));
+		out << "\"" << name << "\"," << h.count << "," << h.timeouts
+		    << "," << h.last / 1000000.0 << "," << h.min / 1000000.0
+		    << "," << (h.count ? h.total / h.count / 1000000.0 : 0.0)
+		    << "," << h.max / 1000000.0;
+		for (int i = 0; i < LatencyHistogram::Buckets; i++)
+			out << "," << h.counts[i];
+		out << "\n";
+	}
+	blog(LOG_INFO, "[Device Switcher] switch latency exported to %s",
+	     file);
+	bfree(file);
+}
+
+DeviceWidget *DeviceSwitcherDock::FindDeviceWidget(obs_weak_source_t *source)
+{
+	for (auto w : deviceWidgets) {
+		if (w->source == source)
+			return w;
+	}
+	return nullptr;
+}
+
+void DeviceSwitcherDock::AddDeviceSource(obs_weak_source_t *weak)
+{
+	ProfileScope scope("DeviceSwitcherDock::AddDeviceSource",
+			   &pluginStats.addDeviceSource);
+	if (FindDeviceWidget(weak))
+		return;
+	auto source = obs_weak_source_get_source(weak);
+	if (!source)
+		return;
+
+	if (reconcile.start) {
+		const QString name = QT_UTF8(obs_source_get_name(source));
+		const char *type = obs_source_get_unversioned_id(source);
+		for (auto w : deviceWidgets) {
+			if (w->source || w->objectName() != name ||
+			    w->sourceType != type)
+				continue;
+			w->Bind(source);
+			reconcile.kept++;
+			LoadSourceSettings(w, source);
+			obs_source_release(source);
+			return;
+		}
+	}
+
+	obs_properties_t *props;
+	{
+		ProfileScope propertiesScope("obs_source_properties",
+					     &pluginStats.sourceProperties);
+		props = obs_source_properties(source);
+	}
+	if (!props) {
+		obs_source_release(source);
+		return;
+	}
+
+	auto prop = obs_properties_get(props, "device_id");
+	if (!prop)
+		prop = obs_properties_get(props, "video_device_id");
+
+	if (!prop) {
+		obs_properties_destroy(props);
+		obs_source_release(source);
+		return;
+	}
+
+	const auto propCount = obs_property_list_item_count(prop);
+	if (propCount == 0) {
+		obs_properties_destroy(props);
+		obs_source_release(source);
+		return;
+	}
+
+	auto w = new DeviceWidget(source, prop, show_config, this);
+	mainLayout->addWidget(w);
+	obs_properties_destroy(props);
+	if (reconcile.start)
+		reconcile.created++;
+
+	LoadSourceSettings(w, source);
+	obs_source_release(source);
+}
+
+void DeviceSwitcherDock::RemoveDeviceSource(obs_weak_source_t *weak)
+{
+	auto w = FindDeviceWidget(weak);
+	if (!w)
+		return;
+	if (collectionLoading) {
+		// The next collection likely has the same source again.
+		if (!reconcile.start)
+			reconcile.start = os_gettime_ns();
+		w->Unbind();
+		return;
+	}
+	mainLayout->removeWidget(w);
+	delete w;
+}
+
+void DeviceSwitcherDock::RenameDeviceSource(obs_weak_source_t *weak)
+{
+	auto w = FindDeviceWidget(weak);
+	if (!w)
+		return;
+	auto source = obs_weak_source_get_source(weak);
+	if (!source)
+		return;
+	const auto newDeviceName = QT_UTF8(obs_source_get_name(source));
+	obs_source_release(source);
+	const auto oldName = w->objectName().toUtf8();
+	if (auto prefs = obs_data_get_obj(devicePrefs, oldName.constData())) {
+		obs_data_set_obj(devicePrefs, QT_TO_UTF8(newDeviceName), prefs);
+		obs_data_erase(devicePrefs, oldName.constData());
+		obs_data_release(prefs);
+	}
+	w->setObjectName(newDeviceName);
+	if (w->nameLabel)
+		w->nameLabel->setText(newDeviceName);
+	else
+		w->update();
+	if (w->volMeter)
+		w->volMeter->SetExportName(QT_TO_UTF8(newDeviceName));
+	telemetry.RenameSource(w->telemetrySource, QT_TO_UTF8(newDeviceName));
+}
+
+DeviceWidget::DeviceWidget(obs_source_t *source, obs_property_t *prop,
+			   config_t *sc, DeviceSwitcherDock *parent)
+	: QWidget(parent)
+{
+	dock = parent;
+	id = ++dock->nextWidgetId;
+	dock->deviceWidgets.insert(id, this);
+	this->source = obs_source_get_weak_source(source);
+	auto sn = obs_source_get_name(source);
+	auto st = obs_source_get_unversioned_id(source);
+	const QString sourceName = QString::fromUtf8(sn);
+	sourceType = st;
+
+	setObjectName(sourceName);
+	setContentsMargins(0, 0, 0, 0);
+	telemetrySource = telemetry.AddSource(sn);
+
+	switchTimer.setTimerType(Qt::PreciseTimer);
+	connect(&switchTimer, &QTimer::timeout, this,
+		&DeviceWidget::CheckSwitchMeasure);
+	restartTimer.setTimerType(Qt::PreciseTimer);
+	connect(&restartTimer, &QTimer::timeout, this,
+		&DeviceWidget::CheckRestart);
+
+	if (GetShowSetting(sc, st, sn, "Compact", false)) {
+		SetupCompact(source, prop, sc);
+		return;
+	}
+
+	auto l = new QVBoxLayout(this);
+	l->setContentsMargins(0, 0, 0, 0);
+
+	const auto nameRow = new QHBoxLayout;
+	if (GetShowSetting(sc, st, sn, "Icon")) {
+		const auto iconLabel = new QLabel(this);
+		auto icon = GetIconFromType(
+			obs_source_get_icon_type(obs_source_get_id(source)));
+		iconLabel->setPixmap(icon.pixmap(16, 16));
+		nameRow->addWidget(iconLabel);
+	}
+	nameLabel = new QLabel(this);
 	nameLabel->setText(sourceName);
 	nameRow->addWidget(nameLabel, 1);
+	healthLabel = new QLabel(this);
+	healthLabel->hide();
+	nameRow->addWidget(healthLabel);
 
 	l->addLayout(nameRow);
 	auto settingName = obs_property_name(prop);
-	QString settingNameString = QString::fromUtf8(settingName);
+	this->settingName = settingName;
 	if (GetShowSetting(sc, st, sn, "Device")) {
 
 		auto settings = obs_source_get_settings(source);
@@ -723,25 +1359,16 @@ DeviceWidget::DeviceWidget(obs_source_t *source, obs_property_t *prop,
 		}
 
 		l->addWidget(combo);
+		deviceCombo = combo;
+		primaryDevice = deviceId ? deviceId : "";
+		combo->setContextMenuPolicy(Qt::CustomContextMenu);
+		connect(combo, &QComboBox::customContextMenuRequested, this,
+			&DeviceWidget::ShowFallbackMenu);
 		auto comboIndexChanged = static_cast<void (QComboBox::*)(int)>(
 			&QComboBox::currentIndexChanged);
-		connect(combo, comboIndexChanged,
-			[combo, this, settingNameString](int index) {
-				auto id = combo->itemData(index).toString();
-				auto source = obs_weak_source_get_source(
-					this->source);
-				if (!source)
-					return;
-				auto settings = obs_data_create();
-				auto uv = id.toUtf8();
-				auto v = uv.constData();
-				auto us = settingNameString.toUtf8();
-				auto s = us.constData();
-				obs_data_set_string(settings, s, v);
-				obs_source_update(source, settings);
-				obs_data_release(settings);
-				obs_source_release(source);
-			});
+		connect(combo, comboIndexChanged, [combo, this](int index) {
+			SelectDevice(combo->itemData(index).toString());
+		});
 	}
 	auto bw = new QWidget(this);
 	bw->setObjectName(QStringLiteral("contextContainer"));
@@ -796,29 +1423,34 @@ DeviceWidget::DeviceWidget(obs_source_t *source, obs_property_t *prop,
 			restart->setFixedSize(restart->size().height(),
 					      restart->size().height());
 		}
-		connect(restart, &QPushButton::clicked,
-			[this, settingNameString]() {
-				auto source = obs_weak_source_get_source(
-					this->source);
-				if (!source)
-					return;
-				auto settings = obs_source_get_settings(source);
-
-				auto us = settingNameString.toUtf8();
-				std::string s = us.constData();
-				std::string v = obs_data_get_string(settings, s.c_str());
-				obs_data_set_string(settings, s.c_str(), "");
-				obs_source_update(source, nullptr);
-				QTimer::singleShot(100, [source, settings, s, v] {
-					obs_data_set_string(settings, s.c_str(),
-							    v.c_str());
-					obs_source_update(source, nullptr);
-					obs_data_release(settings);
-					obs_source_release(source);
-				});
-			});
+		connect(restart, &QPushButton::clicked, this,
+			&DeviceWidget::Restart);
+		restartButton = restart;
 		hl->addWidget(restart);
 	}
+	if (deviceCombo && GetShowSetting(sc, st, sn, "Standby", false)) {
+		standbyButton = new QPushButton(
+			QString::fromUtf8(obs_module_text("Standby")), bw);
+		standbyButton->setCheckable(true);
+		standbyButton->setContextMenuPolicy(Qt::CustomContextMenu);
+		connect(standbyButton, &QPushButton::clicked, [this] {
+			if (standby && !standby->Active())
+				FailOver();
+			else
+				FailBack();
+		});
+		connect(standbyButton, &QPushButton::customContextMenuRequested,
+			this, &DeviceWidget::ShowStandbyMenu);
+		hl->addWidget(standbyButton);
+
+		auto prefs = obs_data_get_obj(dock->devicePrefs, sn);
+		const char *standbyId = obs_data_get_string(prefs, "standby");
+		if (standbyId && *standbyId)
+			SetStandbyDevice(QString::fromUtf8(standbyId));
+		else
+			UpdateStandbyButton();
+		obs_data_release(prefs);
+	}
 
 	if ((obs_source_get_output_flags(source) & OBS_OUTPUT_AUDIO) ==
 		    OBS_OUTPUT_AUDIO &&
@@ -826,6 +1458,7 @@ DeviceWidget::DeviceWidget(obs_source_t *source, obs_property_t *prop,
 	    GetShowSetting(sc, st, sn, "Monitor")) {
 		auto monitor = new QCheckBox(
 			QString::fromUtf8(obs_module_text("Monitor")), bw);
+		monitorCheck = monitor;
 		monitor->setChecked(obs_source_get_monitoring_type(source) !=
 				    OBS_MONITORING_TYPE_NONE);
 		connect(monitor, &QCheckBox::stateChanged,
@@ -869,18 +1502,28 @@ DeviceWidget::DeviceWidget(obs_source_t *source, obs_property_t *prop,
 	}
 
 	l->addWidget(bw);
+	controls = bw;
 	if ((obs_source_get_output_flags(source) & OBS_OUTPUT_AUDIO) ==
 		    OBS_OUTPUT_AUDIO &&
 	    obs_source_audio_active(source)) {
 		if (GetShowSetting(sc, st, sn, "VolumeMeter")) {
-			auto volMeter = new VolumeMeter(nullptr, source);
-			volMeter->setSizePolicy(QSizePolicy::Minimum,
-						QSizePolicy::Fixed);
-
+			ReadMeterSettings(sc, st, sn);
+			if (levelHistory) {
+				history = std::make_shared<LevelRecorder>();
+				history->SetSource(source);
+				historyTimer = VolumeMeter::SharedTimer();
+				historyTimer->AddRecorder(history.get());
+			}
+			volMeter = CreateVolumeMeter(source);
 			l->addWidget(volMeter);
 		}
+		if (GetShowSetting(sc, st, sn, "Spectrum", false)) {
+			spectrum = new SpectrumStrip(this);
+			spectrum->SetSource(source);
+			l->addWidget(spectrum);
+		}
 		if (GetShowSetting(sc, st, sn, "VolumeSlider")) {
-			auto volControl = new QWidget;
+			volControl = new QWidget;
 			volControl->setContentsMargins(0, 0, 0, 0);
 			auto *audioLayout = new QHBoxLayout(this);
 
@@ -919,10 +1562,6 @@ DeviceWidget::DeviceWidget(obs_source_t *source, obs_property_t *prop,
 					obs_source_release(source);
 				});
 
-			const auto sh = obs_source_get_signal_handler(source);
-			signal_handler_connect(sh, "mute", OBSMute, this);
-			signal_handler_connect(sh, "volume", OBSVolume, this);
-
 			audioLayout->addWidget(slider);
 			audioLayout->addWidget(mute);
 
@@ -933,32 +1572,1297 @@ DeviceWidget::DeviceWidget(obs_source_t *source, obs_property_t *prop,
 	setLayout(l);
 	if (mute || slider)
 		UpdateVolControls();
+
+	sceneAware = sc && config_get_bool(sc, "General", "SceneAware");
+	ConnectSignals(source);
+	if (sceneAware) {
+		summaryLabel = new QLabel(this);
+		summaryLabel->hide();
+		l->insertWidget(1, summaryLabel);
+		UpdateActivation();
+	}
+
+	if (deviceCombo) {
+		auto prefs = obs_data_get_obj(dock->devicePrefs, sn);
+		auto array = obs_data_get_array(prefs, "fallbacks");
+		const size_t count = obs_data_array_count(array);
+		for (size_t i = 0; i < count; i++) {
+			auto item = obs_data_array_item(array, i);
+			fallbacks.push_back(obs_data_get_string(item, "id"));
+			obs_data_release(item);
+		}
+		obs_data_array_release(array);
+		obs_data_release(prefs);
+		UpdateHealthMonitor();
+	}
+	UpdateSwitchTooltip();
 }
 
 bool DeviceWidget::GetShowSetting(config_t *config, const char *st,
-				  const char *sn, const char *setting)
+				  const char *sn, const char *setting, bool def)
 {
 	if (!config)
-		return true;
+		return def;
 	if (config_has_user_value(config, sn, setting))
 		return config_get_bool(config, sn, setting);
 	if (config_has_user_value(config, st, setting))
 		return config_get_bool(config, st, setting);
 	if (config_has_user_value(config, "General", setting))
 		return config_get_bool(config, "General", setting);
-	return true;
+	return def;
+}
+
+const char *DeviceWidget::GetStringSetting(config_t *config, const char *st,
+					   const char *sn, const char *setting,
+					   const char *def)
+{
+	if (!config)
+		return def;
+	if (config_has_user_value(config, sn, setting))
+		return config_get_string(config, sn, setting);
+	if (config_has_user_value(config, st, setting))
+		return config_get_string(config, st, setting);
+	if (config_has_user_value(config, "General", setting))
+		return config_get_string(config, "General", setting);
+	return def;
+}
+
+void DeviceWidget::ReadMeterSettings(config_t *config, const char *st,
+				     const char *sn)
+{
+	loudness = GetShowSetting(config, st, sn, "Loudness", false);
+	levelHistory = GetShowSetting(config, st, sn, "History", false);
+	const char *channels =
+		GetStringSetting(config, st, sn, "MeterChannels", "all");
+	if (strcmp(channels, "loudest") == 0)
+		meterChannels = VolumeMeter::Channels::Loudest;
+	else if (strcmp(channels, "stereo") == 0)
+		meterChannels = VolumeMeter::Channels::Stereo;
+	meterRate = atoi(GetStringSetting(config, st, sn, "MeterRate", "60"));
+	const char *peak =
+		GetStringSetting(config, st, sn, "PeakMeter", "sample");
+	if (strcmp(peak, "true") == 0)
+		peakMeterType = TRUE_PEAK_METER;
+	const char *decay =
+		GetStringSetting(config, st, sn, "MeterDecay", "medium");
+	if (strcmp(decay, "fast") == 0)
+		meterDecay = VOLUME_METER_DECAY_FAST;
+	else if (strcmp(decay, "slow") == 0)
+		meterDecay = VOLUME_METER_DECAY_SLOW;
+}
+
+VolumeMeter *DeviceWidget::CreateVolumeMeter(obs_source_t *s)
+{
+	auto meter = new VolumeMeter(nullptr, s);
+	meter->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+	if (loudness)
+		meter->EnableLoudness(s);
+	meter->SetHistory(history);
+	meter->SetChannelReduction(meterChannels);
+	meter->SetUpdateRate(meterRate);
+	meter->setPeakMeterType(peakMeterType);
+	meter->setPeakDecayRate(meterDecay);
+	meter->SetExportName(obs_source_get_name(s));
+	meter->SetTelemetrySource(telemetrySource);
+	return meter;
 }
 
 DeviceWidget::~DeviceWidget()
 {
+	dock->deviceWidgets.remove(id);
+	if (historyTimer)
+		historyTimer->RemoveRecorder(history.get());
+	standby.reset();
+	CancelRestart();
+	EndSwitchMeasure();
+	DetachActivityProbe();
+	auto s = obs_weak_source_get_source(source);
+	if (s) {
+		DisconnectSignals(s);
+		obs_source_release(s);
+	}
+	dock->retainStore.SetSaveDevice(source, nullptr, nullptr);
+	obs_weak_source_release(source);
+	obs_source_release(probe);
+}
+
+void DeviceWidget::ConnectSignals(obs_source_t *s)
+{
+	const auto sh = obs_source_get_signal_handler(s);
+	signal_handler_connect(sh, "update", OBSUpdate, this);
+	// The summary of a collapsed row shows volume and mute too, so these
+	// stay connected while collapsed.
+	if (slider || (compact && compact->audio) || sceneAware) {
+		signal_handler_connect(sh, "mute", OBSMute, this);
+		signal_handler_connect(sh, "volume", OBSVolume, this);
+	}
+	if (sceneAware) {
+		signal_handler_connect(sh, "activate", OBSActivation, this);
+		signal_handler_connect(sh, "deactivate", OBSActivation, this);
+		signal_handler_connect(sh, "show", OBSActivation, this);
+		signal_handler_connect(sh, "hide", OBSActivation, this);
+	}
+}
+
+void DeviceWidget::DisconnectSignals(obs_source_t *s)
+{
+	const auto sh = obs_source_get_signal_handler(s);
+	signal_handler_disconnect(sh, "mute", OBSMute, this);
+	signal_handler_disconnect(sh, "volume", OBSVolume, this);
+	signal_handler_disconnect(sh, "update", OBSUpdate, this);
+	signal_handler_disconnect(sh, "activate", OBSActivation, this);
+	signal_handler_disconnect(sh, "deactivate", OBSActivation, this);
+	signal_handler_disconnect(sh, "show", OBSActivation, this);
+	signal_handler_disconnect(sh, "hide", OBSActivation, this);
+}
+
+void DeviceWidget::Unbind()
+{
+	CancelRestart();
+	EndSwitchMeasure();
+	if (standby) {
+		standby->Deactivate();
+		UpdateStandbyButton();
+	}
+	DetachActivityProbe();
+	obs_source_release(probe);
+	probe = nullptr;
+	probeData = nullptr;
 	auto s = obs_weak_source_get_source(source);
 	if (s) {
-		const auto sh = obs_source_get_signal_handler(s);
-		signal_handler_disconnect(sh, "mute", OBSMute, this);
-		signal_handler_disconnect(sh, "volume", OBSVolume, this);
+		DisconnectSignals(s);
 		obs_source_release(s);
 	}
+	if (volMeter) {
+		meterIndex = layout()->indexOf(volMeter);
+		delete volMeter;
+		volMeter = nullptr;
+	}
+	if (spectrum)
+		spectrum->SetSource(nullptr);
+	if (compact)
+		compact->SetSource(nullptr);
+	if (history)
+		history->SetSource(nullptr);
+	dock->retainStore.SetSaveDevice(source, nullptr, nullptr);
 	obs_weak_source_release(source);
+	source = nullptr;
+}
+
+void DeviceWidget::Bind(obs_source_t *s)
+{
+	source = obs_source_get_weak_source(s);
+	ConnectSignals(s);
+	if (standby)
+		standby->Retarget(s);
+	if (history)
+		history->SetSource(s);
+	PublishSaveDevice();
+	if (meterIndex >= 0 && !collapsed) {
+		volMeter = CreateVolumeMeter(s);
+		static_cast<QVBoxLayout *>(layout())->insertWidget(meterIndex,
+								  volMeter);
+	}
+	if (spectrum && !collapsed)
+		spectrum->SetSource(s);
+	if (compact && compact->metered)
+		compact->SetSource(s);
+	if (compact && compact->switchable) {
+		auto settings = obs_source_get_settings(s);
+		const std::string device =
+			obs_data_get_string(settings, settingName.c_str());
+		obs_data_release(settings);
+		compact->device = DeviceName(s, device);
+		update();
+	}
+	if (deviceCombo) {
+		auto settings = obs_source_get_settings(s);
+		const std::string device =
+			obs_data_get_string(settings, settingName.c_str());
+		obs_data_release(settings);
+		const int index = deviceCombo->findData(QT_UTF8(device.c_str()));
+		if (index >= 0 && index != deviceCombo->currentIndex()) {
+			QSignalBlocker blocker(deviceCombo);
+			deviceCombo->setCurrentIndex(index);
+		}
+		ResetFailover(device);
+	}
+	if (monitorCheck) {
+		QSignalBlocker blocker(monitorCheck);
+		monitorCheck->setChecked(obs_source_get_monitoring_type(s) !=
+					 OBS_MONITORING_TYPE_NONE);
+	}
+	if (mute || slider || compact)
+		UpdateVolControls();
+	UpdateHealthMonitor();
+	UpdateActivation();
+}
+
+#define SWITCH_TIMEOUT_NS 10000000000ULL
+
+// The probe filter of a video source only sees frames while the source is
+// shown, hidden video cannot be timed.
+static bool ActivityObservable(obs_source_t *s)
+{
+	return !(obs_source_get_output_flags(s) & OBS_SOURCE_VIDEO) ||
+	       obs_source_showing(s);
+}
+
+void DeviceWidget::BeginSwitchMeasure(uint64_t start)
+{
+	EndSwitchMeasure();
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	if (!ActivityObservable(s)) {
+		blog(LOG_DEBUG,
+		     "[Device Switcher] '%s' is hidden, switch not measured",
+		     QT_TO_UTF8(objectName()));
+		obs_source_release(s);
+		return;
+	}
+	const uint32_t flags = obs_source_get_output_flags(s);
+	measureVideo = (flags & OBS_SOURCE_VIDEO) != 0;
+	measureAudio = !measureVideo && (flags & OBS_SOURCE_AUDIO) != 0;
+	switchApplied = 0;
+	switchFirstAudio = 0;
+	AttachActivityProbe(s);
+	if (auto p = probeData.load())
+		p->Disarm();
+	obs_source_release(s);
+	switchStart = start;
+	switchTimer.start(16);
+}
+
+void DeviceWidget::EndSwitchMeasure()
+{
+	if (!switchStart)
+		return;
+	switchTimer.stop();
+	switchStart = 0;
+	measuringFailover = false;
+	if (auto p = probeData.load())
+		p->Disarm();
+	if (restartState == RestartState::Idle && !HealthMonitored())
+		DetachActivityProbe();
+}
+
+void DeviceWidget::AttachActivityProbe(obs_source_t *s)
+{
+	const uint32_t flags = obs_source_get_output_flags(s);
+	if (flags & OBS_SOURCE_VIDEO) {
+		// The probe only sits on the source while it is needed.
+		if (!probe) {
+			probe = device_probe_attach(s);
+			probeData = device_probe_get(probe);
+		} else if (!obs_filter_get_parent(probe)) {
+			obs_source_filter_add(s, probe);
+		}
+	} else if ((flags & OBS_SOURCE_AUDIO) && !audioCaptureAttached) {
+		obs_source_add_audio_capture_callback(s, ActivityAudioCaptured,
+						      this);
+		audioCaptureAttached = true;
+	}
+}
+
+void DeviceWidget::DetachActivityProbe()
+{
+	if (probe) {
+		if (auto parent = obs_filter_get_parent(probe))
+			obs_source_filter_remove(parent, probe);
+	}
+	if (audioCaptureAttached) {
+		auto s = obs_weak_source_get_source(source);
+		if (s) {
+			obs_source_remove_audio_capture_callback(
+				s, ActivityAudioCaptured, this);
+			obs_source_release(s);
+		}
+		audioCaptureAttached = false;
+	}
+}
+
+uint64_t DeviceWidget::LastActivity()
+{
+	uint64_t last = lastAudio;
+	if (auto p = probeData.load()) {
+		const uint64_t frame = p->lastFrame;
+		if (frame > last)
+			last = frame;
+	}
+	return last;
+}
+
+#define RESTART_QUIET_NS 150000000ULL
+#define RESTART_RELEASE_TIMEOUT_NS 5000000000ULL
+// How long hidden video gets to release the device.
+#define RESTART_HIDDEN_RELEASE_NS 500000000ULL
+
+void DeviceWidget::Restart()
+{
+	if (restartState != RestartState::Idle ||
+	    (standby && standby->Active()))
+		return;
+	ProfileScope scope("DeviceWidget restart");
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	EndSwitchMeasure();
+	auto settings = obs_source_get_settings(s);
+	restartValue = obs_data_get_string(settings, settingName.c_str());
+	obs_data_release(settings);
+
+	restartStart = os_gettime_ns();
+	restartObservable = ActivityObservable(s);
+	AttachActivityProbe(s);
+	auto clear = obs_data_create();
+	obs_data_set_string(clear, settingName.c_str(), "");
+	obs_source_update(s, clear);
+	obs_data_release(clear);
+	obs_source_release(s);
+
+	// Reopen once the source stopped delivering, instead of guessing
+	// how long the device needs to be released.
+	restartState = RestartState::Releasing;
+	if (restartButton)
+		restartButton->setEnabled(false);
+	restartTimer.start(16);
+}
+
+void DeviceWidget::CancelRestart()
+{
+	if (restartState == RestartState::Idle)
+		return;
+	restartTimer.stop();
+	restartState = RestartState::Idle;
+	if (restartButton)
+		restartButton->setEnabled(true);
+	if (!switchStart && !HealthMonitored())
+		DetachActivityProbe();
+}
+
+void DeviceWidget::CheckRestart()
+{
+	const uint64_t ts = os_gettime_ns();
+	if (restartState == RestartState::Releasing) {
+		uint64_t last = LastActivity();
+		if (last < restartStart)
+			last = restartStart;
+		const bool quiet =
+			restartObservable
+				? ts - last >= RESTART_QUIET_NS
+				: ts - restartStart >= RESTART_HIDDEN_RELEASE_NS;
+		const bool timeout =
+			ts - restartStart >= RESTART_RELEASE_TIMEOUT_NS;
+		if (!quiet && !timeout)
+			return;
+		if (timeout)
+			blog(LOG_WARNING,
+			     "[Device Switcher] '%s' still active after release timeout",
+			     QT_TO_UTF8(objectName()));
+		auto s = obs_weak_source_get_source(source);
+		if (!s)
+			return CancelRestart();
+		restartState = RestartState::Reopening;
+		restartTimeouts = switchHistogram.timeouts;
+		restartSwitches = switchHistogram.count;
+		BeginSwitchMeasure(restartStart);
+		auto reopen = obs_data_create();
+		obs_data_set_string(reopen, settingName.c_str(),
+				    restartValue.c_str());
+		obs_source_update(s, reopen);
+		obs_data_release(reopen);
+		obs_source_release(s);
+	} else if (restartState == RestartState::Reopening) {
+		if (switchStart)
+			return;
+		if (switchHistogram.timeouts != restartTimeouts) {
+			blog(LOG_WARNING,
+			     "[Device Switcher] '%s' did not reopen after restart",
+			     QT_TO_UTF8(objectName()));
+			return CancelRestart();
+		}
+		if (switchHistogram.count == restartSwitches) {
+			// Hidden video, the reopen was not measured.
+			blog(LOG_INFO,
+			     "[Device Switcher] '%s' reopened while hidden, "
+			     "restart not timed",
+			     QT_TO_UTF8(objectName()));
+			return CancelRestart();
+		}
+		const uint64_t duration = ts - restartStart;
+		restartDuration.Add(duration);
+		telemetry.Restart(telemetrySource, duration);
+		blog(LOG_INFO, "[Device Switcher] '%s' restarted in %.1f ms",
+		     QT_TO_UTF8(objectName()), duration / 1000000.0);
+		CancelRestart();
+		if (restartButton)
+			restartButton->setToolTip(
+				QString::fromUtf8(obs_module_text("RestartDuration"))
+					.arg(duration / 1000000.0, 0, 'f', 1));
+	}
+}
+
+void DeviceWidget::SetStandbyDevice(const QString &deviceId)
+{
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	const auto id = deviceId.toUtf8();
+	if (standby && standby->Active())
+		FailBack();
+	standby.reset();
+
+	auto settings = obs_source_get_settings(s);
+	const bool current =
+		strcmp(obs_data_get_string(settings, settingName.c_str()),
+		       id.constData()) == 0;
+	obs_data_release(settings);
+	if (!id.isEmpty() && current) {
+		blog(LOG_WARNING,
+		     "[Device Switcher] '%s' already uses the standby device",
+		     obs_source_get_name(s));
+	} else if (!id.isEmpty()) {
+		standby.reset(new DeviceStandby(s, settingName.c_str(),
+						id.constData()));
+	}
+	obs_source_release(s);
+
+	auto prefs = dock->GetDevicePrefs(objectName());
+	obs_data_set_string(prefs, "standby",
+			    standby ? standby->DeviceId().c_str() : "");
+	obs_data_release(prefs);
+	UpdateStandbyButton();
+	UpdateHealthMonitor();
+}
+
+void DeviceWidget::ShowStandbyMenu(const QPoint &pos)
+{
+	QMenu menu(this);
+	const QString current =
+		standby ? QString::fromUtf8(standby->DeviceId().c_str())
+			: QString();
+	auto none = menu.addAction(QString::fromUtf8(obs_module_text("None")));
+	none->setCheckable(true);
+	none->setChecked(current.isEmpty());
+	connect(none, &QAction::triggered,
+		[this] { SetStandbyDevice(QString()); });
+	menu.addSeparator();
+	for (int i = 0; i < deviceCombo->count(); i++) {
+		const auto deviceId = deviceCombo->itemData(i).toString();
+		if (deviceId.isEmpty())
+			continue;
+		auto action = menu.addAction(deviceCombo->itemText(i));
+		action->setCheckable(true);
+		action->setChecked(deviceId == current);
+		// The primary device can not be opened twice.
+		action->setEnabled(i != deviceCombo->currentIndex());
+		connect(action, &QAction::triggered,
+			[this, deviceId] { SetStandbyDevice(deviceId); });
+	}
+	menu.exec(standbyButton->mapToGlobal(pos));
+}
+
+void DeviceWidget::UpdateStandbyButton()
+{
+	if (!standbyButton)
+		return;
+	standbyButton->setChecked(standby && standby->Active());
+	if (!standby) {
+		standbyButton->setToolTip(
+			QString::fromUtf8(obs_module_text("StandbyNone")));
+		return;
+	}
+	QString device = QString::fromUtf8(standby->DeviceId().c_str());
+	const int index = deviceCombo->findData(device);
+	if (index >= 0)
+		device = deviceCombo->itemText(index);
+	QString tip = QString::fromUtf8(obs_module_text("StandbyDevice"))
+			      .arg(device);
+	if (failoverLatency.count)
+		tip += QStringLiteral("\n") +
+		       QString::fromUtf8(obs_module_text("FailoverLatency"))
+			       .arg(failoverLatency.last / 1000000.0, 0, 'f',
+				    1);
+	standbyButton->setToolTip(tip);
+}
+
+void DeviceWidget::FailOver()
+{
+	if (!standby || standby->Active())
+		return UpdateStandbyButton();
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	CancelRestart();
+	auto settings = obs_source_get_settings(s);
+	failoverDevice = obs_data_get_string(settings, settingName.c_str());
+	obs_data_release(settings);
+
+	// The standby device is already open, the swap only waits for its
+	// next frame or audio block to reach the primary source.
+	BeginSwitchMeasure(os_gettime_ns());
+	measuringFailover = switchStart != 0;
+	standby->Activate();
+
+	// Close the primary device, so only the standby output remains.
+	auto clear = obs_data_create();
+	obs_data_set_string(clear, settingName.c_str(), "");
+	obs_source_update(s, clear);
+	obs_data_release(clear);
+	obs_source_release(s);
+	PublishSaveDevice();
+	UpdateStandbyButton();
+}
+
+// While failed over the source is saved with the device the row fails
+// back to, not the cleared or fallback device it runs on. The live
+// settings keep the running device.
+void DeviceWidget::PublishSaveDevice()
+{
+	const char *device = nullptr;
+	if (standby && standby->Active())
+		device = failoverDevice.c_str();
+	else if (fallbackIndex >= 0)
+		device = primaryDevice.c_str();
+	dock->retainStore.SetSaveDevice(source, settingName.c_str(), device);
+}
+
+void DeviceWidget::FailBack()
+{
+	if (!standby || !standby->Active())
+		return UpdateStandbyButton();
+	standby->Deactivate();
+	auto s = obs_weak_source_get_source(source);
+	if (s) {
+		BeginSwitchMeasure(os_gettime_ns());
+		auto reopen = obs_data_create();
+		obs_data_set_string(reopen, settingName.c_str(),
+				    failoverDevice.c_str());
+		obs_source_update(s, reopen);
+		obs_data_release(reopen);
+		obs_source_release(s);
+	}
+	PublishSaveDevice();
+	UpdateStandbyButton();
+}
+
+void DeviceWidget::ApplySettings(obs_source_t *s, obs_data_t *settings)
+{
+	CancelRestart();
+	if (standby && standby->Active()) {
+		standby->Deactivate();
+		PublishSaveDevice();
+		UpdateStandbyButton();
+	}
+	if (obs_data_has_user_value(settings, settingName.c_str())) {
+		const std::string device =
+			obs_data_get_string(settings, settingName.c_str());
+		if (!autoSwitching)
+			ResetFailover(device);
+		// A device can only be open once.
+		if (standby && standby->DeviceId() == device)
+			SetStandbyDevice(QString());
+		const int index =
+			deviceCombo ? deviceCombo->findData(QT_UTF8(device.c_str()))
+				    : -1;
+		if (index >= 0 && index != deviceCombo->currentIndex()) {
+			QSignalBlocker blocker(deviceCombo);
+			deviceCombo->setCurrentIndex(index);
+		}
+		if (compact && compact->switchable) {
+			compact->device = DeviceName(s, device);
+			update();
+		}
+	}
+	BeginSwitchMeasure(os_gettime_ns());
+	obs_source_update(s, settings);
+	if (collapsed)
+		UpdateSummary();
+}
+
+void DeviceWidget::SetBus()
+{
+	auto prefs = dock->GetDevicePrefs(objectName());
+	bool ok = false;
+	const QString bus = QInputDialog::getText(
+		this, QString::fromUtf8(obs_module_text("Bus")),
+		QString::fromUtf8(obs_module_text("BusName")),
+		QLineEdit::Normal,
+		QT_UTF8(obs_data_get_string(prefs, "bus")), &ok);
+	if (ok)
+		obs_data_set_string(prefs, "bus", QT_TO_UTF8(bus.trimmed()));
+	obs_data_release(prefs);
+}
+
+void DeviceWidget::ShowFallbackMenu(const QPoint &pos)
+{
+	QMenu menu(this);
+	auto primary = menu.addAction(
+		QString::fromUtf8(obs_module_text("BackToPrimary")));
+	primary->setEnabled(fallbackIndex >= 0);
+	connect(primary, &QAction::triggered,
+		[this] { ReturnToPrimary(os_gettime_ns()); });
+	auto list = menu.addMenu(
+		QString::fromUtf8(obs_module_text("FallbackDevices")));
+	for (int i = 0; i < deviceCombo->count(); i++) {
+		const std::string deviceId =
+			QT_TO_UTF8(deviceCombo->itemData(i).toString());
+		if (deviceId.empty() || deviceId == primaryDevice)
+			continue;
+		const auto it =
+			std::find(fallbacks.begin(), fallbacks.end(), deviceId);
+		QString text = deviceCombo->itemText(i);
+		if (it != fallbacks.end())
+			text = QStringLiteral("%1. %2")
+				       .arg(it - fallbacks.begin() + 1)
+				       .arg(text);
+		auto action = list->addAction(text);
+		action->setCheckable(true);
+		action->setChecked(it != fallbacks.end());
+		// Checking appends to the end of the list, so the order is
+		// the order the devices were checked in.
+		connect(action, &QAction::triggered, [this, deviceId] {
+			auto devices = fallbacks;
+			const auto found = std::find(devices.begin(),
+						     devices.end(), deviceId);
+			if (found != devices.end())
+				devices.erase(found);
+			else
+				devices.push_back(deviceId);
+			SetFallbacks(devices);
+		});
+	}
+	list->addSeparator();
+	auto clear = list->addAction(QString::fromUtf8(obs_module_text("Clear")));
+	clear->setEnabled(!fallbacks.empty());
+	connect(clear, &QAction::triggered,
+		[this] { SetFallbacks(std::vector<std::string>()); });
+	menu.addSeparator();
+	connect(menu.addAction(QString::fromUtf8(obs_module_text("Bus"))),
+		&QAction::triggered, this, &DeviceWidget::SetBus);
+	menu.exec(deviceCombo->mapToGlobal(pos));
+}
+
+void DeviceWidget::SetFallbacks(const std::vector<std::string> &devices)
+{
+	fallbacks = devices;
+	auto array = obs_data_array_create();
+	for (const auto &deviceId : fallbacks) {
+		auto item = obs_data_create();
+		obs_data_set_string(item, "id", deviceId.c_str());
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+	}
+	auto prefs = dock->GetDevicePrefs(objectName());
+	obs_data_set_array(prefs, "fallbacks", array);
+	obs_data_release(prefs);
+	obs_data_array_release(array);
+	UpdateHealthMonitor();
+}
+
+bool DeviceWidget::HealthMonitored() const
+{
+	return deviceCombo && (standby || !fallbacks.empty());
+}
+
+void DeviceWidget::UpdateHealthMonitor()
+{
+	if (!HealthMonitored()) {
+		if (!switchStart && restartState == RestartState::Idle)
+			DetachActivityProbe();
+		healthSince = 0;
+		return;
+	}
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	// The probe and capture callback only count, so they can stay on
+	// every monitored source.
+	AttachActivityProbe(s);
+	obs_source_release(s);
+	if (!healthSince)
+		healthSince = os_gettime_ns();
+}
+
+void DeviceWidget::ResetFailover(const std::string &device)
+{
+	primaryDevice = device;
+	fallbackIndex = -1;
+	failbackHoldScale = 1;
+	primaryListedSince = 0;
+	healthSince = os_gettime_ns();
+	PublishSaveDevice();
+	UpdateHealthLabel();
+}
+
+void DeviceWidget::SelectDevice(const QString &device)
+{
+	ProfileScope scope("DeviceWidget device switch");
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	auto settings = obs_data_create();
+	obs_data_set_string(settings, settingName.c_str(), QT_TO_UTF8(device));
+	ApplySettings(s, settings);
+	obs_data_release(settings);
+	obs_source_release(s);
+}
+
+void DeviceWidget::ApplyDevice(const std::string &device)
+{
+	const QString id = QT_UTF8(device.c_str());
+	if (deviceCombo) {
+		const int index = deviceCombo->findData(id);
+		if (index < 0)
+			return;
+		QSignalBlocker blocker(deviceCombo);
+		deviceCombo->setCurrentIndex(index);
+	}
+	autoSwitching = true;
+	SelectDevice(id);
+	autoSwitching = false;
+}
+
+#define FAILBACK_CHECK_NS 5000000000ULL
+#define FAILBACK_HOLD_MAX_SCALE 32
+
+void DeviceWidget::CheckHealth(uint64_t ts)
+{
+	if (!HealthMonitored() || !healthSince ||
+	    restartState != RestartState::Idle)
+		return;
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	const bool video = (obs_source_get_output_flags(s) &
+			    OBS_SOURCE_VIDEO) != 0;
+	// Async frames only pass the probe while the source is shown.
+	const bool observable = !video || obs_source_showing(s);
+	obs_source_release(s);
+	if (!observable) {
+		healthSince = ts;
+		return;
+	}
+
+	uint64_t last = LastActivity();
+	if (last < healthSince)
+		last = healthSince;
+	if (ts - last >= dock->failoverWindow) {
+		telemetry.Idle(telemetrySource, ts - last);
+		if (StepFailover(ts))
+			return;
+	}
+
+	if (fallbackIndex < 0) {
+		// Healthy on the primary for a while, forget earlier flapping.
+		if (failbackHoldScale > 1 &&
+		    ts - healthSince > dock->failbackHold * failbackHoldScale)
+			failbackHoldScale = 1;
+		return;
+	}
+	if (presencePending || ts - lastPresenceCheck < FAILBACK_CHECK_NS)
+		return;
+	lastPresenceCheck = ts;
+	CheckPrimaryListed();
+}
+
+struct PresenceTask {
+	DeviceSwitcherDock *dock;
+	uint64_t widgetId;
+	obs_weak_source_t *source;
+	std::string settingName;
+	std::string device;
+};
+
+void DeviceWidget::CheckPrimaryListed()
+{
+	auto task = new PresenceTask;
+	task->dock = dock;
+	task->widgetId = id;
+	task->source = source;
+	obs_weak_source_addref(source);
+	task->settingName = settingName;
+	task->device = primaryDevice;
+	if (!os_task_queue_queue_task(dock->taskQueue, ListPrimaryDevice,
+				      task)) {
+		obs_weak_source_release(task->source);
+		delete task;
+		return;
+	}
+	presencePending = true;
+}
+
+void DeviceWidget::ListPrimaryDevice(void *param)
+{
+	ProfileScope scope("DeviceWidget::ListPrimaryDevice");
+	auto task = static_cast<PresenceTask *>(param);
+	bool found = false;
+	if (auto s = obs_weak_source_get_source(task->source)) {
+		// Building the properties enumerates the devices, which can
+		// take a while for some drivers.
+		auto props = obs_source_properties(s);
+		auto prop = obs_properties_get(props, task->settingName.c_str());
+		const size_t count = obs_property_list_item_count(prop);
+		for (size_t i = 0; i < count && !found; i++) {
+			const char *deviceId =
+				obs_property_list_item_string(prop, i);
+			found = deviceId && task->device == deviceId;
+		}
+		obs_properties_destroy(props);
+		obs_source_release(s);
+	}
+	PluginEvent event = {};
+	event.type = PluginEventType::RowPresence;
+	event.widgetId = task->widgetId;
+	event.listed = found;
+	task->dock->events.Push(event);
+	obs_weak_source_release(task->source);
+	delete task;
+}
+
+void DeviceWidget::PrimaryListed(bool listed)
+{
+	presencePending = false;
+	if (fallbackIndex < 0)
+		return;
+	if (!listed) {
+		primaryListedSince = 0;
+		return;
+	}
+	const uint64_t ts = os_gettime_ns();
+	if (!primaryListedSince)
+		primaryListedSince = ts;
+	if (ts - primaryListedSince >= dock->failbackHold * failbackHoldScale)
+		ReturnToPrimary(ts);
+}
+
+bool DeviceWidget::StepFailover(uint64_t ts)
+{
+	const int from = fallbackIndex;
+	if (fallbackIndex < 0 && standby && !standby->Active()) {
+		fallbackIndex = 0;
+		FailOver();
+	} else {
+		const int next = fallbackIndex < 1 ? 1 : fallbackIndex + 1;
+		if (next > (int)fallbacks.size()) {
+			// Nothing left to try, keep the current device.
+			const QString noDevice =
+				QString::fromUtf8(obs_module_text("NoDevice"));
+			if (!healthLabel || healthLabel->text() != noDevice)
+				blog(LOG_WARNING,
+				     "[Device Switcher] '%s' no working fallback device",
+				     QT_TO_UTF8(objectName()));
+			if (healthLabel) {
+				healthLabel->setText(noDevice);
+				healthLabel->show();
+			}
+			healthSince = ts;
+			return false;
+		}
+		fallbackIndex = next;
+		if (fallbacks[next - 1] == primaryDevice)
+			return StepFailover(ts);
+		ApplyDevice(fallbacks[next - 1]);
+	}
+	if (from < 0) {
+		primaryListedSince = 0;
+		lastPresenceCheck = ts;
+	}
+	telemetry.Failover(telemetrySource,
+			   fallbackIndex == 0
+				   ? standby->DeviceId().c_str()
+				   : fallbacks[fallbackIndex - 1].c_str());
+	blog(LOG_WARNING,
+	     "[Device Switcher] '%s' no frames or audio for %llu ms, failing over to %s",
+	     QT_TO_UTF8(objectName()),
+	     (unsigned long long)(dock->failoverWindow / 1000000),
+	     fallbackIndex == 0 ? "standby"
+				: fallbacks[fallbackIndex - 1].c_str());
+	healthSince = ts;
+	PublishSaveDevice();
+	UpdateHealthLabel();
+	return true;
+}
+
+void DeviceWidget::ReturnToPrimary(uint64_t ts)
+{
+	if (fallbackIndex < 0)
+		return;
+	blog(LOG_INFO, "[Device Switcher] '%s' returning to primary device",
+	     QT_TO_UTF8(objectName()));
+	telemetry.Failback(telemetrySource);
+	if (standby && standby->Active()) {
+		FailBack();
+	} else {
+		ApplyDevice(primaryDevice);
+	}
+	fallbackIndex = -1;
+	primaryListedSince = 0;
+	// When the primary fails again soon, wait longer before the next
+	// attempt to avoid flapping between devices.
+	if (failbackHoldScale < FAILBACK_HOLD_MAX_SCALE)
+		failbackHoldScale *= 2;
+	healthSince = ts;
+	PublishSaveDevice();
+	UpdateHealthLabel();
+}
+
+// Compact rows have no label, they paint without one.
+void DeviceWidget::UpdateHealthLabel()
+{
+	if (!healthLabel)
+		return;
+	if (fallbackIndex < 0) {
+		healthLabel->hide();
+		return;
+	}
+	healthLabel->setText(QString::fromUtf8(obs_module_text("FailedOver")));
+	healthLabel->show();
+}
+
+void DeviceWidget::mousePressEvent(QMouseEvent *event)
+{
+	if (compact && event->button() == Qt::LeftButton &&
+	    !(event->modifiers() & Qt::ControlModifier)) {
+		switch (compact->HitTest(rect(), event->pos())) {
+		case CompactRow::Part::Device:
+			if (compact->switchable)
+				ShowCompactDevices();
+			break;
+		case CompactRow::Part::Meter:
+			if (!compact->audio)
+				break;
+			compactDragging = true;
+			SliderChanged((int)(compact->FaderAt(rect(),
+							     event->pos().x()) *
+					    10000.0f));
+			break;
+		case CompactRow::Part::Mute:
+			if (auto s = obs_weak_source_get_source(source)) {
+				obs_source_set_muted(s, !obs_source_muted(s));
+				obs_source_release(s);
+			}
+			break;
+		default:
+			break;
+		}
+		event->accept();
+		return;
+	}
+	if (event->button() != Qt::LeftButton ||
+	    !(event->modifiers() & Qt::ControlModifier))
+		return QWidget::mousePressEvent(event);
+	selected = !selected;
+	setAutoFillBackground(selected);
+	setBackgroundRole(selected ? QPalette::Highlight : QPalette::Window);
+	if (compact)
+		update();
+	event->accept();
+}
+
+void DeviceWidget::mouseMoveEvent(QMouseEvent *event)
+{
+	if (!compactDragging)
+		return QWidget::mouseMoveEvent(event);
+	SliderChanged(
+		(int)(compact->FaderAt(rect(), event->pos().x()) * 10000.0f));
+	event->accept();
+}
+
+void DeviceWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+	compactDragging = false;
+	QWidget::mouseReleaseEvent(event);
+}
+
+void DeviceWidget::contextMenuEvent(QContextMenuEvent *event)
+{
+	if (!compact)
+		return QWidget::contextMenuEvent(event);
+	ShowCompactMenu(event->globalPos());
+	event->accept();
+}
+
+void DeviceWidget::paintEvent(QPaintEvent *event)
+{
+	if (!compact)
+		return QWidget::paintEvent(event);
+	QPainter painter(this);
+	QPalette colors = palette();
+	if (selected)
+		colors.setColor(QPalette::Window,
+				colors.color(QPalette::Highlight));
+	compact->Paint(painter, rect(), colors, objectName());
+}
+
+// One painted line per source, see CompactRow. Standby and fallback
+// devices are configured on the full row and not offered here.
+void DeviceWidget::SetupCompact(obs_source_t *source, obs_property_t *prop,
+				config_t *sc)
+{
+	const char *sn = obs_source_get_name(source);
+	const char *st = obs_source_get_unversioned_id(source);
+	settingName = obs_property_name(prop);
+	compact = std::make_unique<CompactRow>(this);
+	if (GetShowSetting(sc, st, sn, "Device")) {
+		compact->switchable = true;
+		auto settings = obs_source_get_settings(source);
+		primaryDevice =
+			obs_data_get_string(settings, settingName.c_str());
+		obs_data_release(settings);
+		const size_t count = obs_property_list_item_count(prop);
+		for (size_t i = 0; i < count; i++) {
+			const char *id = obs_property_list_item_string(prop, i);
+			if (id && primaryDevice == id) {
+				compact->device = QString::fromUtf8(
+					obs_property_list_item_name(prop, i));
+				break;
+			}
+		}
+		if (compact->device.isEmpty())
+			compact->device = QString::fromUtf8(
+				obs_module_text("NoDevice"));
+	}
+	compact->properties = GetShowSetting(sc, st, sn, "Properties");
+	compact->filters = GetShowSetting(sc, st, sn, "Filters");
+	compact->restart = GetShowSetting(sc, st, sn, "Restart");
+	compact->retain = GetShowSetting(sc, st, sn, "Retain");
+	if ((obs_source_get_output_flags(source) & OBS_OUTPUT_AUDIO) ==
+		    OBS_OUTPUT_AUDIO &&
+	    obs_source_audio_active(source)) {
+		compact->monitor = GetShowSetting(sc, st, sn, "Monitor");
+		compact->audio = GetShowSetting(sc, st, sn, "VolumeSlider");
+		compact->metered = GetShowSetting(sc, st, sn, "VolumeMeter");
+		if (compact->metered)
+			compact->SetSource(source);
+	}
+	setAttribute(Qt::WA_OpaquePaintEvent, true);
+	setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+	setFixedHeight(compact->Height(fontMetrics().height()));
+	ConnectSignals(source);
+	UpdateVolControls();
+}
+
+QString DeviceWidget::DeviceName(obs_source_t *s, const std::string &device)
+{
+	QString name;
+	auto props = obs_source_properties(s);
+	auto prop = obs_properties_get(props, settingName.c_str());
+	const size_t count = obs_property_list_item_count(prop);
+	for (size_t i = 0; i < count && name.isEmpty(); i++) {
+		const char *id = obs_property_list_item_string(prop, i);
+		if (id && device == id)
+			name = QString::fromUtf8(
+				obs_property_list_item_name(prop, i));
+	}
+	obs_properties_destroy(props);
+	if (name.isEmpty())
+		name = QString::fromUtf8(obs_module_text("NoDevice"));
+	return name;
+}
+
+// The device list is read when the menu opens, so the row keeps no copy.
+void DeviceWidget::ShowCompactDevices()
+{
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	auto settings = obs_source_get_settings(s);
+	const std::string current =
+		obs_data_get_string(settings, settingName.c_str());
+	obs_data_release(settings);
+
+	QMenu menu;
+	auto props = obs_source_properties(s);
+	auto prop = obs_properties_get(props, settingName.c_str());
+	const size_t count = obs_property_list_item_count(prop);
+	for (size_t i = 0; i < count; i++) {
+		const char *id = obs_property_list_item_string(prop, i);
+		auto action = menu.addAction(QString::fromUtf8(
+			obs_property_list_item_name(prop, i)));
+		action->setData(QString::fromUtf8(id ? id : ""));
+		action->setCheckable(true);
+		action->setChecked(id && current == id);
+	}
+	obs_properties_destroy(props);
+	obs_source_release(s);
+
+	const QRect part = compact->PartRect(rect(), CompactRow::Part::Device);
+	auto action = menu.exec(mapToGlobal(part.bottomLeft()));
+	if (!action || !action->isChecked())
+		return;
+	s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	auto update = obs_data_create();
+	obs_data_set_string(update, settingName.c_str(),
+			    QT_TO_UTF8(action->data().toString()));
+	ApplySettings(s, update);
+	obs_data_release(update);
+	obs_source_release(s);
+}
+
+// The actions of the row's buttons and check boxes, built when asked.
+void DeviceWidget::ShowCompactMenu(const QPoint &pos)
+{
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	QMenu menu;
+	if (compact->properties)
+		menu.addAction(QString::fromUtf8(obs_module_text("Properties")),
+			       [s] { obs_frontend_open_source_properties(s); });
+	if (compact->filters)
+		menu.addAction(QString::fromUtf8(obs_module_text("Filters")),
+			       [s] { obs_frontend_open_source_filters(s); });
+	if (compact->restart)
+		menu.addAction(QString::fromUtf8(obs_module_text("Restart")),
+			       this, &DeviceWidget::Restart);
+	if (compact->monitor) {
+		auto action = menu.addAction(
+			QString::fromUtf8(obs_module_text("Monitor")), [s] {
+				obs_source_set_monitoring_type(
+					s,
+					obs_source_get_monitoring_type(s) ==
+							OBS_MONITORING_TYPE_NONE
+						? OBS_MONITORING_TYPE_MONITOR_AND_OUTPUT
+						: OBS_MONITORING_TYPE_NONE);
+			});
+		action->setCheckable(true);
+		action->setChecked(obs_source_get_monitoring_type(s) !=
+				   OBS_MONITORING_TYPE_NONE);
+	}
+	if (compact->retain) {
+		const bool retained = dock->HasSourceSettings(objectName());
+		auto action = menu.addAction(
+			QString::fromUtf8(obs_module_text("Retain")),
+			[this, s, retained] {
+				if (retained)
+					dock->RemoveSourceSettings(
+						objectName());
+				else
+					dock->SaveSourceSettings(s);
+			});
+		action->setCheckable(true);
+		action->setChecked(retained);
+	}
+	if (!menu.isEmpty())
+		menu.exec(pos);
+	obs_source_release(s);
+}
+
+void DeviceWidget::CheckSwitchMeasure()
+{
+	const uint64_t start = switchStart;
+	if (!start)
+		return switchTimer.stop();
+	uint64_t first = 0;
+	if (measureVideo) {
+		if (auto p = probeData.load())
+			first = p->firstFrame;
+	} else if (measureAudio) {
+		first = switchFirstAudio;
+	}
+	if (first) {
+		const uint64_t latency = first > start ? first - start : 0;
+		switchHistogram.Add(latency);
+		switchLatency.Add(latency);
+		telemetry.Switch(telemetrySource, latency);
+		if (measuringFailover) {
+			failoverLatency.Add(latency);
+			UpdateStandbyButton();
+		}
+		blog(LOG_INFO, "[Device Switcher] '%s' %s in %.1f ms",
+		     QT_TO_UTF8(objectName()),
+		     measuringFailover ? "failed over" : "switched",
+		     latency / 1000000.0);
+	} else if (os_gettime_ns() - start > SWITCH_TIMEOUT_NS) {
+		auto s = obs_weak_source_get_source(source);
+		const bool observable = s && ActivityObservable(s);
+		obs_source_release(s);
+		if (!observable) {
+			// Hidden since the switch, no frame could arrive.
+			blog(LOG_DEBUG,
+			     "[Device Switcher] '%s' hidden while switching, "
+			     "switch not measured",
+			     QT_TO_UTF8(objectName()));
+			EndSwitchMeasure();
+			return;
+		}
+		switchHistogram.timeouts++;
+		telemetry.SwitchTimeout(telemetrySource);
+		blog(LOG_WARNING,
+		     "[Device Switcher] '%s' no %s after switching device",
+		     QT_TO_UTF8(objectName()), measureVideo ? "frame" : "audio");
+	} else {
+		return;
+	}
+	EndSwitchMeasure();
+	UpdateSwitchTooltip();
+}
+
+void DeviceWidget::OBSUpdate(void *data, calldata_t *call_data)
+{
+	UNUSED_PARAMETER(call_data);
+	DeviceWidget *w = static_cast<DeviceWidget *>(data);
+	if (!w->switchStart || w->switchApplied)
+		return;
+	// Frames before the new settings are applied still come from the
+	// previous device.
+	const uint64_t ts = os_gettime_ns();
+	w->switchApplied = ts;
+	if (auto p = w->probeData.load())
+		p->Arm(ts);
+}
+
+void DeviceWidget::ActivityAudioCaptured(void *param, obs_source_t *source,
+					 const struct audio_data *audio_data,
+					 bool muted)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(audio_data);
+	UNUSED_PARAMETER(muted);
+	DeviceWidget *w = static_cast<DeviceWidget *>(param);
+	const uint64_t ts = os_gettime_ns();
+	w->lastAudio.store(ts, std::memory_order_relaxed);
+	if (!w->switchApplied.load(std::memory_order_acquire))
+		return;
+	uint64_t none = 0;
+	w->switchFirstAudio.compare_exchange_strong(none, ts);
+}
+
+void DeviceWidget::UpdateSwitchTooltip()
+{
+	QWidget *target = deviceCombo ? (QWidget *)deviceCombo : this;
+	const auto &h = switchHistogram;
+	if (!h.count && !h.timeouts) {
+		target->setToolTip(QString());
+		return;
+	}
+	QString tip = QString::fromUtf8(obs_module_text("SwitchLatency"));
+	if (h.count)
+		tip += QStringLiteral("\n%1 / %2 / %3 ms (min / avg / max)")
+			       .arg(h.min / 1000000.0, 0, 'f', 1)
+			       .arg(h.total / h.count / 1000000.0, 0, 'f', 1)
+			       .arg(h.max / 1000000.0, 0, 'f', 1);
+	for (int i = 0; i < LatencyHistogram::Buckets; i++) {
+		if (!h.counts[i])
+			continue;
+		if (i < LatencyHistogram::Buckets - 1)
+			tip += QStringLiteral("\n< %1 ms: %2")
+				       .arg(LatencyHistogram::bounds[i])
+				       .arg(h.counts[i]);
+		else
+			tip += QStringLiteral("\n>= %1 ms: %2")
+				       .arg(LatencyHistogram::bounds[i - 1])
+				       .arg(h.counts[i]);
+	}
+	if (h.timeouts)
+		tip += QStringLiteral("\n%1: %2")
+			       .arg(QString::fromUtf8(obs_module_text("Timeouts")))
+			       .arg(h.timeouts);
+	target->setToolTip(tip);
 }
 
 void DeviceWidget::SliderChanged(int v)
@@ -1001,59 +2905,165 @@ void DeviceWidget::UpdateVolControls()
 	locked->setChecked(lock);*/
 	if (mute) {
 		mute->setEnabled(!lock);
+		QSignalBlocker blocker(mute);
 		mute->setChecked(s ? obs_source_muted(s) : false);
 	}
 	if (slider) {
 		slider->setEnabled(!lock);
+		QSignalBlocker blocker(slider);
 		float mul = s ? obs_source_get_volume(s) : 0.0f;
-		float db = obs_mul_to_db(mul);
-		float def;
-		if (db >= 0.0f)
-			def = 1.0f;
-		else if (db <= -96.0f)
-			def = 0.0f;
-		else
-			def = (-log10f(-db + LOG_OFFSET_DB) - LOG_RANGE_VAL) /
-			      (LOG_OFFSET_VAL - LOG_RANGE_VAL);
-		slider->setValue(def * 10000.0f);
+		slider->setValue(VolumeToFader(mul) * 10000.0f);
+	}
+	if (compact) {
+		compact->muted = obs_source_muted(s);
+		compact->fader = VolumeToFader(obs_source_get_volume(s));
+		update();
 	}
 	obs_source_release(s);
 }
 
+void DeviceWidget::PostUpdate()
+{
+	if (updatePosted.exchange(true))
+		return;
+	PluginEvent event = {};
+	event.type = PluginEventType::RowUpdate;
+	event.widgetId = id;
+	dock->events.Push(event);
+}
+
+void DeviceWidget::OBSActivation(void *data, calldata_t *call_data)
+{
+	UNUSED_PARAMETER(call_data);
+	DeviceWidget *w = static_cast<DeviceWidget *>(data);
+	if (w->activationPosted.exchange(true))
+		return;
+	PluginEvent event = {};
+	event.type = PluginEventType::RowActivation;
+	event.widgetId = w->id;
+	w->dock->events.Push(event);
+}
+
+void DeviceWidget::UpdateActivation()
+{
+	activationPosted = false;
+	if (!sceneAware)
+		return;
+	auto s = obs_weak_source_get_source(source);
+	if (!s)
+		return;
+	const bool onAir = obs_source_active(s) || obs_source_showing(s);
+	if (onAir == collapsed) {
+		collapsed = !onAir;
+		if (collapsed) {
+			if (volMeter) {
+				meterIndex = layout()->indexOf(volMeter);
+				delete volMeter;
+				volMeter = nullptr;
+			}
+			if (spectrum)
+				spectrum->SetSource(nullptr);
+		} else {
+			if (meterIndex >= 0) {
+				volMeter = CreateVolumeMeter(s);
+				static_cast<QVBoxLayout *>(layout())
+					->insertWidget(meterIndex, volMeter);
+			}
+			if (spectrum)
+				spectrum->SetSource(s);
+		}
+		if (deviceCombo)
+			deviceCombo->setVisible(!collapsed);
+		if (controls)
+			controls->setVisible(!collapsed);
+		if (volControl)
+			volControl->setVisible(!collapsed);
+		if (spectrum)
+			spectrum->setVisible(!collapsed);
+		if (summaryLabel)
+			summaryLabel->setVisible(collapsed);
+	}
+	obs_source_release(s);
+	if (collapsed)
+		UpdateSummary();
+}
+
+void DeviceWidget::UpdateSummary()
+{
+	if (!summaryLabel)
+		return;
+	QString summary;
+	if (deviceCombo)
+		summary = deviceCombo->currentText();
+	auto s = obs_weak_source_get_source(source);
+	if (s && (obs_source_get_output_flags(s) & OBS_SOURCE_AUDIO)) {
+		if (!summary.isEmpty())
+			summary += QStringLiteral(" - ");
+		summary += obs_source_muted(s)
+				   ? QString::fromUtf8(obs_module_text("Muted"))
+				   : QStringLiteral("%1%").arg(qRound(
+					     obs_source_get_volume(s) * 100.0f));
+	}
+	obs_source_release(s);
+	summaryLabel->setText(summary);
+}
+
 void DeviceWidget::OBSVolume(void *data, calldata_t *call_data)
 {
-	double volume = calldata_float(call_data, "volume");
+	ProfileScope scope("DeviceWidget::OBSVolume");
 	DeviceWidget *w = static_cast<DeviceWidget *>(data);
-	QMetaObject::invokeMethod(w, "SetOutputVolume", Qt::QueuedConnection,
-				  Q_ARG(double, volume));
+	w->pendingVolume.store((float)calldata_float(call_data, "volume"),
+			       std::memory_order_relaxed);
+	w->pendingVolumeSet.store(true, std::memory_order_release);
+	w->PostUpdate();
 }
 
 void DeviceWidget::OBSMute(void *data, calldata_t *call_data)
 {
-	bool muted = calldata_bool(call_data, "muted");
+	ProfileScope scope("DeviceWidget::OBSMute");
 	DeviceWidget *w = static_cast<DeviceWidget *>(data);
-	QMetaObject::invokeMethod(w, "SetMute", Qt::QueuedConnection,
-				  Q_ARG(bool, muted));
+	w->pendingMute.store(calldata_bool(call_data, "muted") ? 1 : 0,
+			     std::memory_order_release);
+	w->PostUpdate();
 }
 
-void DeviceWidget::SetOutputVolume(double volume)
+void DeviceWidget::ApplyPendingUpdate()
 {
-	float db = obs_mul_to_db(volume);
-	float def;
-	if (db >= 0.0f)
-		def = 1.0f;
-	else if (db <= -96.0f)
-		def = 0.0f;
-	else
-		def = (-log10f(-db + LOG_OFFSET_DB) - LOG_RANGE_VAL) /
-		      (LOG_OFFSET_VAL - LOG_RANGE_VAL);
+	// Clear first, a value stored after this posts a new update.
+	updatePosted.store(false);
+	if (pendingVolumeSet.exchange(false, std::memory_order_acquire))
+		SetOutputVolume(
+			pendingVolume.load(std::memory_order_relaxed));
+	const int muted = pendingMute.exchange(-1, std::memory_order_acquire);
+	if (muted >= 0)
+		SetMute(muted != 0);
+	if (collapsed)
+		UpdateSummary();
+}
 
-	int val = def * 10000.0f;
+void DeviceWidget::SetOutputVolume(double volume)
+{
+	if (compact) {
+		compact->fader = VolumeToFader((float)volume);
+		update();
+	}
+	if (!slider)
+		return;
+	int val = VolumeToFader((float)volume) * 10000.0f;
+	// The value came from the source, do not send it back.
+	QSignalBlocker blocker(slider);
 	slider->setValue(val);
 }
 
 void DeviceWidget::SetMute(bool muted)
 {
+	if (compact) {
+		compact->muted = muted;
+		update();
+	}
+	if (!mute)
+		return;
+	QSignalBlocker blocker(mute);
 	mute->setChecked(muted);
 }
 
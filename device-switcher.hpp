@@ -4,22 +4,106 @@
 #include <QCheckBox>
 #include <qcombobox.h>
 #include <QDockWidget>
+#include <QHash>
+#include <QLabel>
+#include <QMenu>
 #include <qpushbutton.h>
 #include <QTextEdit>
+#include <QTimer>
 #include <QVBoxLayout>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <util/task.h>
 
 #include "obs.hpp"
+#include "benchmark.hpp"
+#include "compact-row.hpp"
+#include "event-queue.hpp"
+#include "plugin-stats.hpp"
+#include "device-probe.hpp"
+#include "device-scheduler.hpp"
+#include "device-standby.hpp"
+#include "retain-store.hpp"
+#include "spectrum-analyzer.hpp"
+#include "virtual-camera.hpp"
 #include "volume-meter.hpp"
 
+class DeviceWidget;
+
+enum class PluginEventType : uint8_t {
+	AddSource,
+	RemoveSource,
+	RenameSource,
+	RowUpdate,
+	RowActivation,
+	RowPresence,
+};
+
+// Posted from signal threads and handled by DispatchEvents on the UI
+// thread. Source events hold a weak reference, row events the row id.
+struct PluginEvent {
+	PluginEventType type;
+	obs_weak_source_t *source;
+	uint64_t widgetId;
+	bool listed; // RowPresence: the primary device is listed
+};
+
 class DeviceSwitcherDock : public QDockWidget {
 	Q_OBJECT
 
 private:
 	QVBoxLayout *mainLayout;
 	QComboBox *monitoringCombo = nullptr;
-	obs_data_t *retain_config = nullptr;
+	DeviceScheduler scheduler;
+	QTimer schedulerTimer;
+	QLabel *batchLabel = nullptr;
+	// Rows of removed sources are kept while a collection loads and
+	// bound to a source with the same name and type of the new one.
+	struct {
+		uint64_t start = 0;
+		int kept = 0;
+		int created = 0;
+	} reconcile;
+	// Retained settings of a scene collection being loaded are opened
+	// as one batch, committed once loading finished.
+	uint64_t loadBatch = 0;
+	bool collectionLoading = true;
+	QHash<QString, int> monitoringDeviceIndex;
+	std::atomic<uint64_t> monitoringGeneration{0};
+	os_task_queue_t *taskQueue = nullptr;
+	RetainStore retainStore;
+	// Per source preferences of the rows, like the standby device.
+	obs_data_t *devicePrefs = nullptr;
+	// Named device profiles, a device per source name.
+	obs_data_t *deviceProfiles = nullptr;
+	QMenu *applyProfileMenu = nullptr;
+	QMenu *deleteProfileMenu = nullptr;
 	config_t *show_config = nullptr;
 	QPushButton *virtualCamera = nullptr;
+	MpscQueue<PluginEvent, 1024> events;
+	QTimer eventTimer;
+	QHash<uint64_t, DeviceWidget *> deviceWidgets;
+	uint64_t nextWidgetId = 0;
+	QLabel *statsLabel = nullptr;
+	QTimer statsTimer;
+	QTimer healthTimer;
+	uint64_t failoverWindow = 0;
+	uint64_t failbackHold = 0;
+	struct {
+		DurationWindow meterInterval;
+		DurationWindow meterTick;
+		DurationWindow meterPaint;
+		DurationWindow dispatch;
+		DurationWindow addDeviceSource;
+		DurationWindow sourceProperties;
+		DurationWindow retainCapture;
+		DurationWindow retainApply;
+		DurationWindow volmeterLevels;
+		DurationWindow levelEngine;
+		DurationWindow loudness;
+		DurationWindow spectrum;
+	} statsWindows;
 	static void add_source(void *p, calldata_t *calldata);
 	static void remove_source(void *p, calldata_t *calldata);
 	static void rename_source(void *p, calldata_t *calldata);
@@ -27,30 +111,59 @@ private:
 	static bool is_device_source(obs_source_t *source);
 	static bool add_monitoring_device(void *data, const char *name,
 					  const char *id);
+	static void set_monitoring_device(void *param);
 	static void frontend_event(enum obs_frontend_event event, void *data);
-	static void SaveFilterSettings(obs_source_t *parent,
-				       obs_source_t *child, void *param);
+	static void frontend_save(obs_data_t *save_data, bool saving,
+				  void *data);
 	static void RemoveFilter(obs_source_t *parent, obs_source_t *child,
 				 void *param);
 
 	bool HasSourceSettings(QString sourceName);
 	void SaveSourceSettings(obs_source_t *source);
 	void RemoveSourceSettings(QString sourceName);
-	void LoadSourceSettings(obs_source_t *source);
+	obs_data_t *GetDevicePrefs(const QString &sourceName);
+	void LoadSourceSettings(DeviceWidget *w, obs_source_t *source);
+	void CommitLoadBatch();
+	void DropUnboundRows();
 	void LoadFilter(obs_source_t *parent, obs_data_t *filter_data);
+	void LoadFilters(obs_source_t *source, obs_data_array_t *filters);
+	std::string DeviceBus(DeviceWidget *w);
+	void SaveDeviceProfiles();
+	void ApplyDeviceProfile(const QString &name);
+	void ShowBatchReport(const std::string &label,
+			     const std::vector<DeviceJobResult> &results,
+			     uint64_t total);
+	void RefreshMonitoringDevices();
+	void SelectMonitoringDevice(const QString &id);
+	void PostSourceEvent(PluginEventType type, obs_source_t *source);
+	DeviceWidget *FindDeviceWidget(obs_weak_source_t *source);
+	void AddDeviceSource(obs_weak_source_t *weak);
+	void RemoveDeviceSource(obs_weak_source_t *weak);
+	void RenameDeviceSource(obs_weak_source_t *weak);
 
 	friend class DeviceWidget;
+	friend class DeviceScheduler;
+	friend class DockBenchmark;
 
-	bool restart_virtual_camera = false;
+	VirtualCamKeeper virtualCamKeeper;
+	// Declared last so a running benchmark is torn down first.
+	std::unique_ptr<DockBenchmark> benchmark;
 
 private slots:
-	void AddDeviceSource(QString sourceName);
-	void RemoveDeviceSource(QString sourceName);
-	void RenameDeviceSource(QString prevDeviceName, QString newDeviceName);
+	void DispatchEvents();
+	void UpdateStats();
+	void ExportSwitchLatency();
+	void RestartSelected();
+	void CheckHealth();
+	void RunScheduler();
+	void SaveDeviceProfile();
+	void UpdateProfileMenus();
 
 public:
 	DeviceSwitcherDock(QWidget *parent = nullptr);
 	~DeviceSwitcherDock();
+
+	size_t PendingEvents() const { return events.Depth(); }
 };
 
 class DeviceWidget : public QWidget {
@@ -58,25 +171,194 @@ class DeviceWidget : public QWidget {
 private:
 	obs_weak_source_t *source;
 	DeviceSwitcherDock *dock;
+	uint64_t id;
+	QLabel *nameLabel = nullptr;
 	QSlider *slider = nullptr;
 	QCheckBox *mute = nullptr;
 
+	// Latest volume and mute from the source signals. At most one
+	// RowUpdate is queued per row, so a burst of changes is applied
+	// once per UI tick with only the newest values.
+	std::atomic<float> pendingVolume{0.0f};
+	std::atomic<bool> pendingVolumeSet{false};
+	std::atomic<int> pendingMute{-1};
+	std::atomic<bool> updatePosted{false};
+
+	// Switch latency, from selecting a device until the first frame or
+	// audio block after the source applied the new settings.
+	QComboBox *deviceCombo = nullptr;
+	QTimer switchTimer;
+	obs_source_t *probe = nullptr;
+	std::atomic<DeviceProbe *> probeData{nullptr};
+	std::atomic<uint64_t> switchStart{0};
+	std::atomic<uint64_t> switchApplied{0};
+	std::atomic<uint64_t> switchFirstAudio{0};
+	std::atomic<uint64_t> lastAudio{0};
+	bool audioCaptureAttached = false;
+	bool measureVideo = false;
+	bool measureAudio = false;
+	DurationStat switchLatency;
+	LatencyHistogram switchHistogram;
+
+	enum class RestartState { Idle, Releasing, Reopening };
+	RestartState restartState = RestartState::Idle;
+	QTimer restartTimer;
+	QPushButton *restartButton = nullptr;
+	std::string settingName;
+	std::string restartValue;
+	uint64_t restartStart = 0;
+	uint32_t restartTimeouts = 0;
+	uint64_t restartSwitches = 0;
+	// False for hidden video, its release and reopen cannot be seen.
+	bool restartObservable = true;
+	bool selected = false;
+	DurationStat restartDuration;
+
+	std::unique_ptr<DeviceStandby> standby;
+	QPushButton *standbyButton = nullptr;
+	std::string failoverDevice;
+	bool measuringFailover = false;
+	DurationStat failoverLatency;
+
+	// Automatic failover. The row is monitored when a standby or fallback
+	// device is configured; once it delivers nothing for the failover
+	// window it moves to the standby and then down the fallback list.
+	std::vector<std::string> fallbacks;
+	std::string primaryDevice;
+	int fallbackIndex = -1; // -1 primary, 0 standby, 1.. fallbacks
+	bool autoSwitching = false;
+	uint64_t healthSince = 0;
+	uint64_t primaryListedSince = 0;
+	uint64_t lastPresenceCheck = 0;
+	bool presencePending = false;
+	uint64_t failbackHoldScale = 1;
+	QLabel *healthLabel = nullptr;
+
+	// Scene aware mode: rows of sources that are neither active nor
+	// shown drop their meter and signal hookups and collapse to a
+	// summary line until the source is used again.
+	bool sceneAware = false;
+	bool collapsed = false;
+	QWidget *controls = nullptr;
+	QWidget *volControl = nullptr;
+	VolumeMeter *volMeter = nullptr;
+	bool loudness = false;
+	bool levelHistory = false;
+	// Outlives the meters, which are dropped on collapse and rebind.
+	std::shared_ptr<LevelRecorder> history;
+	QSharedPointer<VolumeMeterTimer> historyTimer;
+	VolumeMeter::Channels meterChannels = VolumeMeter::Channels::All;
+	int meterRate = 60;
+	enum obs_peak_meter_type peakMeterType = SAMPLE_PEAK_METER;
+	qreal meterDecay = VOLUME_METER_DECAY_MEDIUM;
+	int meterIndex = -1;
+	SpectrumStrip *spectrum = nullptr;
+	QLabel *summaryLabel = nullptr;
+	std::atomic<bool> activationPosted{false};
+
+	std::string sourceType;
+	QCheckBox *monitorCheck = nullptr;
+	uint32_t telemetrySource = 0;
+
+	// Compact mode: the row paints itself instead of holding the child
+	// widgets above, which all stay null.
+	std::unique_ptr<CompactRow> compact;
+	bool compactDragging = false;
+
+	// Opt-in modes pass def false, so a missing config or key keeps
+	// them off.
 	bool GetShowSetting(config_t *config, const char *st, const char *sn,
-			    const char *setting);
+			    const char *setting, bool def = true);
+	// The value of setting for the source, its type or General, def
+	// when none has it.
+	const char *GetStringSetting(config_t *config, const char *st,
+				     const char *sn, const char *setting,
+				     const char *def);
+	// Reads the meter options above once, meters recreated on rebind
+	// or activation reuse them.
+	void ReadMeterSettings(config_t *config, const char *st,
+			       const char *sn);
+	VolumeMeter *CreateVolumeMeter(obs_source_t *s);
 	void UpdateVolControls();
 	static void OBSVolume(void *data, calldata_t *call_data);
 	static void OBSMute(void *data, calldata_t *call_data);
+	static void OBSUpdate(void *data, calldata_t *call_data);
+	static void OBSActivation(void *data, calldata_t *call_data);
+	static void ActivityAudioCaptured(void *param, obs_source_t *source,
+					  const struct audio_data *audio_data,
+					  bool muted);
+	void AttachActivityProbe(obs_source_t *s);
+	void DetachActivityProbe();
+	uint64_t LastActivity();
+	void BeginSwitchMeasure(uint64_t start);
+	void EndSwitchMeasure();
+	void CancelRestart();
+	void SetStandbyDevice(const QString &deviceId);
+	void UpdateStandbyButton();
+	void ShowStandbyMenu(const QPoint &pos);
+	void ShowFallbackMenu(const QPoint &pos);
+	void SetFallbacks(const std::vector<std::string> &devices);
+	bool HealthMonitored() const;
+	void UpdateHealthMonitor();
+	void ResetFailover(const std::string &device);
+	void SelectDevice(const QString &device);
+	void ApplyDevice(const std::string &device);
+	// Lists the devices on the task queue, the result arrives as a
+	// RowPresence event in PrimaryListed.
+	void CheckPrimaryListed();
+	static void ListPrimaryDevice(void *param);
+	void PrimaryListed(bool listed);
+	bool StepFailover(uint64_t ts);
+	void ReturnToPrimary(uint64_t ts);
+	void UpdateHealthLabel();
+	void ApplySettings(obs_source_t *s, obs_data_t *settings);
+	void UpdateActivation();
+	void UpdateSummary();
+	void ConnectSignals(obs_source_t *s);
+	void DisconnectSignals(obs_source_t *s);
+	void Bind(obs_source_t *s);
+	void Unbind();
+	void SetBus();
+	void UpdateSwitchTooltip();
+	void PostUpdate();
+	void ApplyPendingUpdate();
+	void SetOutputVolume(double volume);
+	void SetMute(bool muted);
+	void SetupCompact(obs_source_t *source, obs_property_t *prop,
+			  config_t *sc);
+	QString DeviceName(obs_source_t *s, const std::string &device);
+	void ShowCompactDevices();
+	void ShowCompactMenu(const QPoint &pos);
+
+	friend class DeviceSwitcherDock;
+	friend class DeviceScheduler;
+	friend class DockBenchmark;
 
 private slots:
 	void SliderChanged(int vol);
-	void SetOutputVolume(double volume);
-	void SetMute(bool muted);
+	void CheckSwitchMeasure();
+	void CheckRestart();
 
 public:
 	DeviceWidget(obs_source_t *source, obs_property_t *device_prop,
 		     config_t *show_config, DeviceSwitcherDock *parent);
 
 	~DeviceWidget();
+
+	void Restart();
+	void FailOver();
+	void FailBack();
+	void CheckHealth(uint64_t ts);
+	// Publishes the device the source is saved with to the retain
+	// store, whenever the standby or fallback state changes.
+	void PublishSaveDevice();
+
+protected:
+	void mousePressEvent(QMouseEvent *event) override;
+	void mouseMoveEvent(QMouseEvent *event) override;
+	void mouseReleaseEvent(QMouseEvent *event) override;
+	void contextMenuEvent(QContextMenuEvent *event) override;
+	void paintEvent(QPaintEvent *event) override;
 };
 
 class SliderIgnoreScroll : public QSlider {
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Bounded multi-producer, single-consumer queue. Producers never block and
+// never allocate while there is room in the ring. When the ring is full
+// items go to a locked overflow list, and keep going there until the
+// consumer has drained it. The consumer only takes from the overflow list
+// once every claimed ring cell has been consumed, so the order per
+// producer is kept.
+template<typename T, size_t Capacity> class MpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0,
+		      "Capacity must be a power of two");
+
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	Cell cells[Capacity];
+	alignas(64) std::atomic<size_t> enqueuePos{0};
+	alignas(64) size_t dequeuePos = 0;
+	std::atomic<size_t> depth{0};
+
+	std::mutex overflowMutex;
+	std::deque<T> overflow;
+	std::atomic<bool> overflowing{false};
+
+	void PushOverflow(T &&item)
+	{
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		overflow.push_back(std::move(item));
+		overflowing.store(true, std::memory_order_release);
+		depth.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Moves item into the ring, false when the ring is full.
+	bool PushRing(T &item)
+	{
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell &cell = cells[pos & (Capacity - 1)];
+			const size_t seq =
+				cell.sequence.load(std::memory_order_acquire);
+			const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (enqueuePos.compare_exchange_weak(
+					    pos, pos + 1,
+					    std::memory_order_relaxed)) {
+					cell.data = std::move(item);
+					cell.sequence.store(
+						pos + 1,
+						std::memory_order_release);
+					depth.fetch_add(
+						1, std::memory_order_relaxed);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = enqueuePos.load(
+					std::memory_order_relaxed);
+			}
+		}
+	}
+
+public:
+	MpscQueue()
+	{
+		for (size_t i = 0; i < Capacity; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MpscQueue(const MpscQueue &) = delete;
+	MpscQueue &operator=(const MpscQueue &) = delete;
+
+	void Push(T item)
+	{
+		if (overflowing.load(std::memory_order_acquire) ||
+		    !PushRing(item))
+			PushOverflow(std::move(item));
+	}
+
+	// Like Push, but drops the item instead of taking the overflow lock
+	// when the ring is full, for producers that must never block.
+	bool TryPush(T &item)
+	{
+		if (overflowing.load(std::memory_order_acquire))
+			return false;
+		return PushRing(item);
+	}
+
+	// Only call from the single consumer.
+	bool Pop(T &item)
+	{
+		Cell &cell = cells[dequeuePos & (Capacity - 1)];
+		const size_t seq = cell.sequence.load(std::memory_order_acquire);
+		if (seq == dequeuePos + 1) {
+			item = std::move(cell.data);
+			cell.sequence.store(dequeuePos + Capacity,
+					    std::memory_order_release);
+			dequeuePos++;
+			depth.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		if (!overflowing.load(std::memory_order_acquire))
+			return false;
+
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		// A ring cell claimed but not yet published holds an item pushed
+		// before anything in the overflow list by the same producer, wait
+		// for it. Producers advance enqueuePos before they take the lock.
+		if (enqueuePos.load(std::memory_order_relaxed) != dequeuePos)
+			return false;
+		if (overflow.empty()) {
+			overflowing.store(false, std::memory_order_release);
+			return false;
+		}
+		item = std::move(overflow.front());
+		overflow.pop_front();
+		if (overflow.empty())
+			overflowing.store(false, std::memory_order_release);
+		depth.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	size_t Depth() const { return depth.load(std::memory_order_relaxed); }
+};
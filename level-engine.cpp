@@ -0,0 +1,306 @@
+#include "level-engine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "media-io/audio-math.h"
+#include "util/platform.h"
+#include "util/sse-intrin.h"
+#include "plugin-stats.hpp"
+#include "trace.hpp"
+
+LevelEngine levelEngine;
+
+// Catmull-Rom weights of x[n - 1], x[n], x[n + 1] and x[n + 2] for the
+// points at n, n + 0.25, n + 0.5 and n + 0.75, one phase per lane.
+alignas(16) static const float truePeakTaps[4][4] = {
+	{0.0f, -0.0703125f, -0.0625f, -0.0234375f},
+	{1.0f, 0.8671875f, 0.5625f, 0.2265625f},
+	{0.0f, 0.2265625f, 0.5625f, 0.8671875f},
+	{0.0f, -0.0234375f, -0.0625f, -0.0703125f},
+};
+
+static inline __m128 abs_ps(__m128 v)
+{
+	return _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+}
+
+static inline float hmax_ps(__m128 v)
+{
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, v);
+	return std::max(std::max(lanes[0], lanes[1]),
+			std::max(lanes[2], lanes[3]));
+}
+
+static inline float hsum_ps(__m128 v)
+{
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, v);
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// Sample peak and sum of squares of a block in one pass.
+static void level_kernel(const float *in, uint32_t frames, float *peak,
+			 double *squares)
+{
+	__m128 maxv = _mm_setzero_ps();
+	__m128 sum = _mm_setzero_ps();
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		const __m128 v = _mm_loadu_ps(in + i);
+		maxv = _mm_max_ps(maxv, abs_ps(v));
+		sum = _mm_add_ps(sum, _mm_mul_ps(v, v));
+	}
+	float max = hmax_ps(maxv);
+	float total = hsum_ps(sum);
+	for (; i < frames; i++) {
+		max = std::max(max, fabsf(in[i]));
+		total += in[i] * in[i];
+	}
+	*peak = std::max(*peak, max);
+	*squares += total;
+}
+
+static inline __m128 true_peak_point(float a, float b, float c, float d)
+{
+	__m128 v = _mm_mul_ps(_mm_set1_ps(a), _mm_load_ps(truePeakTaps[0]));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(b),
+				     _mm_load_ps(truePeakTaps[1])));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(c),
+				     _mm_load_ps(truePeakTaps[2])));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(d),
+				     _mm_load_ps(truePeakTaps[3])));
+	return abs_ps(v);
+}
+
+// 4x oversampled peak of a block, the last three samples of the previous
+// block are kept in history so the interpolation runs across blocks.
+static void true_peak_kernel(const float *in, uint32_t frames, float *history,
+			     float *peak)
+{
+	if (frames < 3) {
+		for (uint32_t i = 0; i < frames; i++)
+			*peak = std::max(*peak, fabsf(in[i]));
+		return;
+	}
+	const float head[6] = {history[0], history[1], history[2],
+			       in[0],      in[1],      in[2]};
+	__m128 maxv = true_peak_point(head[0], head[1], head[2], head[3]);
+	maxv = _mm_max_ps(maxv, true_peak_point(head[1], head[2], head[3],
+						head[4]));
+	maxv = _mm_max_ps(maxv, true_peak_point(head[2], head[3], head[4],
+						head[5]));
+	for (uint32_t i = 1; i + 2 < frames; i++)
+		maxv = _mm_max_ps(maxv, true_peak_point(in[i - 1], in[i],
+							in[i + 1], in[i + 2]));
+	// The points after the second to last sample are interpolated
+	// together with the next block.
+	*peak = std::max(*peak, hmax_ps(maxv));
+	history[0] = in[frames - 3];
+	history[1] = in[frames - 2];
+	history[2] = in[frames - 1];
+}
+
+void LevelEngine::AudioCaptured(void *param, obs_source_t *source,
+				const struct audio_data *audio_data,
+				bool muted)
+{
+	ProfileScope scope("LevelEngine::AudioCaptured",
+			   &pluginStats.levelEngine);
+	auto slot = static_cast<LevelSlot *>(param);
+	const int channels = std::min(
+		(int)audio_output_get_channels(obs_get_audio()),
+		MAX_AUDIO_CHANNELS);
+	const bool truePeak = slot->truePeak.load(std::memory_order_relaxed);
+	for (int ch = 0; ch < channels; ch++) {
+		const auto in = (const float *)audio_data->data[ch];
+		if (!in)
+			continue;
+		level_kernel(in, audio_data->frames, &slot->accPeak[ch],
+			     &slot->accSquares[ch]);
+		if (truePeak)
+			true_peak_kernel(in, audio_data->frames,
+					 slot->history[ch], &slot->accPeak[ch]);
+	}
+	slot->accFrames += audio_data->frames;
+	if (slot->accFrames < audio_output_get_sample_rate(obs_get_audio()) / 20)
+		return;
+	Publish(slot, channels, muted ? 0.0f : obs_source_get_volume(source));
+}
+
+void LevelEngine::Publish(LevelSlot *slot, int channels, float mul)
+{
+	const uint32_t seq = slot->sequence.load(std::memory_order_relaxed);
+	slot->sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (int ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+		float magnitude = -INFINITY;
+		float peak = -INFINITY;
+		float inputPeak = -INFINITY;
+		if (ch < channels) {
+			const float rms = (float)sqrt(slot->accSquares[ch] /
+						      slot->accFrames);
+			magnitude = mul_to_db(rms * mul);
+			peak = mul_to_db(slot->accPeak[ch] * mul);
+			inputPeak = mul_to_db(slot->accPeak[ch]);
+		}
+		slot->magnitude[ch].store(magnitude, std::memory_order_relaxed);
+		slot->peak[ch].store(peak, std::memory_order_relaxed);
+		slot->inputPeak[ch].store(inputPeak, std::memory_order_relaxed);
+		slot->accPeak[ch] = 0.0f;
+		slot->accSquares[ch] = 0.0;
+	}
+	slot->accFrames = 0;
+	slot->channels.store(channels, std::memory_order_relaxed);
+	slot->updated.store(os_gettime_ns(), std::memory_order_relaxed);
+	slot->sequence.store(seq + 2, std::memory_order_release);
+}
+
+int LevelEngine::Attach(obs_source_t *source)
+{
+	int free = -1;
+	for (int i = 0; i < LEVEL_ENGINE_SLOTS; i++) {
+		if (slots[i].refs &&
+		    obs_weak_source_references_source(slots[i].source,
+						      source)) {
+			slots[i].refs++;
+			return i;
+		}
+		if (!slots[i].refs && free < 0)
+			free = i;
+	}
+	if (free < 0)
+		return -1;
+	LevelSlot &slot = slots[free];
+	slot.source = obs_source_get_weak_source(source);
+	slot.refs = 1;
+	slot.accFrames = 0;
+	for (int ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+		slot.accPeak[ch] = 0.0f;
+		slot.accSquares[ch] = 0.0;
+		slot.history[ch][0] = slot.history[ch][1] =
+			slot.history[ch][2] = 0.0f;
+	}
+	slot.channels.store(0, std::memory_order_relaxed);
+	slot.updated.store(0, std::memory_order_relaxed);
+	obs_source_add_audio_capture_callback(source, AudioCaptured, &slot);
+	return free;
+}
+
+void LevelEngine::Detach(int slot)
+{
+	if (slot < 0 || slot >= LEVEL_ENGINE_SLOTS || !slots[slot].refs)
+		return;
+	if (--slots[slot].refs)
+		return;
+	// Returns once a running callback finished, so the slot is free. A
+	// destroyed source took its callbacks with it.
+	if (auto source = obs_weak_source_get_source(slots[slot].source)) {
+		obs_source_remove_audio_capture_callback(
+			source, AudioCaptured, &slots[slot]);
+		obs_source_release(source);
+	}
+	obs_weak_source_release(slots[slot].source);
+	slots[slot].source = nullptr;
+}
+
+void LevelEngine::SetTruePeak(int slot, bool truePeak)
+{
+	if (slot >= 0 && slot < LEVEL_ENGINE_SLOTS)
+		slots[slot].truePeak.store(truePeak, std::memory_order_relaxed);
+}
+
+bool LevelEngine::Read(int index, LevelReading &reading) const
+{
+	if (index < 0 || index >= LEVEL_ENGINE_SLOTS)
+		return false;
+	const LevelSlot &slot = slots[index];
+	for (;;) {
+		const uint32_t seq =
+			slot.sequence.load(std::memory_order_acquire);
+		if (seq & 1)
+			continue;
+		const uint64_t updated =
+			slot.updated.load(std::memory_order_relaxed);
+		if (updated == reading.updated)
+			return false;
+		reading.channels = slot.channels.load(std::memory_order_relaxed);
+		for (int ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+			reading.magnitude[ch] = slot.magnitude[ch].load(
+				std::memory_order_relaxed);
+			reading.peak[ch] =
+				slot.peak[ch].load(std::memory_order_relaxed);
+			reading.inputPeak[ch] = slot.inputPeak[ch].load(
+				std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != seq)
+			continue;
+		reading.updated = updated;
+		return true;
+	}
+}
+
+int LevelEngine::Channels(int slot) const
+{
+	if (slot < 0 || slot >= LEVEL_ENGINE_SLOTS)
+		return 0;
+	return slots[slot].channels.load(std::memory_order_relaxed);
+}
+
+void LevelEngine::Benchmark(uint64_t blocks, uint64_t &scalar, uint64_t &simd,
+			    uint64_t &simdTruePeak)
+{
+	const uint32_t frames = AUDIO_OUTPUT_FRAMES;
+	const int channels = 8;
+	std::vector<float> buffer(frames * channels);
+	for (size_t i = 0; i < buffer.size(); i++)
+		buffer[i] = sinf((float)i * 0.01f) * 0.5f;
+	volatile float sink = 0.0f;
+	scalar = simd = simdTruePeak = 0;
+	if (!blocks)
+		return;
+
+	uint64_t start = os_gettime_ns();
+	for (uint64_t b = 0; b < blocks; b++) {
+		for (int ch = 0; ch < channels; ch++) {
+			const float *in = buffer.data() + ch * frames;
+			float peak = 0.0f;
+			float squares = 0.0f;
+			for (uint32_t i = 0; i < frames; i++) {
+				peak = std::max(peak, fabsf(in[i]));
+				squares += in[i] * in[i];
+			}
+			sink = sink + peak + squares;
+		}
+	}
+	scalar = (os_gettime_ns() - start) / blocks;
+
+	start = os_gettime_ns();
+	for (uint64_t b = 0; b < blocks; b++) {
+		for (int ch = 0; ch < channels; ch++) {
+			float peak = 0.0f;
+			double squares = 0.0;
+			level_kernel(buffer.data() + ch * frames, frames, &peak,
+				     &squares);
+			sink = sink + peak + (float)squares;
+		}
+	}
+	simd = (os_gettime_ns() - start) / blocks;
+
+	float history[channels][3] = {};
+	start = os_gettime_ns();
+	for (uint64_t b = 0; b < blocks; b++) {
+		for (int ch = 0; ch < channels; ch++) {
+			const float *in = buffer.data() + ch * frames;
+			float peak = 0.0f;
+			double squares = 0.0;
+			level_kernel(in, frames, &peak, &squares);
+			true_peak_kernel(in, frames, history[ch], &peak);
+			sink = sink + peak + (float)squares;
+		}
+	}
+	simdTruePeak = (os_gettime_ns() - start) / blocks;
+}
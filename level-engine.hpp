@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "obs.h"
+
+#define LEVEL_ENGINE_SLOTS 256
+
+// Levels of one channel set as published to the meters, in dB.
+struct LevelReading {
+	int channels = 0;
+	uint64_t updated = 0;
+	float magnitude[MAX_AUDIO_CHANNELS];
+	float peak[MAX_AUDIO_CHANNELS];
+	float inputPeak[MAX_AUDIO_CHANNELS];
+};
+
+// One row of the shared level table. The audio thread of the source
+// accumulates a block at a time and publishes every 50 ms, the sequence
+// is odd while a publish is in progress so readers retry.
+struct LevelSlot {
+	std::atomic<uint32_t> sequence{0};
+	std::atomic<uint64_t> updated{0};
+	std::atomic<int> channels{0};
+	std::atomic<float> magnitude[MAX_AUDIO_CHANNELS];
+	std::atomic<float> peak[MAX_AUDIO_CHANNELS];
+	std::atomic<float> inputPeak[MAX_AUDIO_CHANNELS];
+	std::atomic<bool> truePeak{false};
+
+	// Owned by the attaching UI thread.
+	obs_weak_source_t *source = nullptr;
+	int refs = 0;
+
+	// Owned by the audio thread.
+	float accPeak[MAX_AUDIO_CHANNELS] = {};
+	double accSquares[MAX_AUDIO_CHANNELS] = {};
+	uint32_t accFrames = 0;
+	float history[MAX_AUDIO_CHANNELS][3] = {};
+};
+
+// Meters all sources from their audio capture callbacks into one table,
+// instead of an obs_volmeter with its own callback per meter. Sample peak,
+// RMS and the optional 4x oversampled true peak are computed with SSE in
+// a single pass over each block. Attach and Detach run on the UI thread,
+// readers poll the table from the meter timer.
+class LevelEngine {
+	LevelSlot slots[LEVEL_ENGINE_SLOTS];
+	bool enabled = false;
+
+	static void AudioCaptured(void *param, obs_source_t *source,
+				  const struct audio_data *audio_data,
+				  bool muted);
+	static void Publish(LevelSlot *slot, int channels, float mul);
+
+public:
+	bool Enabled() const { return enabled; }
+	void SetEnabled(bool enable) { enabled = enable; }
+
+	// Returns the slot of the source, or -1 when the table is full.
+	int Attach(obs_source_t *source);
+	void Detach(int slot);
+	void SetTruePeak(int slot, bool truePeak);
+	// Copies the levels when they changed since updated.
+	bool Read(int slot, LevelReading &reading) const;
+	int Channels(int slot) const;
+
+	// Times the block kernels against a plain scalar peak and RMS loop,
+	// returns ns per block for each. obs_volmeter is not part of it.
+	static void Benchmark(uint64_t blocks, uint64_t &scalar,
+			      uint64_t &simd, uint64_t &simdTruePeak);
+};
+
+extern LevelEngine levelEngine;
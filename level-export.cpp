@@ -0,0 +1,198 @@
+#include "level-export.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "util/platform.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+LevelExport levelExport;
+
+LevelExport::~LevelExport()
+{
+	Close();
+}
+
+#ifndef _WIN32
+
+bool LevelExport::Open()
+{
+	if (header)
+		return true;
+	// Never take over a segment another instance still writes, or one a
+	// crashed instance left behind, fall back to a name of our own.
+	shmName = LEVEL_EXPORT_NAME;
+	int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 && errno == EEXIST) {
+		shmName += "-" + std::to_string(getpid());
+		blog(LOG_WARNING,
+		     "[Device Switcher] level export %s exists, using %s",
+		     LEVEL_EXPORT_NAME, shmName.c_str());
+		fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (fd < 0) {
+		blog(LOG_WARNING,
+		     "[Device Switcher] failed to open level export %s",
+		     shmName.c_str());
+		return false;
+	}
+	void *memory = MAP_FAILED;
+	if (ftruncate(fd, (off_t)LEVEL_EXPORT_SIZE) == 0)
+		memory = mmap(nullptr, LEVEL_EXPORT_SIZE,
+			      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED) {
+		blog(LOG_WARNING,
+		     "[Device Switcher] failed to map level export %s",
+		     shmName.c_str());
+		shm_unlink(shmName.c_str());
+		return false;
+	}
+	memset(memory, 0, LEVEL_EXPORT_SIZE);
+	header = static_cast<level_export_header *>(memory);
+	header->version = LEVEL_EXPORT_VERSION;
+	header->header_size = sizeof(level_export_header);
+	header->entry_size = sizeof(level_export_entry);
+	header->capacity = LEVEL_EXPORT_CAPACITY;
+	header->channels = LEVEL_EXPORT_CHANNELS;
+	header->started = os_gettime_ns();
+	entries = level_export_entries(header);
+	// Readers only trust the layout once the magic is there.
+	__atomic_store_n(&header->magic, LEVEL_EXPORT_MAGIC, __ATOMIC_RELEASE);
+	blog(LOG_INFO, "[Device Switcher] exporting levels to %s",
+	     shmName.c_str());
+	return true;
+}
+
+void LevelExport::Close()
+{
+	if (!header)
+		return;
+	__atomic_store_n(&header->magic, 0u, __ATOMIC_RELEASE);
+	munmap(header, LEVEL_EXPORT_SIZE);
+	shm_unlink(shmName.c_str());
+	header = nullptr;
+	entries = nullptr;
+}
+
+// The only writer of the entry makes the sequence odd for the readers.
+static inline void begin_write(level_export_entry *entry)
+{
+	const uint32_t seq =
+		__atomic_load_n(&entry->sequence, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->sequence, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void end_write(level_export_entry *entry)
+{
+	const uint32_t seq =
+		__atomic_load_n(&entry->sequence, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->sequence, seq + 1, __ATOMIC_RELEASE);
+}
+
+#else
+
+bool LevelExport::Open()
+{
+	blog(LOG_WARNING,
+	     "[Device Switcher] level export is not available on Windows");
+	return false;
+}
+
+void LevelExport::Close() {}
+
+static inline void begin_write(level_export_entry *) {}
+static inline void end_write(level_export_entry *) {}
+
+#endif
+
+void LevelExport::SetName(level_export_entry *entry, const char *name)
+{
+	begin_write(entry);
+	strncpy(entry->name, name ? name : "", LEVEL_EXPORT_NAME_SIZE - 1);
+	entry->name[LEVEL_EXPORT_NAME_SIZE - 1] = 0;
+	entry->channels = 0;
+	entry->updated = 0;
+	end_write(entry);
+}
+
+void LevelExport::DropRename(int entry)
+{
+	std::lock_guard<std::mutex> lock(renames[entry].mutex);
+	renames[entry].pending = false;
+}
+
+int LevelExport::Attach(const char *name)
+{
+	if (!entries)
+		return -1;
+	for (int i = 0; i < LEVEL_EXPORT_CAPACITY; i++) {
+		if (used[i])
+			continue;
+		used[i] = true;
+		DropRename(i);
+		SetName(&entries[i], name);
+		return i;
+	}
+	return -1;
+}
+
+// The meter stopped writing before it detaches.
+void LevelExport::Detach(int entry)
+{
+	if (!entries || entry < 0 || entry >= LEVEL_EXPORT_CAPACITY)
+		return;
+	DropRename(entry);
+	SetName(&entries[entry], nullptr);
+	used[entry] = false;
+}
+
+void LevelExport::Rename(int entry, const char *name)
+{
+	if (!entries || entry < 0 || entry >= LEVEL_EXPORT_CAPACITY ||
+	    !used[entry])
+		return;
+	PendingName &rename = renames[entry];
+	std::lock_guard<std::mutex> lock(rename.mutex);
+	strncpy(rename.name, name ? name : "", LEVEL_EXPORT_NAME_SIZE - 1);
+	rename.name[LEVEL_EXPORT_NAME_SIZE - 1] = 0;
+	rename.pending = true;
+}
+
+void LevelExport::Write(int index, const float magnitude[MAX_AUDIO_CHANNELS],
+			const float peak[MAX_AUDIO_CHANNELS],
+			const float inputPeak[MAX_AUDIO_CHANNELS])
+{
+	if (!entries || index < 0 || index >= LEVEL_EXPORT_CAPACITY)
+		return;
+	level_export_entry *entry = &entries[index];
+	const int channels = std::min(
+		{(int)audio_output_get_channels(obs_get_audio()),
+		 MAX_AUDIO_CHANNELS, LEVEL_EXPORT_CHANNELS});
+	begin_write(entry);
+	// A rename being posted right now waits for the next levels.
+	PendingName &rename = renames[index];
+	if (rename.pending && rename.mutex.try_lock()) {
+		if (rename.pending)
+			memcpy(entry->name, rename.name, LEVEL_EXPORT_NAME_SIZE);
+		rename.pending = false;
+		rename.mutex.unlock();
+	}
+	entry->channels = (uint32_t)channels;
+	entry->updated = os_gettime_ns();
+	for (int ch = 0; ch < LEVEL_EXPORT_CHANNELS; ch++) {
+		const bool valid = ch < channels;
+		entry->magnitude[ch] = valid ? magnitude[ch] : -INFINITY;
+		entry->peak[ch] = valid ? peak[ch] : -INFINITY;
+		entry->input_peak[ch] = valid ? inputPeak[ch] : -INFINITY;
+	}
+	end_write(entry);
+}
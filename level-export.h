@@ -0,0 +1,78 @@
+#pragma once
+
+/* Layout of the shared memory segment the dock exports its meter levels
+ * to, shared with external readers. The segment starts with the header,
+ * followed by capacity entries of entry_size bytes. Readers must check
+ * magic, version and entry_size before using an entry.
+ *
+ * The sequence of an entry is odd while the entry is written, a reader
+ * copies the entry and retries when the sequence was odd or changed
+ * meanwhile, see level_export_read. Levels are in dB,
+ * timestamps are monotonic nanoseconds of the writing process. A free
+ * entry has an empty name.
+ *
+ * When LEVEL_EXPORT_NAME already exists, because another instance exports
+ * or a crashed one left it behind, the dock exports to
+ * LEVEL_EXPORT_NAME "-<pid>" instead and logs the name. */
+
+#include <stdint.h>
+#include <string.h>
+
+#define LEVEL_EXPORT_NAME "/obs-device-switcher-levels"
+#define LEVEL_EXPORT_MAGIC 0x4c565344u /* "DSVL" */
+#define LEVEL_EXPORT_VERSION 1
+#define LEVEL_EXPORT_CAPACITY 256
+#define LEVEL_EXPORT_CHANNELS 8
+#define LEVEL_EXPORT_NAME_SIZE 64
+
+struct level_export_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t entry_size;
+	uint32_t capacity;
+	uint32_t channels;
+	uint64_t started;
+};
+
+struct level_export_entry {
+	uint32_t sequence;
+	uint32_t channels;
+	uint64_t updated;
+	char name[LEVEL_EXPORT_NAME_SIZE];
+	float magnitude[LEVEL_EXPORT_CHANNELS];
+	float peak[LEVEL_EXPORT_CHANNELS];
+	float input_peak[LEVEL_EXPORT_CHANNELS];
+};
+
+#define LEVEL_EXPORT_SIZE                         \
+	(sizeof(struct level_export_header) +     \
+	 LEVEL_EXPORT_CAPACITY * sizeof(struct level_export_entry))
+
+static inline struct level_export_entry *
+level_export_entries(struct level_export_header *header)
+{
+	return (struct level_export_entry *)((uint8_t *)header +
+					     header->header_size);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+/* Copies a consistent snapshot of entry, returns 0 when the writer kept
+ * changing it. */
+static inline int level_export_read(const struct level_export_entry *entry,
+				    struct level_export_entry *out)
+{
+	for (int tries = 0; tries < 100; tries++) {
+		const uint32_t before =
+			__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+		if (before & 1)
+			continue;
+		memcpy(out, entry, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&entry->sequence, __ATOMIC_RELAXED) ==
+		    before)
+			return 1;
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+#include "obs.h"
+#include "level-export.h"
+
+// Publishes the levels of the meters in a POSIX shared memory segment, so
+// external tools read them at meter rate without attaching volmeters of
+// their own. Open, Close, Attach and Rename run on the UI thread, Write
+// runs wherever the levels of the meter arrive and never allocates or
+// waits. An entry has one writer at a time: the UI thread on attach and
+// detach, while no meter writes it, and the meter in between. Renames are
+// posted to the meter and land with its next levels. Not available on
+// Windows.
+class LevelExport {
+	struct PendingName {
+		std::mutex mutex;
+		std::atomic<bool> pending{false};
+		char name[LEVEL_EXPORT_NAME_SIZE] = {};
+	};
+
+	std::string shmName;
+	level_export_header *header = nullptr;
+	level_export_entry *entries = nullptr;
+	bool used[LEVEL_EXPORT_CAPACITY] = {};
+	PendingName renames[LEVEL_EXPORT_CAPACITY];
+
+	static void SetName(level_export_entry *entry, const char *name);
+	void DropRename(int entry);
+
+public:
+	~LevelExport();
+
+	bool Open();
+	void Close();
+	bool Active() const { return header != nullptr; }
+
+	// Returns the entry of a meter, -1 when full or not open.
+	int Attach(const char *name);
+	void Detach(int entry);
+	void Rename(int entry, const char *name);
+	void Write(int entry, const float magnitude[MAX_AUDIO_CHANNELS],
+		   const float peak[MAX_AUDIO_CHANNELS],
+		   const float inputPeak[MAX_AUDIO_CHANNELS]);
+};
+
+extern LevelExport levelExport;
@@ -0,0 +1,176 @@
+#include "level-history.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "plugin-stats.hpp"
+
+// 0 dB and above encode as 255, -127.5 dB and below as 0.
+#define HISTORY_FLOOR_DB -127.5f
+
+LevelHistory::LevelHistory(int channels_)
+	: channels(std::clamp(channels_, 1, MAX_AUDIO_CHANNELS)),
+	  peaks((size_t)Length * channels, 0),
+	  magnitudes((size_t)Length * channels, 0)
+{
+	for (int ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+		pendingPeak[ch] = -INFINITY;
+		pendingMagnitude[ch] = -INFINITY;
+	}
+}
+
+uint8_t LevelHistory::Encode(float db)
+{
+	if (!(db > HISTORY_FLOOR_DB))
+		return 0;
+	return (uint8_t)std::min(lroundf((db - HISTORY_FLOOR_DB) * 2.0f), 255L);
+}
+
+float LevelHistory::Decode(uint8_t code)
+{
+	return code ? HISTORY_FLOOR_DB + code * 0.5f : -INFINITY;
+}
+
+void LevelHistory::Commit()
+{
+	uint8_t *peak = &peaks[(size_t)head * channels];
+	uint8_t *magnitude = &magnitudes[(size_t)head * channels];
+	for (int ch = 0; ch < channels; ch++) {
+		peak[ch] = Encode(pendingPeak[ch]);
+		magnitude[ch] = Encode(pendingMagnitude[ch]);
+		pendingPeak[ch] = -INFINITY;
+		pendingMagnitude[ch] = -INFINITY;
+	}
+	head = (head + 1) % Length;
+	count = std::min(count + 1, Length);
+	version++;
+}
+
+void LevelHistory::Advance(uint64_t ts)
+{
+	if (!periodStart) {
+		periodStart = ts;
+		return;
+	}
+	if (ts < periodStart + Period)
+		return;
+	const uint64_t periods = (ts - periodStart) / Period;
+	// More than the whole ring of silence only needs one pass.
+	const uint64_t commits = std::min(periods, (uint64_t)Length);
+	for (uint64_t i = 0; i < commits; i++)
+		Commit();
+	periodStart += periods * Period;
+}
+
+void LevelHistory::Add(uint64_t ts, const float *magnitude, const float *peak)
+{
+	Advance(ts);
+	for (int ch = 0; ch < channels; ch++) {
+		pendingPeak[ch] = std::max(pendingPeak[ch], peak[ch]);
+		pendingMagnitude[ch] =
+			std::max(pendingMagnitude[ch], magnitude[ch]);
+	}
+}
+
+uint8_t LevelHistory::Peak(int age, int channel) const
+{
+	if (age < 0 || age >= count || channel < 0 || channel >= channels)
+		return 0;
+	const int index = (head - 1 - age + Length) % Length;
+	return peaks[(size_t)index * channels + channel];
+}
+
+uint8_t LevelHistory::Magnitude(int age, int channel) const
+{
+	if (age < 0 || age >= count || channel < 0 || channel >= channels)
+		return 0;
+	const int index = (head - 1 - age + Length) % Length;
+	return magnitudes[(size_t)index * channels + channel];
+}
+
+uint8_t LevelHistory::MaxPeak(int age) const
+{
+	uint8_t max = 0;
+	for (int ch = 0; ch < channels; ch++)
+		max = std::max(max, Peak(age, ch));
+	return max;
+}
+
+int LevelHistory::Clips(int ages, float level) const
+{
+	const uint8_t clip = Encode(level);
+	int clips = 0;
+	for (int age = 0; age < std::min(ages, count); age++) {
+		if (MaxPeak(age) >= clip)
+			clips++;
+	}
+	return clips;
+}
+
+int LevelHistory::LastClip(float level) const
+{
+	const uint8_t clip = Encode(level);
+	for (int age = 0; age < count; age++) {
+		if (MaxPeak(age) >= clip)
+			return age;
+	}
+	return -1;
+}
+
+LevelRecorder::LevelRecorder()
+	: history((int)audio_output_get_channels(obs_get_audio()))
+{
+}
+
+LevelRecorder::~LevelRecorder()
+{
+	levelEngine.Detach(levelSlot);
+	if (!volmeter)
+		return;
+	obs_volmeter_remove_callback(volmeter, Levels, this);
+	obs_volmeter_destroy(volmeter);
+	pluginStats.volmeters--;
+}
+
+void LevelRecorder::SetSource(obs_source_t *source)
+{
+	levelEngine.Detach(levelSlot);
+	levelSlot = -1;
+	levelReading.updated = 0;
+	if (source && levelEngine.Enabled())
+		levelSlot = levelEngine.Attach(source);
+	if (!source || levelSlot >= 0) {
+		if (volmeter)
+			obs_volmeter_detach_source(volmeter);
+		return;
+	}
+
+	// The engine is off or its table is full.
+	if (!volmeter) {
+		volmeter = obs_volmeter_create(OBS_FADER_LOG);
+		pluginStats.volmeters++;
+		obs_volmeter_add_callback(volmeter, Levels, this);
+	}
+	obs_volmeter_attach_source(volmeter, source);
+}
+
+void LevelRecorder::Poll()
+{
+	if (!levelEngine.Read(levelSlot, levelReading))
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	history.Add(levelReading.updated, levelReading.magnitude,
+		    outputPeak ? levelReading.peak : levelReading.inputPeak);
+}
+
+void LevelRecorder::Levels(void *param,
+			   const float magnitude[MAX_AUDIO_CHANNELS],
+			   const float peak[MAX_AUDIO_CHANNELS],
+			   const float inputPeak[MAX_AUDIO_CHANNELS])
+{
+	auto recorder = static_cast<LevelRecorder *>(param);
+	const uint64_t ts = os_gettime_ns();
+	std::lock_guard<std::mutex> lock(recorder->mutex);
+	recorder->history.Add(ts, magnitude,
+			      recorder->outputPeak ? peak : inputPeak);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include "obs.h"
+#include "level-engine.hpp"
+#include "util/platform.h"
+
+// The last ten minutes of a meter at 10 Hz: the highest peak and
+// magnitude of every channel per 100 ms, quantized to 0.5 dB steps in a
+// byte. A source takes Length * channels * 2 bytes, 24 KB in stereo and
+// 96 KB at 7.1, allocated once.
+class LevelHistory {
+public:
+	static constexpr int Rate = 10;
+	static constexpr int Length = 600 * Rate;
+	static constexpr uint64_t Period = 1000000000ULL / Rate;
+
+private:
+	int channels;
+	std::vector<uint8_t> peaks;
+	std::vector<uint8_t> magnitudes;
+	int head = 0;
+	int count = 0;
+	uint64_t version = 0;
+	uint64_t periodStart = 0;
+	float pendingPeak[MAX_AUDIO_CHANNELS];
+	float pendingMagnitude[MAX_AUDIO_CHANNELS];
+
+	void Commit();
+
+public:
+	explicit LevelHistory(int channels);
+
+	static uint8_t Encode(float db);
+	static float Decode(uint8_t code);
+
+	// Folds levels in dB into the current period.
+	void Add(uint64_t ts, const float *magnitude, const float *peak);
+	// Closes the periods that ended before ts, silent ones included.
+	void Advance(uint64_t ts);
+
+	int Channels() const { return channels; }
+	int Count() const { return count; }
+	// Changes whenever a period is closed.
+	uint64_t Version() const { return version; }
+	// Age 0 is the newest closed period.
+	uint8_t Peak(int age, int channel) const;
+	uint8_t Magnitude(int age, int channel) const;
+	// Highest peak of all channels.
+	uint8_t MaxPeak(int age) const;
+	// Periods with a peak at or above level within the newest ages.
+	int Clips(int ages, float level) const;
+	// Age of the newest period with a clip, -1 if there is none.
+	int LastClip(float level) const;
+};
+
+// Feeds a LevelHistory from the level engine when it is enabled, else from
+// a volmeter of its own, so the history belongs to the row instead of its
+// meter: meters dropped on collapse or rebind and created again show the
+// same ten minutes. Levels are added under the mutex, from the meter timer
+// or the audio thread, readers hold it only while copying.
+class LevelRecorder {
+	obs_volmeter_t *volmeter = nullptr;
+	int levelSlot = -1;
+	LevelReading levelReading;
+	std::mutex mutex;
+	LevelHistory history;
+	std::atomic<bool> outputPeak{false};
+
+	static void Levels(void *param,
+			   const float magnitude[MAX_AUDIO_CHANNELS],
+			   const float peak[MAX_AUDIO_CHANNELS],
+			   const float inputPeak[MAX_AUDIO_CHANNELS]);
+
+public:
+	LevelRecorder();
+	~LevelRecorder();
+
+	LevelRecorder(const LevelRecorder &) = delete;
+	LevelRecorder &operator=(const LevelRecorder &) = delete;
+
+	// Records another source from now on, or none. The history is kept.
+	void SetSource(obs_source_t *source);
+	// Adds the newest levels of the engine slot, called on every tick of
+	// the meter timer. Does nothing when a volmeter records.
+	void Poll();
+	// Records the peak after volume and mute instead of the input peak.
+	void ShowOutputPeak(bool output) { outputPeak = output; }
+	int Channels() const { return history.Channels(); }
+
+	// Closes the periods that ended by now and runs f on the history
+	// with the audio thread held off, keep f short.
+	template<typename F> void Read(F &&f)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		history.Advance(os_gettime_ns());
+		f((const LevelHistory &)history);
+	}
+};
@@ -0,0 +1,251 @@
+#include "loudness-meter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "util/sse-intrin.h"
+#include "plugin-stats.hpp"
+#include "trace.hpp"
+
+#define ABSOLUTE_GATE -70.0
+#define RELATIVE_GATE -10.0
+
+static inline float block_loudness(double energy)
+{
+	return energy > 0.0 ? (float)(-0.691 + 10.0 * log10(energy))
+			    : -INFINITY;
+}
+
+// Mean energy of a block at the center of each histogram bin.
+static const struct BinEnergy {
+	double energy[LoudnessMeter::Bins];
+
+	BinEnergy()
+	{
+		for (int i = 0; i < LoudnessMeter::Bins; i++) {
+			const double loudness = ABSOLUTE_GATE + (i + 0.5) * 0.1;
+			energy[i] = pow(10.0, (loudness + 0.691) / 10.0);
+		}
+	}
+} binEnergy;
+
+LoudnessMeter::LoudnessMeter(obs_source_t *source_)
+	: source(obs_source_get_weak_source(source_)),
+	  momentary(-INFINITY),
+	  shortTerm(-INFINITY),
+	  integrated(-INFINITY)
+{
+	Configure();
+	obs_source_add_audio_capture_callback(source_, AudioCaptured, this);
+}
+
+LoudnessMeter::~LoudnessMeter()
+{
+	if (auto s = obs_weak_source_get_source(source)) {
+		obs_source_remove_audio_capture_callback(s, AudioCaptured,
+							 this);
+		obs_source_release(s);
+	}
+	obs_weak_source_release(source);
+}
+
+void LoudnessMeter::Configure()
+{
+	struct obs_audio_info oai = {};
+	obs_get_audio_info(&oai);
+	rate = oai.samples_per_sec ? oai.samples_per_sec : 48000;
+	subLength = rate / 10;
+
+	// Channel weights of BS.1770, the LFE is left out and the surround
+	// channels count 1.41.
+	static const float layouts[][MAX_AUDIO_CHANNELS] = {
+		{1.0f},
+		{1.0f, 1.0f},
+		{1.0f, 1.0f, 0.0f},
+		{1.0f, 1.0f, 1.0f, 1.41f},
+		{1.0f, 1.0f, 1.0f, 0.0f, 1.41f},
+		{1.0f, 1.0f, 1.0f, 0.0f, 1.41f, 1.41f},
+		{1.0f, 1.0f, 1.0f, 0.0f, 1.41f, 1.41f, 1.41f, 1.41f},
+	};
+	int layout;
+	switch (oai.speakers) {
+	case SPEAKERS_MONO:
+		layout = 0;
+		break;
+	case SPEAKERS_2POINT1:
+		layout = 2;
+		break;
+	case SPEAKERS_4POINT0:
+		layout = 3;
+		break;
+	case SPEAKERS_4POINT1:
+		layout = 4;
+		break;
+	case SPEAKERS_5POINT1:
+		layout = 5;
+		break;
+	case SPEAKERS_7POINT1:
+		layout = 6;
+		break;
+	default:
+		layout = 1;
+		break;
+	}
+	channels = std::min((int)get_audio_channels(oai.speakers),
+			    MAX_AUDIO_CHANNELS);
+	memcpy(weights, layouts[layout], sizeof(weights));
+
+	// The K-weighting pre-filter and RLB high pass of BS.1770 for the
+	// output sample rate.
+	double K = tan(M_PI * 1681.974450955533 / rate);
+	double Q = 0.7071752369554196;
+	const double Vh = pow(10.0, 3.999843853973347 / 20.0);
+	const double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+	shelf.b0 = (float)((Vh + Vb * K / Q + K * K) / a0);
+	shelf.b1 = (float)(2.0 * (K * K - Vh) / a0);
+	shelf.b2 = (float)((Vh - Vb * K / Q + K * K) / a0);
+	shelf.a1 = (float)(2.0 * (K * K - 1.0) / a0);
+	shelf.a2 = (float)((1.0 - K / Q + K * K) / a0);
+
+	K = tan(M_PI * 38.13547087602444 / rate);
+	Q = 0.5003270373238773;
+	a0 = 1.0 + K / Q + K * K;
+	highpass.b0 = 1.0f;
+	highpass.b1 = -2.0f;
+	highpass.b2 = 1.0f;
+	highpass.a1 = (float)(2.0 * (K * K - 1.0) / a0);
+	highpass.a2 = (float)((1.0 - K / Q + K * K) / a0);
+}
+
+// K-weights frames of every channel and returns their weighted energy.
+// The biquads are transposed direct form II, four channels at a time.
+double LoudnessMeter::Filter(const float *const *in, uint32_t offset,
+			     uint32_t frames)
+{
+	const __m128 sb0 = _mm_set1_ps(shelf.b0), sb1 = _mm_set1_ps(shelf.b1),
+		     sb2 = _mm_set1_ps(shelf.b2), sa1 = _mm_set1_ps(shelf.a1),
+		     sa2 = _mm_set1_ps(shelf.a2);
+	const __m128 hb0 = _mm_set1_ps(highpass.b0),
+		     hb1 = _mm_set1_ps(highpass.b1),
+		     hb2 = _mm_set1_ps(highpass.b2),
+		     ha1 = _mm_set1_ps(highpass.a1),
+		     ha2 = _mm_set1_ps(highpass.a2);
+	double total = 0.0;
+	for (int group = 0; group * 4 < channels; group++) {
+		const int first = group * 4;
+		const float *p[4];
+		for (int c = 0; c < 4; c++)
+			p[c] = first + c < channels && in[first + c]
+				       ? in[first + c] + offset
+				       : nullptr;
+		__m128 sz1 = _mm_load_ps(state[0] + first);
+		__m128 sz2 = _mm_load_ps(state[1] + first);
+		__m128 hz1 = _mm_load_ps(state[2] + first);
+		__m128 hz2 = _mm_load_ps(state[3] + first);
+		__m128 acc = _mm_setzero_ps();
+		for (uint32_t i = 0; i < frames; i++) {
+			const __m128 x = _mm_setr_ps(p[0] ? p[0][i] : 0.0f,
+						     p[1] ? p[1][i] : 0.0f,
+						     p[2] ? p[2][i] : 0.0f,
+						     p[3] ? p[3][i] : 0.0f);
+			const __m128 s = _mm_add_ps(_mm_mul_ps(sb0, x), sz1);
+			sz1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb1, x),
+						    _mm_mul_ps(sa1, s)),
+					 sz2);
+			sz2 = _mm_sub_ps(_mm_mul_ps(sb2, x), _mm_mul_ps(sa2, s));
+			const __m128 y = _mm_add_ps(_mm_mul_ps(hb0, s), hz1);
+			hz1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(hb1, s),
+						    _mm_mul_ps(ha1, y)),
+					 hz2);
+			hz2 = _mm_sub_ps(_mm_mul_ps(hb2, s), _mm_mul_ps(ha2, y));
+			acc = _mm_add_ps(acc, _mm_mul_ps(y, y));
+		}
+		_mm_store_ps(state[0] + first, sz1);
+		_mm_store_ps(state[1] + first, sz2);
+		_mm_store_ps(state[2] + first, hz1);
+		_mm_store_ps(state[3] + first, hz2);
+		alignas(16) float sums[4];
+		_mm_store_ps(sums, _mm_mul_ps(acc, _mm_loadu_ps(weights + first)));
+		total += (double)sums[0] + sums[1] + sums[2] + sums[3];
+	}
+	return total;
+}
+
+void LoudnessMeter::EndSubBlock()
+{
+	subBlocks[subIndex] = subSum / subLength;
+	subIndex = (subIndex + 1) % SubBlocks;
+	subCount = std::min(subCount + 1, SubBlocks);
+	subSum = 0.0;
+	subFrames = 0;
+	// Momentary blocks are 400 ms and overlap by 75%.
+	if (subCount < 4)
+		return;
+	double sum = 0.0;
+	for (int i = 1; i <= subCount; i++) {
+		sum += subBlocks[(subIndex - i + SubBlocks) % SubBlocks];
+		if (i == 4) {
+			const float block = block_loudness(sum / 4.0);
+			momentary = block;
+			if (block >= ABSOLUTE_GATE) {
+				const int bin = std::min(
+					(int)((block - ABSOLUTE_GATE) * 10.0),
+					Bins - 1);
+				histogram[bin]++;
+			}
+		}
+	}
+	shortTerm = block_loudness(sum / subCount);
+	integrated = Integrate();
+}
+
+float LoudnessMeter::Integrate() const
+{
+	uint64_t count = 0;
+	double energy = 0.0;
+	for (int i = 0; i < Bins; i++) {
+		count += histogram[i];
+		energy += histogram[i] * binEnergy.energy[i];
+	}
+	if (!count)
+		return -INFINITY;
+	const double gate = block_loudness(energy / count) + RELATIVE_GATE;
+	const int first = std::max(
+		(int)ceil((gate - ABSOLUTE_GATE) * 10.0 - 0.5), 0);
+	count = 0;
+	energy = 0.0;
+	for (int i = first; i < Bins; i++) {
+		count += histogram[i];
+		energy += histogram[i] * binEnergy.energy[i];
+	}
+	return count ? block_loudness(energy / count) : -INFINITY;
+}
+
+void LoudnessMeter::AudioCaptured(void *param, obs_source_t *source,
+				  const struct audio_data *audio_data,
+				  bool muted)
+{
+	ProfileScope scope("LoudnessMeter::AudioCaptured",
+			   &pluginStats.loudness);
+	auto meter = static_cast<LoudnessMeter *>(param);
+	if (meter->resetPending.exchange(false)) {
+		memset(meter->histogram, 0, sizeof(meter->histogram));
+		meter->integrated = -INFINITY;
+	}
+	const float mul = muted ? 0.0f : obs_source_get_volume(source);
+	const double gain = (double)mul * mul;
+	const auto in = (const float *const *)audio_data->data;
+	uint32_t offset = 0;
+	while (offset < audio_data->frames) {
+		const uint32_t frames =
+			std::min(audio_data->frames - offset,
+				 meter->subLength - meter->subFrames);
+		meter->subSum += meter->Filter(in, offset, frames) * gain;
+		meter->subFrames += frames;
+		offset += frames;
+		if (meter->subFrames == meter->subLength)
+			meter->EndSubBlock();
+	}
+}
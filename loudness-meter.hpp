@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "obs.h"
+
+// ITU-R BS.1770 / EBU R128 loudness of a source, measured from its audio
+// capture callback. The audio is K-weighted with two biquads that run on
+// four channels per SSE vector, summed into 100 ms sub-blocks and gated
+// from a histogram, so memory stays fixed however long it integrates.
+// Values are in LUFS, -inf while there is nothing to measure.
+class LoudnessMeter {
+public:
+	static constexpr int SubBlocks = 30; // 3 s short-term window
+	static constexpr int Bins = 1000;    // -70 to +30 LUFS in 0.1 LU
+
+private:
+	struct Biquad {
+		float b0, b1, b2, a1, a2;
+	};
+
+	obs_weak_source_t *source;
+	uint32_t rate = 0;
+	int channels = 0;
+	Biquad shelf = {};
+	Biquad highpass = {};
+	float weights[MAX_AUDIO_CHANNELS] = {};
+	// z1 and z2 of both stages, four channels per vector.
+	alignas(16) float state[4][MAX_AUDIO_CHANNELS] = {};
+
+	uint32_t subLength = 0;
+	uint32_t subFrames = 0;
+	double subSum = 0.0;
+	double subBlocks[SubBlocks] = {};
+	int subIndex = 0;
+	int subCount = 0;
+	uint32_t histogram[Bins] = {};
+
+	std::atomic<float> momentary;
+	std::atomic<float> shortTerm;
+	std::atomic<float> integrated;
+	std::atomic<bool> resetPending{false};
+
+	static void AudioCaptured(void *param, obs_source_t *source,
+				  const struct audio_data *audio_data,
+				  bool muted);
+	void Configure();
+	double Filter(const float *const *in, uint32_t offset, uint32_t frames);
+	void EndSubBlock();
+	float Integrate() const;
+
+public:
+	explicit LoudnessMeter(obs_source_t *source);
+	~LoudnessMeter();
+
+	LoudnessMeter(const LoudnessMeter &) = delete;
+	LoudnessMeter &operator=(const LoudnessMeter &) = delete;
+
+	float Momentary() const { return momentary; }
+	float ShortTerm() const { return shortTerm; }
+	float Integrated() const { return integrated; }
+	// Restarts the integrated measurement.
+	void Reset() { resetPending = true; }
+};
@@ -0,0 +1,46 @@
+#include "plugin-stats.hpp"
+
+PluginStats pluginStats;
+
+void DurationStat::Add(uint64_t ns)
+{
+	count.fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(ns, std::memory_order_relaxed);
+	last.store(ns, std::memory_order_relaxed);
+	uint64_t m = max.load(std::memory_order_relaxed);
+	while (ns > m &&
+	       !max.compare_exchange_weak(m, ns, std::memory_order_relaxed))
+		;
+}
+
+const uint32_t LatencyHistogram::bounds[LatencyHistogram::Buckets - 1] = {
+	50, 100, 250, 500, 1000, 2500, 5000};
+
+void LatencyHistogram::Add(uint64_t ns)
+{
+	int bucket = 0;
+	while (bucket < Buckets - 1 &&
+	       ns >= (uint64_t)bounds[bucket] * 1000000ULL)
+		bucket++;
+	counts[bucket]++;
+	if (!count || ns < min)
+		min = ns;
+	if (ns > max)
+		max = ns;
+	count++;
+	total += ns;
+	last = ns;
+}
+
+double DurationWindow::Update(const DurationStat &stat, uint64_t *samples)
+{
+	const uint64_t c = stat.count.load(std::memory_order_relaxed);
+	const uint64_t t = stat.total.load(std::memory_order_relaxed);
+	const uint64_t dc = c - count;
+	const uint64_t dt = t - total;
+	count = c;
+	total = t;
+	if (samples)
+		*samples = dc;
+	return dc ? (double)dt / (double)dc / 1000000.0 : 0.0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Duration counters that any thread can update without locking.
+struct DurationStat {
+	std::atomic<uint64_t> count{0};
+	std::atomic<uint64_t> total{0};
+	std::atomic<uint64_t> last{0};
+	std::atomic<uint64_t> max{0};
+
+	void Add(uint64_t ns);
+};
+
+struct PluginStats {
+	DurationStat meterTick;
+	DurationStat meterInterval;
+	DurationStat meterPaint;
+	DurationStat dispatch;
+	DurationStat addDeviceSource;
+	DurationStat sourceProperties;
+	DurationStat retainCapture;
+	DurationStat retainApply;
+	DurationStat volmeterLevels;
+	DurationStat levelEngine;
+	DurationStat loudness;
+	DurationStat spectrum;
+	std::atomic<int64_t> volmeters{0};
+};
+
+extern PluginStats pluginStats;
+
+// Switch latency distribution, only used from the UI thread. counts[i]
+// holds the samples below bounds[i] ms, the last bucket the rest.
+struct LatencyHistogram {
+	static constexpr int Buckets = 8;
+	static const uint32_t bounds[Buckets - 1];
+
+	uint32_t counts[Buckets] = {};
+	uint32_t timeouts = 0;
+	uint64_t count = 0;
+	uint64_t total = 0;
+	uint64_t min = 0;
+	uint64_t max = 0;
+	uint64_t last = 0;
+
+	void Add(uint64_t ns);
+};
+
+// Average duration in ms of the samples added since the last update.
+struct DurationWindow {
+	uint64_t count = 0;
+	uint64_t total = 0;
+
+	double Update(const DurationStat &stat, uint64_t *samples = nullptr);
+};
@@ -0,0 +1,287 @@
+#include "retain-store.hpp"
+
+#include <cstring>
+
+#include "device-probe.hpp"
+#include "plugin-stats.hpp"
+#include "trace.hpp"
+
+RetainEntry::~RetainEntry()
+{
+	obs_data_release(settings);
+	obs_data_array_release(filters);
+}
+
+RetainStore::RetainStore()
+	: snapshot(std::make_shared<const RetainSnapshot>())
+{
+	os_sem_init(&wake, 0);
+	os_event_init(&drained, OS_EVENT_TYPE_AUTO);
+	writer = std::thread(&RetainStore::WriterThread, this);
+}
+
+RetainStore::~RetainStore()
+{
+	stopping = true;
+	os_sem_post(wake);
+	writer.join();
+	os_sem_destroy(wake);
+	os_event_destroy(drained);
+}
+
+std::shared_ptr<const RetainSnapshot> RetainStore::Snapshot() const
+{
+	return std::atomic_load(&snapshot);
+}
+
+std::shared_ptr<const RetainEntry> RetainStore::Get(const char *name) const
+{
+	if (!name)
+		return nullptr;
+	const auto current = Snapshot();
+	const auto it = current->find(name);
+	if (it == current->end())
+		return nullptr;
+	return it->second;
+}
+
+bool RetainStore::Has(const char *name) const
+{
+	return !!Get(name);
+}
+
+void RetainStore::SaveFilterSettings(obs_source_t *parent, obs_source_t *filter,
+				     void *param)
+{
+	UNUSED_PARAMETER(parent);
+	if (device_probe_is_probe(filter))
+		return;
+	auto array = static_cast<obs_data_array_t *>(param);
+	obs_data_t *t = obs_data_create();
+	obs_data_set_string(t, "name", obs_source_get_name(filter));
+	obs_data_set_string(t, "id", obs_source_get_unversioned_id(filter));
+	obs_data_t *s = obs_data_create();
+	if (auto settings = obs_source_get_settings(filter)) {
+		obs_data_apply(s, settings);
+		obs_data_release(settings);
+	}
+	obs_data_set_obj(t, "settings", s);
+	obs_data_release(s);
+	obs_data_array_push_back(array, t);
+	obs_data_release(t);
+}
+
+void RetainStore::Put(obs_source_t *source)
+{
+	Capture(source, false);
+}
+
+void RetainStore::Refresh(obs_source_t *source)
+{
+	Capture(source, true);
+}
+
+void RetainStore::Capture(obs_source_t *source, bool refresh)
+{
+	ProfileScope scope("RetainStore::Capture", &pluginStats.retainCapture);
+	if (!source)
+		return;
+	auto entry = std::make_shared<RetainEntry>();
+	entry->id = obs_source_get_unversioned_id(source);
+	entry->settings = obs_data_create();
+	if (const auto settings = obs_source_get_settings(source)) {
+		obs_data_apply(entry->settings, settings);
+		obs_data_release(settings);
+	}
+	std::string setting, device;
+	if (GetSaveDevice(source, setting, device))
+		obs_data_set_string(entry->settings, setting.c_str(),
+				    device.c_str());
+	entry->filters = obs_data_array_create();
+	obs_source_enum_filters(source, SaveFilterSettings, entry->filters);
+
+	Mutation mutation;
+	mutation.name = obs_source_get_name(source);
+	mutation.entry = std::move(entry);
+	mutation.refresh = refresh;
+	Post(std::move(mutation));
+}
+
+void RetainStore::Remove(const char *name)
+{
+	if (!name)
+		return;
+	Mutation mutation;
+	mutation.name = name;
+	Post(std::move(mutation));
+}
+
+void RetainStore::SetSaveDevice(obs_weak_source_t *source,
+				const char *setting, const char *device)
+{
+	if (!source)
+		return;
+	std::lock_guard<std::mutex> lock(saveDevicesMutex);
+	if (!device || !setting) {
+		saveDevices.erase(source);
+		return;
+	}
+	auto &saveDevice = saveDevices[source];
+	saveDevice.setting = setting;
+	saveDevice.device = device;
+}
+
+bool RetainStore::GetSaveDevice(obs_source_t *source, std::string &setting,
+				std::string &device) const
+{
+	obs_weak_source_t *weak = obs_source_get_weak_source(source);
+	bool found = false;
+	{
+		std::lock_guard<std::mutex> lock(saveDevicesMutex);
+		const auto it = saveDevices.find(weak);
+		if (it != saveDevices.end()) {
+			setting = it->second.setting;
+			device = it->second.device;
+			found = true;
+		}
+	}
+	obs_weak_source_release(weak);
+	return found;
+}
+
+void RetainStore::SaveDevices(obs_data_array_t *array) const
+{
+	std::lock_guard<std::mutex> lock(saveDevicesMutex);
+	for (const auto &it : saveDevices) {
+		obs_source_t *source = obs_weak_source_get_source(it.first);
+		if (!source)
+			continue;
+		obs_data_t *item = obs_data_create();
+		obs_data_set_string(item, "name", obs_source_get_name(source));
+		obs_data_set_string(item, "setting", it.second.setting.c_str());
+		obs_data_set_string(item, "device", it.second.device.c_str());
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+		obs_source_release(source);
+	}
+}
+
+void RetainStore::Post(Mutation mutation)
+{
+	queued++;
+	mutations.Push(std::move(mutation));
+	os_sem_post(wake);
+}
+
+void RetainStore::Flush()
+{
+	while (applied.load() != queued.load())
+		os_event_wait(drained);
+}
+
+void RetainStore::Apply(RetainSnapshot &next, Mutation &mutation)
+{
+	ProfileScope scope("RetainStore::Apply", &pluginStats.retainApply);
+	const auto it = next.find(mutation.name);
+	if (mutation.refresh && it == next.end())
+		return;
+	if (!mutation.entry) {
+		if (it != next.end())
+			next.erase(it);
+		return;
+	}
+	if (it != next.end() && it->second->settings) {
+		// Keep values the source no longer reports, like the original
+		// in place merge did.
+		auto merged = std::make_shared<RetainEntry>();
+		merged->id = mutation.entry->id;
+		merged->settings = obs_data_create();
+		obs_data_apply(merged->settings, it->second->settings);
+		obs_data_apply(merged->settings, mutation.entry->settings);
+		merged->filters = mutation.entry->filters;
+		obs_data_array_addref(merged->filters);
+		mutation.entry = std::move(merged);
+	}
+	next[mutation.name] = std::move(mutation.entry);
+}
+
+// Everything queued when the writer wakes is applied to one copy of the
+// snapshot, so saving N retained sources copies the map once per batch
+// instead of once per source.
+void RetainStore::WriterThread()
+{
+	os_set_thread_name("device-switcher: retain store");
+	Mutation mutation;
+	for (;;) {
+		os_sem_wait(wake);
+		std::shared_ptr<RetainSnapshot> next;
+		uint64_t batch = 0;
+		while (mutations.Pop(mutation)) {
+			if (!next)
+				next = std::make_shared<RetainSnapshot>(
+					*Snapshot());
+			Apply(*next, mutation);
+			mutation = Mutation();
+			batch++;
+		}
+		if (next)
+			std::atomic_store(
+				&snapshot,
+				std::shared_ptr<const RetainSnapshot>(
+					std::move(next)));
+		applied += batch;
+		os_event_signal(drained);
+		if (stopping)
+			break;
+	}
+}
+
+void RetainStore::Load(const char *file)
+{
+	obs_data_t *root = obs_data_create_from_json_file_safe(file, "bak");
+	if (!root)
+		return;
+	auto next = std::make_shared<RetainSnapshot>();
+	auto array = obs_data_get_array(root, "sources");
+	const size_t count = obs_data_array_count(array);
+	for (size_t i = 0; i < count; i++) {
+		auto item = obs_data_array_item(array, i);
+		if (!item)
+			continue;
+		auto entry = std::make_shared<RetainEntry>();
+		entry->id = obs_data_get_string(item, "id");
+		entry->settings = obs_data_get_obj(item, "settings");
+		entry->filters = obs_data_get_array(item, "filters");
+		(*next)[obs_data_get_string(item, "name")] = std::move(entry);
+		obs_data_release(item);
+	}
+	obs_data_array_release(array);
+	obs_data_release(root);
+	std::atomic_store(&snapshot,
+			  std::shared_ptr<const RetainSnapshot>(std::move(next)));
+}
+
+bool RetainStore::Save(const char *file)
+{
+	Flush();
+	const auto current = Snapshot();
+	obs_data_t *root = obs_data_create();
+	obs_data_array_t *array = obs_data_array_create();
+	for (const auto &it : *current) {
+		obs_data_t *item = obs_data_create();
+		obs_data_set_string(item, "name", it.first.c_str());
+		obs_data_set_string(item, "id", it.second->id.c_str());
+		if (it.second->settings)
+			obs_data_set_obj(item, "settings", it.second->settings);
+		if (it.second->filters)
+			obs_data_set_array(item, "filters",
+					   it.second->filters);
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+	}
+	obs_data_set_array(root, "sources", array);
+	obs_data_array_release(array);
+	const bool success = obs_data_save_json_safe(root, file, "tmp", "bak");
+	obs_data_release(root);
+	return success;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "obs.h"
+#include "util/threading.h"
+#include "event-queue.hpp"
+
+// Retained device settings of one source. Entries are immutable once they
+// are published in a snapshot, readers can use them without locking.
+struct RetainEntry {
+	std::string id;
+	obs_data_t *settings = nullptr;
+	obs_data_array_t *filters = nullptr;
+
+	RetainEntry() = default;
+	RetainEntry(const RetainEntry &) = delete;
+	RetainEntry &operator=(const RetainEntry &) = delete;
+	~RetainEntry();
+};
+
+typedef std::map<std::string, std::shared_ptr<const RetainEntry>>
+	RetainSnapshot;
+
+// Copy-on-write store for the retained source settings. Readers take the
+// current snapshot, mutations are queued to a single writer thread that
+// publishes a new snapshot, so readers and writers never wait on each
+// other.
+class RetainStore {
+	struct Mutation {
+		std::string name;
+		std::shared_ptr<const RetainEntry> entry; // nullptr removes
+		bool refresh = false; // only updates an existing entry
+	};
+
+	struct SaveDevice {
+		std::string setting;
+		std::string device;
+	};
+
+	std::shared_ptr<const RetainSnapshot> snapshot;
+	mutable std::mutex saveDevicesMutex;
+	std::unordered_map<obs_weak_source_t *, SaveDevice> saveDevices;
+	MpscQueue<Mutation, 256> mutations;
+	std::atomic<uint64_t> queued{0};
+	std::atomic<uint64_t> applied{0};
+	std::atomic<bool> stopping{false};
+	os_sem_t *wake = nullptr;
+	os_event_t *drained = nullptr;
+	std::thread writer;
+
+	static void SaveFilterSettings(obs_source_t *parent,
+				       obs_source_t *filter, void *param);
+	void Capture(obs_source_t *source, bool refresh);
+	void Post(Mutation mutation);
+	void WriterThread();
+	void Apply(RetainSnapshot &next, Mutation &mutation);
+
+public:
+	RetainStore();
+	~RetainStore();
+
+	std::shared_ptr<const RetainSnapshot> Snapshot() const;
+	std::shared_ptr<const RetainEntry> Get(const char *name) const;
+	bool Has(const char *name) const;
+
+	// Captures the settings and filters of the source on the calling
+	// thread and hands them to the writer.
+	void Put(obs_source_t *source);
+	// Like Put, but the writer drops it when the source is no longer
+	// retained by then, so it cannot undo a queued Remove.
+	void Refresh(obs_source_t *source);
+	void Remove(const char *name);
+
+	// Device a source is captured and saved with instead of the one it
+	// runs on, published by its row while it is failed over so saves on
+	// any thread never look at the row. A null device clears it.
+	void SetSaveDevice(obs_weak_source_t *source, const char *setting,
+			   const char *device);
+	bool GetSaveDevice(obs_source_t *source, std::string &setting,
+			   std::string &device) const;
+	// Appends name, setting and device of every source that has one.
+	void SaveDevices(obs_data_array_t *array) const;
+
+	// Waits until all queued mutations are published.
+	void Flush();
+
+	void Load(const char *file);
+	bool Save(const char *file);
+};
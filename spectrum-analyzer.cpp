@@ -0,0 +1,268 @@
+#include "spectrum-analyzer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <QPainter>
+
+#include "util/platform.h"
+#include "plugin-stats.hpp"
+#include "trace.hpp"
+
+#define SPECTRUM_LOW_HZ 40.0
+#define SPECTRUM_HIGH_HZ 20000.0
+#define SPECTRUM_FLOOR_DB -90.0f
+#define SPECTRUM_DECAY_DB 40.0f
+#define SPECTRUM_HOLD_NS 1000000000ULL
+
+// Window, bit reversal and twiddles of the Size / 2 point complex FFT
+// the real FFT is computed with, shared by all analyzers.
+static const struct FftPlan {
+	static constexpr int Size = SpectrumAnalyzer::Size;
+	static constexpr int Half = Size / 2;
+
+	float window[Size];
+	float windowSum = 0.0f;
+	int bitrev[Half];
+	float twiddleRe[Half / 2];
+	float twiddleIm[Half / 2];
+	float splitRe[Half];
+	float splitIm[Half];
+
+	FftPlan()
+	{
+		for (int i = 0; i < Size; i++) {
+			window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i /
+						       (Size - 1));
+			windowSum += window[i];
+		}
+		int bits = 0;
+		while ((1 << bits) < Half)
+			bits++;
+		for (int i = 0; i < Half; i++) {
+			int r = 0;
+			for (int b = 0; b < bits; b++)
+				r |= ((i >> b) & 1) << (bits - 1 - b);
+			bitrev[i] = r;
+		}
+		for (int i = 0; i < Half / 2; i++) {
+			twiddleRe[i] = cosf(2.0f * (float)M_PI * i / Half);
+			twiddleIm[i] = -sinf(2.0f * (float)M_PI * i / Half);
+		}
+		for (int i = 0; i < Half; i++) {
+			splitRe[i] = cosf(2.0f * (float)M_PI * i / Size);
+			splitIm[i] = -sinf(2.0f * (float)M_PI * i / Size);
+		}
+	}
+} plan;
+
+SpectrumAnalyzer::SpectrumAnalyzer(obs_source_t *source_)
+	: source(obs_source_get_weak_source(source_))
+{
+	struct obs_audio_info oai = {};
+	obs_get_audio_info(&oai);
+	const double rate = oai.samples_per_sec ? oai.samples_per_sec : 48000;
+	const double high = std::min(SPECTRUM_HIGH_HZ, rate / 2.0);
+	// Every band starts after the last bin of the one below, so no two
+	// bands show the same bin.
+	for (int b = 0; b < Bands; b++) {
+		const double to =
+			SPECTRUM_LOW_HZ * pow(high / SPECTRUM_LOW_HZ,
+					      (double)(b + 1) / Bands);
+		const int first =
+			b ? bandLast[b - 1] + 1
+			  : (int)lround(SPECTRUM_LOW_HZ * Size / rate);
+		bandFirst[b] = std::clamp(first, 1, Size / 2 - 1);
+		bandLast[b] = std::clamp((int)lround(to * Size / rate) - 1,
+					 bandFirst[b], Size / 2 - 1);
+		bands[b] = -INFINITY;
+	}
+	if (source_)
+		obs_source_add_audio_capture_callback(source_, AudioCaptured,
+						      this);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+	if (auto s = obs_weak_source_get_source(source)) {
+		obs_source_remove_audio_capture_callback(s, AudioCaptured,
+							 this);
+		obs_source_release(s);
+	}
+	obs_weak_source_release(source);
+}
+
+// The input before volume and mute, hum is there either way.
+void SpectrumAnalyzer::AudioCaptured(void *param, obs_source_t *source,
+				     const struct audio_data *audio_data,
+				     bool muted)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(muted);
+	ProfileScope scope("SpectrumAnalyzer::AudioCaptured",
+			   &pluginStats.spectrum);
+	auto analyzer = static_cast<SpectrumAnalyzer *>(param);
+	const int channels = std::min(
+		(int)audio_output_get_channels(obs_get_audio()),
+		MAX_AUDIO_CHANNELS);
+	const float *in[MAX_AUDIO_CHANNELS];
+	int count = 0;
+	for (int ch = 0; ch < channels; ch++) {
+		if (audio_data->data[ch])
+			in[count++] = (const float *)audio_data->data[ch];
+	}
+	if (!count)
+		return;
+	const float scale = 1.0f / count;
+	for (uint32_t i = 0; i < audio_data->frames; i++) {
+		float sum = 0.0f;
+		for (int ch = 0; ch < count; ch++)
+			sum += in[ch][i];
+		analyzer->ring[analyzer->ringPos] = sum * scale;
+		analyzer->ringPos = (analyzer->ringPos + 1) % Size;
+		if (++analyzer->sinceFft == Hop) {
+			analyzer->sinceFft = 0;
+			analyzer->Analyze();
+		}
+	}
+}
+
+void SpectrumAnalyzer::Analyze()
+{
+	const int half = Size / 2;
+	for (int i = 0; i < Size; i++)
+		windowed[i] = ring[(ringPos + i) % Size] * plan.window[i];
+
+	// Even samples as the real part, odd ones as the imaginary part of
+	// a half size complex FFT.
+	for (int i = 0; i < half; i++) {
+		re[plan.bitrev[i]] = windowed[2 * i];
+		im[plan.bitrev[i]] = windowed[2 * i + 1];
+	}
+	for (int len = 2; len <= half; len <<= 1) {
+		const int step = half / len;
+		const int span = len / 2;
+		for (int i = 0; i < half; i += len) {
+			for (int j = 0; j < span; j++) {
+				const float wr = plan.twiddleRe[j * step];
+				const float wi = plan.twiddleIm[j * step];
+				const int a = i + j;
+				const int b = a + span;
+				const float xr = re[b] * wr - im[b] * wi;
+				const float xi = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - xr;
+				im[b] = im[a] - xi;
+				re[a] += xr;
+				im[a] += xi;
+			}
+		}
+	}
+
+	// Splits the half size result into the bins of the real input and
+	// keeps the loudest bin of every band.
+	const float toDb = 2.0f / plan.windowSum;
+	for (int b = 0; b < Bands; b++) {
+		float peak = 0.0f;
+		for (int k = bandFirst[b]; k <= bandLast[b]; k++) {
+			const int c = (half - k) % half;
+			const float evenRe = 0.5f * (re[k] + re[c]);
+			const float evenIm = 0.5f * (im[k] - im[c]);
+			const float oddRe = 0.5f * (im[k] + im[c]);
+			const float oddIm = -0.5f * (re[k] - re[c]);
+			const float xr = evenRe + plan.splitRe[k] * oddRe -
+					 plan.splitIm[k] * oddIm;
+			const float xi = evenIm + plan.splitRe[k] * oddIm +
+					 plan.splitIm[k] * oddRe;
+			peak = std::max(peak, xr * xr + xi * xi);
+		}
+		bands[b].store(20.0f * log10f(sqrtf(peak) * toDb + 1e-10f),
+			       std::memory_order_relaxed);
+	}
+	updated.store(os_gettime_ns(), std::memory_order_relaxed);
+}
+
+uint64_t SpectrumAnalyzer::Benchmark(uint64_t frames)
+{
+	if (!frames)
+		return 0;
+	auto analyzer = std::make_unique<SpectrumAnalyzer>(nullptr);
+	for (int i = 0; i < Size; i++)
+		analyzer->ring[i] = sinf((float)i * 0.37f) * 0.5f;
+	const uint64_t start = os_gettime_ns();
+	for (uint64_t i = 0; i < frames; i++)
+		analyzer->Analyze();
+	return (os_gettime_ns() - start) / frames;
+}
+
+SpectrumStrip::SpectrumStrip(QWidget *parent) : QWidget(parent)
+{
+	setAttribute(Qt::WA_OpaquePaintEvent, true);
+	setFixedHeight(20);
+	setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+	Reset();
+	updateTimer = VolumeMeter::SharedTimer();
+	updateTimer->AddWidget(this);
+}
+
+SpectrumStrip::~SpectrumStrip()
+{
+	updateTimer->RemoveWidget(this);
+}
+
+void SpectrumStrip::Reset()
+{
+	for (int b = 0; b < SpectrumAnalyzer::Bands; b++) {
+		display[b] = SPECTRUM_FLOOR_DB;
+		hold[b] = SPECTRUM_FLOOR_DB;
+		holdTime[b] = 0;
+	}
+}
+
+void SpectrumStrip::SetSource(obs_source_t *source)
+{
+	analyzer.reset();
+	Reset();
+	if (source)
+		analyzer = std::make_unique<SpectrumAnalyzer>(source);
+}
+
+void SpectrumStrip::paintEvent(QPaintEvent *event)
+{
+	UNUSED_PARAMETER(event);
+	const uint64_t ts = os_gettime_ns();
+	const float elapsed =
+		lastRedraw ? (ts - lastRedraw) * 0.000000001f : 0.0f;
+	lastRedraw = ts;
+	if (!analyzer || ts - analyzer->Updated() > 500000000ULL)
+		Reset();
+
+	QPainter painter(this);
+	painter.fillRect(rect(), palette().color(QPalette::Window));
+	const int bands = SpectrumAnalyzer::Bands;
+	const float w = (float)width() / bands;
+	const QColor bar = palette().color(QPalette::Highlight);
+	const QColor marker = palette().color(QPalette::WindowText);
+	for (int b = 0; b < bands; b++) {
+		if (analyzer && ts - analyzer->Updated() <= 500000000ULL) {
+			const float level = std::max(analyzer->Band(b),
+						     SPECTRUM_FLOOR_DB);
+			display[b] = std::max(
+				level, display[b] - SPECTRUM_DECAY_DB * elapsed);
+			if (level >= hold[b] ||
+			    ts - holdTime[b] > SPECTRUM_HOLD_NS) {
+				hold[b] = level;
+				holdTime[b] = ts;
+			}
+		}
+		const int x = (int)(b * w);
+		const int bw = std::max((int)((b + 1) * w) - x - 1, 1);
+		const int h = (int)(height() * (1.0f - display[b] /
+							     SPECTRUM_FLOOR_DB));
+		if (h > 0)
+			painter.fillRect(x, height() - h, bw, h, bar);
+		const int y = height() - (int)(height() * (1.0f - hold[b] /
+							     SPECTRUM_FLOOR_DB));
+		if (hold[b] > SPECTRUM_FLOOR_DB)
+			painter.fillRect(x, std::min(y, height() - 1), bw, 1,
+					 marker);
+	}
+}
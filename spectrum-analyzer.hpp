@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QWidget>
+#include <QPaintEvent>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+#include "obs.h"
+#include "volume-meter.hpp"
+
+// Spectrum of a source in log spaced bands, from a 4096 point real FFT of
+// the mono downmix with a Hann window, every 512 frames. The 11.7 Hz bins
+// at 48 kHz keep the low bands apart, 50 and 60 Hz hum land in different
+// bars. Everything the audio thread touches is allocated up front, the FFT
+// plan is shared.
+class SpectrumAnalyzer {
+public:
+	static constexpr int Size = 4096;
+	static constexpr int Hop = 512;
+	static constexpr int Bands = 32;
+
+private:
+	obs_weak_source_t *source;
+	int bandFirst[Bands];
+	int bandLast[Bands];
+	float ring[Size] = {};
+	int ringPos = 0;
+	int sinceFft = 0;
+	alignas(16) float windowed[Size];
+	alignas(16) float re[Size / 2];
+	alignas(16) float im[Size / 2];
+	std::atomic<float> bands[Bands];
+	std::atomic<uint64_t> updated{0};
+
+	static void AudioCaptured(void *param, obs_source_t *source,
+				  const struct audio_data *audio_data,
+				  bool muted);
+	void Analyze();
+
+public:
+	explicit SpectrumAnalyzer(obs_source_t *source);
+	~SpectrumAnalyzer();
+
+	SpectrumAnalyzer(const SpectrumAnalyzer &) = delete;
+	SpectrumAnalyzer &operator=(const SpectrumAnalyzer &) = delete;
+
+	// Band levels in dBFS of a full scale sine.
+	float Band(int band) const { return bands[band]; }
+	uint64_t Updated() const { return updated; }
+
+	// Runs the window, FFT and banding of frames analyses, returns ns
+	// per analysis.
+	static uint64_t Benchmark(uint64_t frames);
+};
+
+// Strip of spectrum bars with decay and peak hold, repainted on the
+// meter timer.
+class SpectrumStrip : public QWidget {
+	Q_OBJECT
+
+	std::unique_ptr<SpectrumAnalyzer> analyzer;
+	QSharedPointer<VolumeMeterTimer> updateTimer;
+	float display[SpectrumAnalyzer::Bands];
+	float hold[SpectrumAnalyzer::Bands];
+	uint64_t holdTime[SpectrumAnalyzer::Bands];
+	uint64_t lastRedraw = 0;
+
+	void Reset();
+
+protected:
+	void paintEvent(QPaintEvent *event) override;
+
+public:
+	explicit SpectrumStrip(QWidget *parent = nullptr);
+	~SpectrumStrip();
+
+	// Analyzes another source, or none.
+	void SetSource(obs_source_t *source);
+};
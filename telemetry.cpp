@@ -0,0 +1,260 @@
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "util/platform.h"
+
+TelemetryRecorder telemetry;
+
+TelemetryRecorder::~TelemetryRecorder()
+{
+	Stop();
+}
+
+bool TelemetryRecorder::Start(uint64_t fileSize_, int files_,
+			      uint64_t levelInterval_)
+{
+	if (writer.joinable())
+		return active;
+	char *dir = obs_module_config_path("");
+	if (!dir)
+		return false;
+	os_mkdirs(dir);
+	path = dir;
+	bfree(dir);
+	fileSize = fileSize_ ? std::max(fileSize_, (uint64_t)65536)
+			     : 16 * 1024 * 1024;
+	files = files_ > 0 ? files_ : 4;
+	levelInterval = levelInterval_ ? levelInterval_ : 100000000;
+	sources.clear();
+	Rotate();
+	if (!file) {
+		blog(LOG_WARNING, "[Device Switcher] failed to open %s%s",
+		     path.c_str(), TELEMETRY_FILE);
+		return false;
+	}
+	if (!queue)
+		queue.reset(new MpscQueue<Item, 4096>);
+	os_event_init(&stop, OS_EVENT_TYPE_MANUAL);
+	writer = std::thread(&TelemetryRecorder::WriterThread, this);
+	active = true;
+	blog(LOG_INFO, "[Device Switcher] recording telemetry to %s%s",
+	     path.c_str(), TELEMETRY_FILE);
+	return true;
+}
+
+// The writer keeps running after a failed rotation turned recording off,
+// so it is joined whenever it was started.
+void TelemetryRecorder::Stop()
+{
+	if (!writer.joinable())
+		return;
+	active = false;
+	os_event_signal(stop);
+	writer.join();
+	os_event_destroy(stop);
+	stop = nullptr;
+	if (file)
+		fclose(file);
+	file = nullptr;
+}
+
+static std::string RotatedName(const std::string &path, int index)
+{
+	if (!index)
+		return path + TELEMETRY_FILE;
+	return path + "telemetry." + std::to_string(index) + ".bin";
+}
+
+void TelemetryRecorder::Rotate()
+{
+	if (file) {
+		fclose(file);
+		file = nullptr;
+	}
+	os_unlink(RotatedName(path, files - 1).c_str());
+	for (int i = files - 1; i > 0; i--)
+		os_rename(RotatedName(path, i - 1).c_str(),
+			  RotatedName(path, i).c_str());
+	if (!OpenFile())
+		return;
+	// Every file names the sources its records refer to.
+	for (const auto &it : sources) {
+		telemetry_record record = {};
+		record.ts = os_gettime_ns();
+		record.source = it.first;
+		record.type = TELEMETRY_SOURCE;
+		record.size = (uint8_t)it.second.size();
+		Write(record, it.second.data());
+	}
+}
+
+bool TelemetryRecorder::OpenFile()
+{
+	file = os_fopen(RotatedName(path, 0).c_str(), "wb");
+	if (!file)
+		return false;
+	telemetry_file_header header = {};
+	header.magic = TELEMETRY_MAGIC;
+	header.version = TELEMETRY_VERSION;
+	header.started = os_gettime_ns();
+	const auto now = std::chrono::system_clock::now().time_since_epoch();
+	header.wall = (uint64_t)std::chrono::duration_cast<
+			      std::chrono::nanoseconds>(now)
+			      .count();
+	fwrite(&header, sizeof(header), 1, file);
+	written = sizeof(header);
+	return true;
+}
+
+void TelemetryRecorder::Write(const telemetry_record &record,
+			      const void *payload)
+{
+	if (!file)
+		return;
+	fwrite(&record, sizeof(record), 1, file);
+	if (record.size)
+		fwrite(payload, record.size, 1, file);
+	written += sizeof(record) + record.size;
+}
+
+void TelemetryRecorder::WriterThread()
+{
+	os_set_thread_name("device-switcher: telemetry");
+	Item item;
+	for (;;) {
+		const bool stopping = os_event_timedwait(stop, 250) == 0;
+		while (queue->Pop(item)) {
+			if (item.record.type == TELEMETRY_SOURCE)
+				sources[item.record.source].assign(
+					(const char *)item.payload,
+					item.record.size);
+			// Without a file the records are dropped, rotating
+			// again for every one would only churn the old files.
+			if (file &&
+			    written + sizeof(item.record) + item.record.size >
+				    fileSize) {
+				Rotate();
+				if (!file) {
+					active = false;
+					blog(LOG_WARNING,
+					     "[Device Switcher] failed to open %s%s, telemetry stopped",
+					     path.c_str(), TELEMETRY_FILE);
+				}
+			}
+			Write(item.record, item.payload);
+		}
+		if (const uint32_t lost = dropped.exchange(0)) {
+			telemetry_record record = {};
+			record.ts = os_gettime_ns();
+			record.type = TELEMETRY_DROPPED;
+			record.size = sizeof(lost);
+			Write(record, &lost);
+		}
+		if (file)
+			fflush(file);
+		if (stopping)
+			break;
+	}
+}
+
+void TelemetryRecorder::Post(uint32_t source, telemetry_type type,
+			     const void *payload, size_t size)
+{
+	if (!active.load(std::memory_order_relaxed) || !source)
+		return;
+	Item item;
+	item.record.ts = os_gettime_ns();
+	item.record.source = source;
+	item.record.type = (uint8_t)type;
+	item.record.size =
+		(uint8_t)std::min(size, (size_t)TELEMETRY_PAYLOAD_MAX);
+	item.record.reserved = 0;
+	if (item.record.size)
+		memcpy(item.payload, payload, item.record.size);
+	if (!queue->TryPush(item))
+		dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t TelemetryRecorder::AddSource(const char *name)
+{
+	if (!Active())
+		return 0;
+	const uint32_t source = nextSource++;
+	RenameSource(source, name);
+	return source;
+}
+
+void TelemetryRecorder::RenameSource(uint32_t source, const char *name)
+{
+	if (!name)
+		name = "";
+	Post(source, TELEMETRY_SOURCE, name, strlen(name));
+}
+
+static inline int16_t EncodeLevel(float db)
+{
+	if (!(db > -300.0f))
+		return TELEMETRY_LEVEL_SILENT;
+	return (int16_t)std::min(lroundf(db * 100.0f), (long)INT16_MAX);
+}
+
+void TelemetryRecorder::Levels(uint32_t source, int channels,
+			       const float *peak, const float *magnitude)
+{
+	int16_t levels[MAX_AUDIO_CHANNELS * 2];
+	channels = std::clamp(channels, 0, MAX_AUDIO_CHANNELS);
+	for (int ch = 0; ch < channels; ch++) {
+		levels[ch * 2] = EncodeLevel(peak[ch]);
+		levels[ch * 2 + 1] = EncodeLevel(magnitude[ch]);
+	}
+	Post(source, TELEMETRY_LEVELS, levels,
+	     channels * 2 * sizeof(int16_t));
+}
+
+void TelemetryRecorder::Clip(uint32_t source, float peak)
+{
+	const int16_t level = EncodeLevel(peak);
+	Post(source, TELEMETRY_CLIP, &level, sizeof(level));
+}
+
+void TelemetryRecorder::Switch(uint32_t source, uint64_t latency)
+{
+	const uint32_t us = (uint32_t)std::min(latency / 1000,
+					       (uint64_t)UINT32_MAX);
+	Post(source, TELEMETRY_SWITCH, &us, sizeof(us));
+}
+
+void TelemetryRecorder::SwitchTimeout(uint32_t source)
+{
+	Post(source, TELEMETRY_SWITCH_TIMEOUT, nullptr, 0);
+}
+
+void TelemetryRecorder::Restart(uint32_t source, uint64_t duration)
+{
+	const uint32_t us = (uint32_t)std::min(duration / 1000,
+					       (uint64_t)UINT32_MAX);
+	Post(source, TELEMETRY_RESTART, &us, sizeof(us));
+}
+
+void TelemetryRecorder::Failover(uint32_t source, const char *device)
+{
+	if (!device)
+		device = "";
+	Post(source, TELEMETRY_FAILOVER, device, strlen(device));
+}
+
+void TelemetryRecorder::Failback(uint32_t source)
+{
+	Post(source, TELEMETRY_FAILBACK, nullptr, 0);
+}
+
+void TelemetryRecorder::Idle(uint32_t source, uint64_t silent)
+{
+	const uint32_t ms = (uint32_t)std::min(silent / 1000000,
+					       (uint64_t)UINT32_MAX);
+	Post(source, TELEMETRY_IDLE, &ms, sizeof(ms));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/* Layout of the telemetry files the dock records, shared with the
+ * converter in tools. A file starts with the header, followed by records
+ * of a fixed record header and size bytes of payload. Values are in host
+ * byte order, timestamps are monotonic nanoseconds; started and wall map
+ * them to wall clock time.
+ *
+ * Every file starts with a TELEMETRY_SOURCE record for each known source,
+ * so a file is readable on its own after the older ones rotated away. */
+
+#include <stdint.h>
+
+#define TELEMETRY_FILE "telemetry.bin"
+#define TELEMETRY_MAGIC 0x4d545344u /* "DSTM" */
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_PAYLOAD_MAX 120
+
+/* Levels are stored in hundredths of a dB, silence as this value. */
+#define TELEMETRY_LEVEL_SILENT INT16_MIN
+
+enum telemetry_type {
+	/* payload: the source name, not terminated */
+	TELEMETRY_SOURCE = 1,
+	/* payload: int16 peak and magnitude pairs per channel */
+	TELEMETRY_LEVELS = 2,
+	/* payload: uint32 latency in microseconds */
+	TELEMETRY_SWITCH = 3,
+	/* no payload, the switch did not deliver in time */
+	TELEMETRY_SWITCH_TIMEOUT = 4,
+	/* payload: uint32 duration in microseconds */
+	TELEMETRY_RESTART = 5,
+	/* payload: the device failed over to, not terminated */
+	TELEMETRY_FAILOVER = 6,
+	/* no payload, back on the primary device */
+	TELEMETRY_FAILBACK = 7,
+	/* payload: uint32 milliseconds without frames or audio */
+	TELEMETRY_IDLE = 8,
+	/* payload: int16 peak */
+	TELEMETRY_CLIP = 9,
+	/* payload: uint32 records dropped since the last one */
+	TELEMETRY_DROPPED = 10,
+};
+
+struct telemetry_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t started;
+	uint64_t wall; /* unix time of started in nanoseconds */
+};
+
+struct telemetry_record {
+	uint64_t ts;
+	uint32_t source;
+	uint8_t type;
+	uint8_t size;
+	uint16_t reserved;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "obs.h"
+#include "util/threading.h"
+#include "event-queue.hpp"
+#include "telemetry.h"
+
+// Records levels and device events to rotating binary files in the module
+// config directory, see telemetry.h for the format. Recording never
+// blocks: records go through a lock-free queue to a writer thread and are
+// counted as dropped when the queue is full, so the audio and UI threads
+// never touch the disk.
+class TelemetryRecorder {
+	struct Item {
+		telemetry_record record;
+		uint8_t payload[TELEMETRY_PAYLOAD_MAX];
+	};
+
+	std::unique_ptr<MpscQueue<Item, 4096>> queue;
+	std::atomic<bool> active{false};
+	std::atomic<uint32_t> nextSource{1};
+	std::atomic<uint32_t> dropped{0};
+	uint64_t levelInterval = 100000000;
+	os_event_t *stop = nullptr;
+	std::thread writer;
+
+	// Writer thread only.
+	FILE *file = nullptr;
+	std::string path;
+	uint64_t written = 0;
+	uint64_t fileSize = 0;
+	int files = 0;
+	std::unordered_map<uint32_t, std::string> sources;
+
+	void Post(uint32_t source, telemetry_type type, const void *payload,
+		  size_t size);
+	void WriterThread();
+	bool OpenFile();
+	void Rotate();
+	void Write(const telemetry_record &record, const void *payload);
+
+public:
+	~TelemetryRecorder();
+
+	// fileSize in bytes per file, files kept including the current one,
+	// levelInterval in nanoseconds. 0 picks the default.
+	bool Start(uint64_t fileSize, int files, uint64_t levelInterval);
+	void Stop();
+	bool Active() const { return active.load(std::memory_order_relaxed); }
+	uint64_t LevelInterval() const { return levelInterval; }
+
+	// Returns the id records of the source use, 0 when not recording.
+	uint32_t AddSource(const char *name);
+	void RenameSource(uint32_t source, const char *name);
+
+	void Levels(uint32_t source, int channels, const float *peak,
+		    const float *magnitude);
+	void Clip(uint32_t source, float peak);
+	void Switch(uint32_t source, uint64_t latency);
+	void SwitchTimeout(uint32_t source);
+	void Restart(uint32_t source, uint64_t duration);
+	void Failover(uint32_t source, const char *device);
+	void Failback(uint32_t source);
+	void Idle(uint32_t source, uint64_t silent);
+};
+
+extern TelemetryRecorder telemetry;
@@ -0,0 +1,75 @@
+/* Runs the dock benchmark headless: the plugin sources linked against the
+ * libobs and frontend fakes in fake-obs, on the offscreen Qt platform, so
+ * no OBS, display or devices are needed.
+ *
+ *   dock-benchmark [sizes]
+ *
+ * sizes is a comma separated list of source counts, 10,100,1000,5000 by
+ * default. The results are printed as CSV: wall time, UI thread time,
+ * throughput and the peak resident size per phase. It exits with 1 when the
+ * benchmark did not finish or anything logged a warning or error, such as
+ * a phase that did not settle or sources that were never released. Build it
+ * with the ENABLE_DOCK_BENCHMARK CMake option. */
+
+#include <obs-module.h>
+#include <QApplication>
+#include <QFile>
+#include <QMainWindow>
+#include <QTemporaryDir>
+#include <stdio.h>
+
+#include "../benchmark.hpp"
+#include "../device-switcher.hpp"
+#include "fake-obs/fake-obs.hpp"
+
+int main(int argc, char **argv)
+{
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication app(argc, argv);
+
+	QTemporaryDir configDir;
+	if (!configDir.isValid()) {
+		fprintf(stderr, "failed to create a config directory\n");
+		return 1;
+	}
+	const QByteArray configPath = configDir.path().toUtf8();
+	fake_obs_startup(FAKE_OBS_DATA_PATH, configPath.constData());
+	fake_config_override("General", "BenchmarkSizes",
+			     argc > 1 ? argv[1] : "10,100,1000,5000");
+	// Nothing meters audio in the fakes, the meter runs need OBS.
+	fake_config_override("General", "BenchmarkMeterSeconds", "0");
+
+	auto mainWindow = new QMainWindow;
+	fake_frontend_startup(mainWindow);
+	obs_module_set_locale("en-US");
+	obs_module_load();
+	benchmark_register();
+	fake_frontend_event(OBS_FRONTEND_EVENT_FINISHED_LOADING);
+
+	if (auto dock = mainWindow->findChild<DeviceSwitcherDock *>()) {
+		DockBenchmark benchmark(dock);
+		benchmark.Start();
+		while (benchmark.Running())
+			app.processEvents(QEventLoop::WaitForMoreEvents);
+	}
+
+	// Written once every phase of every size ended.
+	bool finished = false;
+	QFile results(configDir.filePath(QStringLiteral("benchmark.csv")));
+	if (results.open(QIODevice::ReadOnly)) {
+		const QByteArray csv = results.readAll();
+		fwrite(csv.constData(), 1, (size_t)csv.size(), stdout);
+		finished = true;
+	}
+
+	delete mainWindow;
+	obs_module_unload();
+	obs_module_free_locale();
+	fake_frontend_shutdown();
+	fake_obs_shutdown();
+
+	if (!finished)
+		fprintf(stderr, "benchmark did not finish\n");
+	return finished && !fake_obs_warnings() ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+#include "fake-obs.hpp"
+
+#include <algorithm>
+#include <QDockWidget>
+#include <QMainWindow>
+#include <QTimer>
+#include <utility>
+#include <vector>
+
+#include "util/config-file.h"
+
+static QMainWindow *mainWindow = nullptr;
+static config_t *profileConfig = nullptr;
+static bool virtualCamActive = false;
+static std::vector<std::pair<obs_frontend_event_cb, void *>> eventCallbacks;
+
+void fake_frontend_startup(QMainWindow *main_window)
+{
+	mainWindow = main_window;
+	config_open(&profileConfig, nullptr, CONFIG_OPEN_ALWAYS);
+}
+
+void fake_frontend_shutdown()
+{
+	config_close(profileConfig);
+	profileConfig = nullptr;
+	eventCallbacks.clear();
+	mainWindow = nullptr;
+}
+
+// Callbacks removed by an earlier callback of the same event are skipped.
+void fake_frontend_event(enum obs_frontend_event event)
+{
+	const auto callbacks = eventCallbacks;
+	for (const auto &cb : callbacks) {
+		if (std::find(eventCallbacks.begin(), eventCallbacks.end(),
+			      cb) != eventCallbacks.end())
+			cb.first(event, cb.second);
+	}
+}
+
+void *obs_frontend_get_main_window(void)
+{
+	return mainWindow;
+}
+
+void *obs_frontend_add_dock(void *dock)
+{
+	auto d = static_cast<QDockWidget *>(dock);
+	mainWindow->addDockWidget(Qt::RightDockWidgetArea, d);
+	return d->toggleViewAction();
+}
+
+void obs_frontend_add_event_callback(obs_frontend_event_cb callback,
+				     void *private_data)
+{
+	eventCallbacks.emplace_back(callback, private_data);
+}
+
+void obs_frontend_remove_event_callback(obs_frontend_event_cb callback,
+					void *private_data)
+{
+	auto it = std::find(eventCallbacks.begin(), eventCallbacks.end(),
+			    std::make_pair(callback, private_data));
+	if (it != eventCallbacks.end())
+		eventCallbacks.erase(it);
+}
+
+// Collections are never saved or loaded, the callbacks never run.
+void obs_frontend_add_save_callback(obs_frontend_save_cb callback,
+				    void *private_data)
+{
+	UNUSED_PARAMETER(callback);
+	UNUSED_PARAMETER(private_data);
+}
+
+void obs_frontend_remove_save_callback(obs_frontend_save_cb callback,
+				       void *private_data)
+{
+	UNUSED_PARAMETER(callback);
+	UNUSED_PARAMETER(private_data);
+}
+
+config_t *obs_frontend_get_profile_config(void)
+{
+	return profileConfig;
+}
+
+void obs_frontend_open_source_filters(obs_source_t *source)
+{
+	UNUSED_PARAMETER(source);
+}
+
+void obs_frontend_open_source_properties(obs_source_t *source)
+{
+	UNUSED_PARAMETER(source);
+}
+
+void obs_frontend_push_ui_translation(obs_frontend_translate_ui_cb translate)
+{
+	UNUSED_PARAMETER(translate);
+}
+
+void obs_frontend_pop_ui_translation(void) {}
+
+bool obs_frontend_virtualcam_active(void)
+{
+	return virtualCamActive;
+}
+
+// Reported from the event loop, like the output signals of the frontend.
+void obs_frontend_start_virtualcam(void)
+{
+	if (virtualCamActive)
+		return;
+	virtualCamActive = true;
+	QTimer::singleShot(0, [] {
+		fake_frontend_event(OBS_FRONTEND_EVENT_VIRTUALCAM_STARTED);
+	});
+}
+
+void obs_frontend_stop_virtualcam(void)
+{
+	if (!virtualCamActive)
+		return;
+	virtualCamActive = false;
+	QTimer::singleShot(0, [] {
+		fake_frontend_event(OBS_FRONTEND_EVENT_VIRTUALCAM_STOPPED);
+	});
+}
@@ -0,0 +1,2072 @@
+#include "fake-obs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <errno.h>
+#include <map>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "obs.h"
+#include "util/config-file.h"
+#include "util/platform.h"
+#include "util/profiler.h"
+#include "util/task.h"
+#include "util/threading.h"
+
+static std::string dataPath;
+static std::string configPath;
+static std::atomic<int> warnings{0};
+
+/* ------------------------------------------------------------------------- */
+/* Memory and logging */
+
+void *bmalloc(size_t size)
+{
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr) {
+		fprintf(stderr, "out of memory allocating %zu bytes\n", size);
+		abort();
+	}
+	return ptr;
+}
+
+void *brealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size ? size : 1);
+	if (!ptr) {
+		fprintf(stderr, "out of memory allocating %zu bytes\n", size);
+		abort();
+	}
+	return ptr;
+}
+
+void bfree(void *ptr)
+{
+	free(ptr);
+}
+
+void blogva(int log_level, const char *format, va_list args)
+{
+	const char *level = "info";
+	if (log_level <= LOG_ERROR)
+		level = "error";
+	else if (log_level <= LOG_WARNING)
+		level = "warning";
+	else if (log_level >= LOG_DEBUG)
+		return;
+	if (log_level <= LOG_WARNING)
+		warnings++;
+	char line[4096];
+	vsnprintf(line, sizeof(line), format, args);
+	fprintf(stderr, "%s: %s\n", level, line);
+}
+
+void blog(int log_level, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	blogva(log_level, format, args);
+	va_end(args);
+}
+
+int fake_obs_warnings()
+{
+	return warnings;
+}
+
+void profile_start(const char *name)
+{
+	UNUSED_PARAMETER(name);
+}
+
+void profile_end(const char *name)
+{
+	UNUSED_PARAMETER(name);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Platform */
+
+FILE *os_fopen(const char *path, const char *mode)
+{
+	return path ? fopen(path, mode) : nullptr;
+}
+
+uint64_t os_gettime_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+bool os_sleepto_ns(uint64_t time_target)
+{
+	const uint64_t now = os_gettime_ns();
+	if (time_target <= now)
+		return false;
+	struct timespec ts;
+	ts.tv_sec = (time_t)((time_target - now) / 1000000000ULL);
+	ts.tv_nsec = (long)((time_target - now) % 1000000000ULL);
+	nanosleep(&ts, nullptr);
+	return true;
+}
+
+int os_mkdirs(const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) == 0)
+		return S_ISDIR(st.st_mode) ? MKDIR_EXISTS : MKDIR_ERROR;
+	std::string dir(path);
+	for (size_t pos = dir.find('/', 1); pos != std::string::npos;
+	     pos = dir.find('/', pos + 1)) {
+		const std::string part = dir.substr(0, pos);
+		if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST)
+			return MKDIR_ERROR;
+	}
+	if (mkdir(path, 0755) != 0 && errno != EEXIST)
+		return MKDIR_ERROR;
+	return MKDIR_SUCCESS;
+}
+
+int os_rename(const char *old_path, const char *new_path)
+{
+	return rename(old_path, new_path);
+}
+
+int os_unlink(const char *path)
+{
+	return unlink(path);
+}
+
+uint64_t os_get_proc_resident_size(void)
+{
+	unsigned long size = 0, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+void os_set_thread_name(const char *name)
+{
+	char truncated[16];
+	snprintf(truncated, sizeof(truncated), "%s", name);
+	pthread_setname_np(pthread_self(), truncated);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Events, semaphores and task queues */
+
+struct os_event_data {
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool signalled = false;
+	bool manual = false;
+};
+
+int os_event_init(os_event_t **event, enum os_event_type type)
+{
+	auto e = new os_event_data;
+	e->manual = type == OS_EVENT_TYPE_MANUAL;
+	*event = e;
+	return 0;
+}
+
+void os_event_destroy(os_event_t *event)
+{
+	delete event;
+}
+
+int os_event_wait(os_event_t *event)
+{
+	std::unique_lock<std::mutex> lock(event->mutex);
+	event->cond.wait(lock, [event] { return event->signalled; });
+	if (!event->manual)
+		event->signalled = false;
+	return 0;
+}
+
+int os_event_timedwait(os_event_t *event, unsigned long milliseconds)
+{
+	std::unique_lock<std::mutex> lock(event->mutex);
+	if (!event->cond.wait_for(lock,
+				  std::chrono::milliseconds(milliseconds),
+				  [event] { return event->signalled; }))
+		return ETIMEDOUT;
+	if (!event->manual)
+		event->signalled = false;
+	return 0;
+}
+
+int os_event_signal(os_event_t *event)
+{
+	std::lock_guard<std::mutex> lock(event->mutex);
+	event->signalled = true;
+	if (event->manual)
+		event->cond.notify_all();
+	else
+		event->cond.notify_one();
+	return 0;
+}
+
+struct os_sem_data {
+	std::mutex mutex;
+	std::condition_variable cond;
+	int value = 0;
+};
+
+int os_sem_init(os_sem_t **sem, int value)
+{
+	auto s = new os_sem_data;
+	s->value = value;
+	*sem = s;
+	return 0;
+}
+
+void os_sem_destroy(os_sem_t *sem)
+{
+	delete sem;
+}
+
+int os_sem_post(os_sem_t *sem)
+{
+	std::lock_guard<std::mutex> lock(sem->mutex);
+	sem->value++;
+	sem->cond.notify_one();
+	return 0;
+}
+
+int os_sem_wait(os_sem_t *sem)
+{
+	std::unique_lock<std::mutex> lock(sem->mutex);
+	sem->cond.wait(lock, [sem] { return sem->value > 0; });
+	sem->value--;
+	return 0;
+}
+
+// One worker thread running the tasks in order, a null task ends it.
+struct os_task_queue {
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::pair<os_task_t, void *>> tasks;
+	std::thread thread;
+};
+
+static void task_queue_run(os_task_queue_t *tq)
+{
+	os_set_thread_name("fake task queue");
+	for (;;) {
+		std::pair<os_task_t, void *> task;
+		{
+			std::unique_lock<std::mutex> lock(tq->mutex);
+			tq->cond.wait(lock,
+				      [tq] { return !tq->tasks.empty(); });
+			task = tq->tasks.front();
+			tq->tasks.pop_front();
+		}
+		if (!task.first)
+			return;
+		task.first(task.second);
+	}
+}
+
+os_task_queue_t *os_task_queue_create(void)
+{
+	auto tq = new os_task_queue;
+	tq->thread = std::thread(task_queue_run, tq);
+	return tq;
+}
+
+bool os_task_queue_queue_task(os_task_queue_t *tq, os_task_t task, void *param)
+{
+	if (!tq || !task)
+		return false;
+	std::lock_guard<std::mutex> lock(tq->mutex);
+	tq->tasks.emplace_back(task, param);
+	tq->cond.notify_one();
+	return true;
+}
+
+void os_task_queue_destroy(os_task_queue_t *tq)
+{
+	if (!tq)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(tq->mutex);
+		tq->tasks.emplace_back(nullptr, nullptr);
+		tq->cond.notify_one();
+	}
+	tq->thread.join();
+	delete tq;
+}
+
+static void task_queue_signal(void *param)
+{
+	os_event_signal(static_cast<os_event_t *>(param));
+}
+
+bool os_task_queue_wait(os_task_queue_t *tq)
+{
+	if (!tq)
+		return false;
+	os_event_t *done;
+	os_event_init(&done, OS_EVENT_TYPE_AUTO);
+	os_task_queue_queue_task(tq, task_queue_signal, done);
+	os_event_wait(done);
+	os_event_destroy(done);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Calldata, stored like libobs: name size, name, data size, data, ending
+ * with a zero name size. */
+
+static uint8_t *calldata_find(const calldata_t *data, const char *name)
+{
+	if (!data->stack)
+		return nullptr;
+	uint8_t *pos = data->stack;
+	for (;;) {
+		size_t nameSize;
+		memcpy(&nameSize, pos, sizeof(size_t));
+		if (!nameSize)
+			return nullptr;
+		if (strcmp((const char *)pos + sizeof(size_t), name) == 0)
+			return pos;
+		pos += sizeof(size_t) + nameSize;
+		size_t dataSize;
+		memcpy(&dataSize, pos, sizeof(size_t));
+		pos += sizeof(size_t) + dataSize;
+	}
+}
+
+static size_t calldata_entry_size(const uint8_t *pos)
+{
+	size_t nameSize, dataSize;
+	memcpy(&nameSize, pos, sizeof(size_t));
+	memcpy(&dataSize, pos + sizeof(size_t) + nameSize, sizeof(size_t));
+	return sizeof(size_t) * 2 + nameSize + dataSize;
+}
+
+void calldata_set_data(calldata_t *data, const char *name, const void *in,
+		       size_t new_size)
+{
+	if (!data || !name || !*name)
+		return;
+	if (!data->stack) {
+		data->capacity = 128;
+		data->stack = (uint8_t *)bmalloc(data->capacity);
+		memset(data->stack, 0, sizeof(size_t));
+		data->size = sizeof(size_t);
+	}
+	if (uint8_t *pos = calldata_find(data, name)) {
+		const size_t entry = calldata_entry_size(pos);
+		memmove(pos, pos + entry,
+			data->size - (size_t)(pos - data->stack) - entry);
+		data->size -= entry;
+	}
+
+	const size_t nameSize = strlen(name) + 1;
+	const size_t entry = sizeof(size_t) * 2 + nameSize + new_size;
+	if (data->size + entry > data->capacity) {
+		if (data->fixed)
+			return;
+		data->capacity = std::max(data->capacity * 2,
+					  data->size + entry);
+		data->stack = (uint8_t *)brealloc(data->stack, data->capacity);
+	}
+	uint8_t *pos = data->stack + data->size - sizeof(size_t);
+	memcpy(pos, &nameSize, sizeof(size_t));
+	memcpy(pos + sizeof(size_t), name, nameSize);
+	pos += sizeof(size_t) + nameSize;
+	memcpy(pos, &new_size, sizeof(size_t));
+	if (new_size)
+		memcpy(pos + sizeof(size_t), in, new_size);
+	pos += sizeof(size_t) + new_size;
+	memset(pos, 0, sizeof(size_t));
+	data->size += entry;
+}
+
+bool calldata_get_data(const calldata_t *data, const char *name, void *out,
+		       size_t size)
+{
+	if (!data || !name)
+		return false;
+	const uint8_t *pos = calldata_find(data, name);
+	if (!pos)
+		return false;
+	size_t nameSize, dataSize;
+	memcpy(&nameSize, pos, sizeof(size_t));
+	pos += sizeof(size_t) + nameSize;
+	memcpy(&dataSize, pos, sizeof(size_t));
+	if (dataSize != size)
+		return false;
+	memcpy(out, pos + sizeof(size_t), size);
+	return true;
+}
+
+bool calldata_get_string(const calldata_t *data, const char *name,
+			 const char **str)
+{
+	if (!data || !name)
+		return false;
+	const uint8_t *pos = calldata_find(data, name);
+	if (!pos)
+		return false;
+	size_t nameSize, dataSize;
+	memcpy(&nameSize, pos, sizeof(size_t));
+	pos += sizeof(size_t) + nameSize;
+	memcpy(&dataSize, pos, sizeof(size_t));
+	*str = dataSize ? (const char *)pos + sizeof(size_t) : nullptr;
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Signals, a callback disconnected while a signal is emitted is not called
+ * anymore. */
+
+struct SignalCallback {
+	signal_callback_t callback;
+	void *data;
+	std::shared_ptr<std::atomic<bool>> connected;
+};
+
+struct signal_handler {
+	std::mutex mutex;
+	std::unordered_map<std::string, std::vector<SignalCallback>> signals;
+};
+
+static signal_handler_t *obsSignals = nullptr;
+
+static signal_handler_t *signals_create()
+{
+	return new signal_handler;
+}
+
+static void signals_destroy(signal_handler_t *handler)
+{
+	delete handler;
+}
+
+static void signals_emit(signal_handler_t *handler, const char *signal,
+			 calldata_t *cd)
+{
+	std::vector<SignalCallback> callbacks;
+	{
+		std::lock_guard<std::mutex> lock(handler->mutex);
+		auto it = handler->signals.find(signal);
+		if (it == handler->signals.end())
+			return;
+		callbacks = it->second;
+	}
+	for (const auto &cb : callbacks) {
+		if (*cb.connected)
+			cb.callback(cb.data, cd);
+	}
+}
+
+void signal_handler_connect(signal_handler_t *handler, const char *signal,
+			    signal_callback_t callback, void *data)
+{
+	if (!handler || !signal || !callback)
+		return;
+	std::lock_guard<std::mutex> lock(handler->mutex);
+	auto &callbacks = handler->signals[signal];
+	for (const auto &cb : callbacks) {
+		if (cb.callback == callback && cb.data == data)
+			return;
+	}
+	callbacks.push_back(
+		{callback, data, std::make_shared<std::atomic<bool>>(true)});
+}
+
+void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
+			       signal_callback_t callback, void *data)
+{
+	if (!handler || !signal || !callback)
+		return;
+	std::lock_guard<std::mutex> lock(handler->mutex);
+	auto it = handler->signals.find(signal);
+	if (it == handler->signals.end())
+		return;
+	auto &callbacks = it->second;
+	for (auto cb = callbacks.begin(); cb != callbacks.end(); ++cb) {
+		if (cb->callback == callback && cb->data == data) {
+			*cb->connected = false;
+			callbacks.erase(cb);
+			return;
+		}
+	}
+}
+
+signal_handler_t *obs_get_signal_handler(void)
+{
+	return obsSignals;
+}
+
+/* ------------------------------------------------------------------------- */
+/* obs_data */
+
+enum class DataKind { None, String, Number, Bool, Object, Array };
+
+struct DataValue {
+	DataKind kind = DataKind::None;
+	std::string str;
+	double num = 0.0;
+	bool b = false;
+	obs_data_t *obj = nullptr;
+	obs_data_array_t *array = nullptr;
+
+	DataValue() = default;
+	DataValue(const DataValue &) = delete;
+	DataValue &operator=(const DataValue &) = delete;
+	~DataValue() { Clear(); }
+
+	void Clear();
+	bool Set() const { return kind != DataKind::None; }
+};
+
+struct obs_data_item {
+	obs_data_t *parent;
+	std::string name;
+	DataValue user;
+	DataValue def;
+	DataValue autoselect;
+};
+
+struct obs_data {
+	std::atomic<long> refs{1};
+	std::vector<std::unique_ptr<obs_data_item>> items;
+
+	obs_data_item *Find(const char *name) const
+	{
+		if (!name)
+			return nullptr;
+		for (const auto &item : items) {
+			if (item->name == name)
+				return item.get();
+		}
+		return nullptr;
+	}
+
+	obs_data_item *Get(const char *name)
+	{
+		if (auto item = Find(name))
+			return item;
+		auto item = std::make_unique<obs_data_item>();
+		item->parent = this;
+		item->name = name;
+		items.push_back(std::move(item));
+		return items.back().get();
+	}
+};
+
+struct obs_data_array {
+	std::atomic<long> refs{1};
+	std::vector<obs_data_t *> objects;
+};
+
+void DataValue::Clear()
+{
+	obs_data_release(obj);
+	obs_data_array_release(array);
+	obj = nullptr;
+	array = nullptr;
+	str.clear();
+	kind = DataKind::None;
+}
+
+obs_data_t *obs_data_create(void)
+{
+	return new obs_data;
+}
+
+void obs_data_addref(obs_data_t *data)
+{
+	if (data)
+		data->refs++;
+}
+
+void obs_data_release(obs_data_t *data)
+{
+	if (data && --data->refs == 0)
+		delete data;
+}
+
+obs_data_array_t *obs_data_array_create(void)
+{
+	return new obs_data_array;
+}
+
+void obs_data_array_addref(obs_data_array_t *array)
+{
+	if (array)
+		array->refs++;
+}
+
+void obs_data_array_release(obs_data_array_t *array)
+{
+	if (!array || --array->refs != 0)
+		return;
+	for (auto obj : array->objects)
+		obs_data_release(obj);
+	delete array;
+}
+
+size_t obs_data_array_count(obs_data_array_t *array)
+{
+	return array ? array->objects.size() : 0;
+}
+
+obs_data_t *obs_data_array_item(obs_data_array_t *array, size_t idx)
+{
+	if (!array || idx >= array->objects.size())
+		return nullptr;
+	obs_data_addref(array->objects[idx]);
+	return array->objects[idx];
+}
+
+size_t obs_data_array_push_back(obs_data_array_t *array, obs_data_t *obj)
+{
+	if (!array || !obj)
+		return 0;
+	obs_data_addref(obj);
+	array->objects.push_back(obj);
+	return array->objects.size() - 1;
+}
+
+static void data_value_set_string(DataValue &value, const char *val)
+{
+	value.Clear();
+	value.kind = DataKind::String;
+	value.str = val ? val : "";
+}
+
+static void data_value_set_obj(DataValue &value, obs_data_t *obj)
+{
+	obs_data_addref(obj);
+	value.Clear();
+	value.kind = DataKind::Object;
+	value.obj = obj;
+}
+
+static void data_value_set_array(DataValue &value, obs_data_array_t *array)
+{
+	obs_data_array_addref(array);
+	value.Clear();
+	value.kind = DataKind::Array;
+	value.array = array;
+}
+
+static void data_value_copy(DataValue &to, const DataValue &from)
+{
+	switch (from.kind) {
+	case DataKind::Object:
+		data_value_set_obj(to, from.obj);
+		break;
+	case DataKind::Array:
+		data_value_set_array(to, from.array);
+		break;
+	default:
+		to.Clear();
+		to.kind = from.kind;
+		to.str = from.str;
+		to.num = from.num;
+		to.b = from.b;
+		break;
+	}
+}
+
+// The user value if set, otherwise the default.
+static const DataValue *data_value(obs_data_t *data, const char *name)
+{
+	const obs_data_item *item = data ? data->Find(name) : nullptr;
+	if (!item)
+		return nullptr;
+	if (item->user.Set())
+		return &item->user;
+	if (item->def.Set())
+		return &item->def;
+	return nullptr;
+}
+
+void obs_data_set_string(obs_data_t *data, const char *name, const char *val)
+{
+	if (data && name)
+		data_value_set_string(data->Get(name)->user, val);
+}
+
+void obs_data_set_default_string(obs_data_t *data, const char *name,
+				 const char *val)
+{
+	if (data && name)
+		data_value_set_string(data->Get(name)->def, val);
+}
+
+void obs_data_set_obj(obs_data_t *data, const char *name, obs_data_t *obj)
+{
+	if (data && name)
+		data_value_set_obj(data->Get(name)->user, obj);
+}
+
+void obs_data_set_array(obs_data_t *data, const char *name,
+			obs_data_array_t *array)
+{
+	if (data && name)
+		data_value_set_array(data->Get(name)->user, array);
+}
+
+const char *obs_data_get_string(obs_data_t *data, const char *name)
+{
+	const DataValue *value = data_value(data, name);
+	return value && value->kind == DataKind::String ? value->str.c_str()
+							: "";
+}
+
+bool obs_data_get_bool(obs_data_t *data, const char *name)
+{
+	const DataValue *value = data_value(data, name);
+	return value && value->kind == DataKind::Bool && value->b;
+}
+
+obs_data_t *obs_data_get_obj(obs_data_t *data, const char *name)
+{
+	const DataValue *value = data_value(data, name);
+	if (!value || value->kind != DataKind::Object)
+		return nullptr;
+	obs_data_addref(value->obj);
+	return value->obj;
+}
+
+obs_data_array_t *obs_data_get_array(obs_data_t *data, const char *name)
+{
+	const DataValue *value = data_value(data, name);
+	if (!value || value->kind != DataKind::Array)
+		return nullptr;
+	obs_data_array_addref(value->array);
+	return value->array;
+}
+
+bool obs_data_has_user_value(obs_data_t *data, const char *name)
+{
+	const obs_data_item *item = data ? data->Find(name) : nullptr;
+	return item && item->user.Set();
+}
+
+bool obs_data_has_default_value(obs_data_t *data, const char *name)
+{
+	const obs_data_item *item = data ? data->Find(name) : nullptr;
+	return item && item->def.Set();
+}
+
+bool obs_data_has_autoselect_value(obs_data_t *data, const char *name)
+{
+	const obs_data_item *item = data ? data->Find(name) : nullptr;
+	return item && item->autoselect.Set();
+}
+
+void obs_data_erase(obs_data_t *data, const char *name)
+{
+	if (!data || !name)
+		return;
+	auto &items = data->items;
+	items.erase(std::remove_if(items.begin(), items.end(),
+				   [name](const auto &item) {
+					   return item->name == name;
+				   }),
+		    items.end());
+}
+
+void obs_data_apply(obs_data_t *target, obs_data_t *apply_data)
+{
+	if (!target || !apply_data || target == apply_data)
+		return;
+	for (const auto &item : apply_data->items) {
+		if (item->user.Set())
+			data_value_copy(target->Get(item->name.c_str())->user,
+					item->user);
+	}
+}
+
+obs_data_item_t *obs_data_first(obs_data_t *data)
+{
+	return data && !data->items.empty() ? data->items.front().get()
+					    : nullptr;
+}
+
+bool obs_data_item_next(obs_data_item_t **item)
+{
+	if (!item || !*item)
+		return false;
+	const auto &items = (*item)->parent->items;
+	for (size_t i = 0; i < items.size(); i++) {
+		if (items[i].get() != *item)
+			continue;
+		*item = i + 1 < items.size() ? items[i + 1].get() : nullptr;
+		return *item != nullptr;
+	}
+	*item = nullptr;
+	return false;
+}
+
+const char *obs_data_item_get_name(obs_data_item_t *item)
+{
+	return item ? item->name.c_str() : nullptr;
+}
+
+/* JSON, only the user values are written and nothing is parsed. */
+
+static void json_write_string(std::string &out, const std::string &str)
+{
+	out += '"';
+	for (const unsigned char c : str) {
+		switch (c) {
+		case '"':
+			out += "\\\"";
+			break;
+		case '\\':
+			out += "\\\\";
+			break;
+		case '\n':
+			out += "\\n";
+			break;
+		case '\r':
+			out += "\\r";
+			break;
+		case '\t':
+			out += "\\t";
+			break;
+		default:
+			if (c < 0x20) {
+				char esc[8];
+				snprintf(esc, sizeof(esc), "\\u%04x", c);
+				out += esc;
+			} else {
+				out += (char)c;
+			}
+		}
+	}
+	out += '"';
+}
+
+static void json_write_obj(std::string &out, obs_data_t *data, int depth);
+
+static void json_write_value(std::string &out, const DataValue &value,
+			     int depth)
+{
+	switch (value.kind) {
+	case DataKind::String:
+		json_write_string(out, value.str);
+		break;
+	case DataKind::Number: {
+		char num[32];
+		snprintf(num, sizeof(num), "%.17g", value.num);
+		out += num;
+		break;
+	}
+	case DataKind::Bool:
+		out += value.b ? "true" : "false";
+		break;
+	case DataKind::Object:
+		if (value.obj)
+			json_write_obj(out, value.obj, depth);
+		else
+			out += "null";
+		break;
+	case DataKind::Array: {
+		if (!value.array) {
+			out += "null";
+			break;
+		}
+		out += '[';
+		const auto &objects = value.array->objects;
+		for (size_t i = 0; i < objects.size(); i++) {
+			out += i ? ",\n" : "\n";
+			out.append((size_t)(depth + 1) * 4, ' ');
+			json_write_obj(out, objects[i], depth + 1);
+		}
+		if (!objects.empty()) {
+			out += '\n';
+			out.append((size_t)depth * 4, ' ');
+		}
+		out += ']';
+		break;
+	}
+	default:
+		out += "null";
+	}
+}
+
+static void json_write_obj(std::string &out, obs_data_t *data, int depth)
+{
+	out += '{';
+	bool first = true;
+	for (const auto &item : data->items) {
+		if (!item->user.Set())
+			continue;
+		out += first ? "\n" : ",\n";
+		first = false;
+		out.append((size_t)(depth + 1) * 4, ' ');
+		json_write_string(out, item->name);
+		out += ": ";
+		json_write_value(out, item->user, depth + 1);
+	}
+	if (!first) {
+		out += '\n';
+		out.append((size_t)depth * 4, ' ');
+	}
+	out += '}';
+}
+
+/* The benchmark starts from an empty config directory and never reads back
+ * what it saved, so loading always behaves as if the file were missing. */
+obs_data_t *obs_data_create_from_json_file_safe(const char *json_file,
+						const char *backup_ext)
+{
+	UNUSED_PARAMETER(backup_ext);
+	FILE *f = json_file ? os_fopen(json_file, "rb") : nullptr;
+	if (f) {
+		fclose(f);
+		blog(LOG_WARNING, "fake obs: not loading %s", json_file);
+	}
+	return nullptr;
+}
+
+bool obs_data_save_json_safe(obs_data_t *data, const char *file,
+			     const char *temp_ext, const char *backup_ext)
+{
+	if (!data || !file || !temp_ext || !*temp_ext)
+		return false;
+	std::string json;
+	json_write_obj(json, data, 0);
+	json += '\n';
+
+	const std::string temp = std::string(file) + "." + temp_ext;
+	FILE *f = os_fopen(temp.c_str(), "wb");
+	if (!f)
+		return false;
+	const bool written = fwrite(json.data(), 1, json.size(), f) ==
+			     json.size();
+	if (fclose(f) != 0 || !written) {
+		os_unlink(temp.c_str());
+		return false;
+	}
+	if (backup_ext && *backup_ext) {
+		const std::string backup = std::string(file) + "." +
+					   backup_ext;
+		os_unlink(backup.c_str());
+		os_rename(file, backup.c_str());
+	}
+	return os_rename(temp.c_str(), file) == 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Properties, only lists are used. */
+
+struct obs_property {
+	std::string name;
+	std::string description;
+	std::vector<std::pair<std::string, std::string>> items;
+};
+
+struct obs_properties {
+	std::vector<std::unique_ptr<obs_property>> props;
+};
+
+obs_properties_t *obs_properties_create(void)
+{
+	return new obs_properties;
+}
+
+void obs_properties_destroy(obs_properties_t *props)
+{
+	delete props;
+}
+
+obs_property_t *obs_properties_get(obs_properties_t *props,
+				   const char *property)
+{
+	if (!props || !property)
+		return nullptr;
+	for (const auto &p : props->props) {
+		if (p->name == property)
+			return p.get();
+	}
+	return nullptr;
+}
+
+obs_property_t *obs_properties_add_list(obs_properties_t *props,
+					const char *name,
+					const char *description,
+					enum obs_combo_type type,
+					enum obs_combo_format format)
+{
+	UNUSED_PARAMETER(type);
+	UNUSED_PARAMETER(format);
+	if (!props || !name || obs_properties_get(props, name))
+		return nullptr;
+	auto p = std::make_unique<obs_property>();
+	p->name = name;
+	p->description = description ? description : "";
+	props->props.push_back(std::move(p));
+	return props->props.back().get();
+}
+
+size_t obs_property_list_add_string(obs_property_t *p, const char *name,
+				    const char *val)
+{
+	if (!p)
+		return 0;
+	p->items.emplace_back(name ? name : "", val ? val : "");
+	return p->items.size() - 1;
+}
+
+size_t obs_property_list_item_count(obs_property_t *p)
+{
+	return p ? p->items.size() : 0;
+}
+
+const char *obs_property_list_item_name(obs_property_t *p, size_t idx)
+{
+	return p && idx < p->items.size() ? p->items[idx].first.c_str()
+					  : nullptr;
+}
+
+const char *obs_property_list_item_string(obs_property_t *p, size_t idx)
+{
+	return p && idx < p->items.size() ? p->items[idx].second.c_str()
+					  : nullptr;
+}
+
+const char *obs_property_name(obs_property_t *p)
+{
+	return p ? p->name.c_str() : nullptr;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Sources. The counters live in the weak reference, which outlives the
+ * source while weak references remain, like libobs. */
+
+struct obs_weak_source {
+	std::atomic<long> refs{1};
+	std::atomic<long> weakRefs{1};
+	obs_source_t *source;
+};
+
+struct obs_source {
+	obs_weak_source_t *control;
+	const struct obs_source_info *info;
+	void *data = nullptr;
+	std::string name;
+	bool isPrivate = false;
+	std::atomic<bool> removed{false};
+	obs_data_t *settings = nullptr;
+	obs_data_t *privateSettings = nullptr;
+	signal_handler_t *signals = nullptr;
+	std::atomic<int> showing{0};
+	std::atomic<int> active{0};
+	std::atomic<bool> muted{false};
+	std::atomic<float> volume{1.0f};
+	std::atomic<int> monitoringType{OBS_MONITORING_TYPE_NONE};
+	std::mutex filterMutex;
+	std::vector<obs_source_t *> filters;
+	obs_source_t *parent = nullptr;
+};
+
+static std::mutex sourcesMutex;
+static std::unordered_map<std::string, struct obs_source_info> sourceTypes;
+static std::unordered_map<std::string, obs_source_t *> sourceNames;
+static std::atomic<long> liveSources{0};
+
+void obs_register_source_s(const struct obs_source_info *info, size_t size)
+{
+	if (!info || !info->id)
+		return;
+	struct obs_source_info copy = {};
+	memcpy(&copy, info, std::min(size, sizeof(copy)));
+	std::lock_guard<std::mutex> lock(sourcesMutex);
+	sourceTypes[info->id] = copy;
+}
+
+static const struct obs_source_info *find_source_type(const char *id)
+{
+	std::lock_guard<std::mutex> lock(sourcesMutex);
+	auto it = id ? sourceTypes.find(id) : sourceTypes.end();
+	return it == sourceTypes.end() ? nullptr : &it->second;
+}
+
+// Emits the global and the source signal with the source as parameter.
+static void source_signal(obs_source_t *source, const char *global,
+			  const char *local)
+{
+	calldata_t cd;
+	calldata_init(&cd);
+	calldata_set_ptr(&cd, "source", source);
+	if (global && !source->isPrivate)
+		signals_emit(obsSignals, global, &cd);
+	if (local)
+		signals_emit(source->signals, local, &cd);
+	calldata_free(&cd);
+}
+
+static obs_source_t *source_create(const char *id, const char *name,
+				   obs_data_t *settings, bool isPrivate)
+{
+	const struct obs_source_info *info = find_source_type(id);
+	if (!info) {
+		blog(LOG_ERROR, "fake obs: source type '%s' not found",
+		     id ? id : "");
+		return nullptr;
+	}
+	auto source = new obs_source;
+	source->control = new obs_weak_source;
+	source->control->source = source;
+	source->info = info;
+	source->name = name ? name : "";
+	source->isPrivate = isPrivate;
+	source->signals = signals_create();
+	source->privateSettings = obs_data_create();
+	source->settings = obs_data_create();
+	if (info->get_defaults)
+		info->get_defaults(source->settings);
+	if (info->get_defaults2)
+		info->get_defaults2(info->type_data, source->settings);
+	obs_data_apply(source->settings, settings);
+	liveSources++;
+
+	if (info->create)
+		source->data = info->create(source->settings, source);
+	if (!isPrivate) {
+		std::lock_guard<std::mutex> lock(sourcesMutex);
+		sourceNames[source->name] = source;
+	}
+	source_signal(source, "source_create", nullptr);
+	return source;
+}
+
+obs_source_t *obs_source_create(const char *id, const char *name,
+				obs_data_t *settings, obs_data_t *hotkey_data)
+{
+	UNUSED_PARAMETER(hotkey_data);
+	return source_create(id, name, settings, false);
+}
+
+obs_source_t *obs_source_create_private(const char *id, const char *name,
+					obs_data_t *settings)
+{
+	return source_create(id, name, settings, true);
+}
+
+static void source_unlist(obs_source_t *source)
+{
+	std::lock_guard<std::mutex> lock(sourcesMutex);
+	auto it = sourceNames.find(source->name);
+	if (it != sourceNames.end() && it->second == source)
+		sourceNames.erase(it);
+}
+
+static void source_destroy(obs_source_t *source)
+{
+	source_signal(source, "source_destroy", "destroy");
+	source_unlist(source);
+
+	std::vector<obs_source_t *> filters;
+	{
+		std::lock_guard<std::mutex> lock(source->filterMutex);
+		filters.swap(source->filters);
+	}
+	for (auto filter : filters) {
+		filter->parent = nullptr;
+		obs_source_release(filter);
+	}
+	if (source->info->destroy && source->data)
+		source->info->destroy(source->data);
+	obs_data_release(source->settings);
+	obs_data_release(source->privateSettings);
+	signals_destroy(source->signals);
+	obs_weak_source_release(source->control);
+	delete source;
+	liveSources--;
+}
+
+// A strong reference unless the source is already being destroyed.
+static obs_source_t *control_get_ref(obs_weak_source_t *control)
+{
+	long refs = control->refs.load();
+	while (refs > 0) {
+		if (control->refs.compare_exchange_weak(refs, refs + 1))
+			return control->source;
+	}
+	return nullptr;
+}
+
+obs_source_t *obs_source_get_ref(obs_source_t *source)
+{
+	return source ? control_get_ref(source->control) : nullptr;
+}
+
+void obs_source_release(obs_source_t *source)
+{
+	if (source && --source->control->refs == 0)
+		source_destroy(source);
+}
+
+obs_weak_source_t *obs_source_get_weak_source(obs_source_t *source)
+{
+	if (!source)
+		return nullptr;
+	obs_weak_source_addref(source->control);
+	return source->control;
+}
+
+obs_source_t *obs_weak_source_get_source(obs_weak_source_t *weak)
+{
+	return weak ? control_get_ref(weak) : nullptr;
+}
+
+void obs_weak_source_addref(obs_weak_source_t *weak)
+{
+	if (weak)
+		weak->weakRefs++;
+}
+
+void obs_weak_source_release(obs_weak_source_t *weak)
+{
+	if (weak && --weak->weakRefs == 0)
+		delete weak;
+}
+
+bool obs_weak_source_references_source(obs_weak_source_t *weak,
+				       obs_source_t *source)
+{
+	return weak && source && source->control == weak;
+}
+
+obs_source_t *obs_get_source_by_name(const char *name)
+{
+	if (!name)
+		return nullptr;
+	std::lock_guard<std::mutex> lock(sourcesMutex);
+	auto it = sourceNames.find(name);
+	if (it == sourceNames.end() || it->second->removed)
+		return nullptr;
+	return obs_source_get_ref(it->second);
+}
+
+void obs_source_remove(obs_source_t *source)
+{
+	if (!source || source->removed.exchange(true))
+		return;
+	obs_source_t *s = obs_source_get_ref(source);
+	if (!s)
+		return;
+	source_signal(s, "source_remove", "remove");
+	obs_source_release(s);
+}
+
+void obs_source_load(obs_source_t *source)
+{
+	if (!source)
+		return;
+	if (source->info->load)
+		source->info->load(source->data, source->settings);
+	source_signal(source, "source_load", "load");
+}
+
+void obs_source_save(obs_source_t *source)
+{
+	if (!source)
+		return;
+	if (source->info->save)
+		source->info->save(source->data, source->settings);
+	source_signal(source, "source_save", "save");
+}
+
+void obs_source_set_name(obs_source_t *source, const char *name)
+{
+	if (!source || !name || source->name == name)
+		return;
+	const std::string prev = source->name;
+	if (!source->isPrivate) {
+		source_unlist(source);
+		std::lock_guard<std::mutex> lock(sourcesMutex);
+		sourceNames[name] = source;
+	}
+	source->name = name;
+
+	calldata_t cd;
+	calldata_init(&cd);
+	calldata_set_ptr(&cd, "source", source);
+	calldata_set_string(&cd, "new_name", name);
+	calldata_set_string(&cd, "prev_name", prev.c_str());
+	if (!source->isPrivate)
+		signals_emit(obsSignals, "source_rename", &cd);
+	signals_emit(source->signals, "rename", &cd);
+	calldata_free(&cd);
+}
+
+const char *obs_source_get_name(const obs_source_t *source)
+{
+	return source ? source->name.c_str() : nullptr;
+}
+
+const char *obs_source_get_id(const obs_source_t *source)
+{
+	return source ? source->info->id : nullptr;
+}
+
+const char *obs_source_get_unversioned_id(const obs_source_t *source)
+{
+	return source ? source->info->id : nullptr;
+}
+
+uint32_t obs_source_get_output_flags(const obs_source_t *source)
+{
+	return source ? source->info->output_flags : 0;
+}
+
+enum obs_icon_type obs_source_get_icon_type(const char *id)
+{
+	const struct obs_source_info *info = find_source_type(id);
+	return info ? info->icon_type : OBS_ICON_TYPE_UNKNOWN;
+}
+
+// Only sources are handed out as objects.
+void *obs_obj_get_data(void *obj)
+{
+	return obj ? static_cast<obs_source_t *>(obj)->data : nullptr;
+}
+
+obs_data_t *obs_source_get_settings(const obs_source_t *source)
+{
+	if (!source)
+		return nullptr;
+	obs_data_addref(source->settings);
+	return source->settings;
+}
+
+obs_data_t *obs_source_get_private_settings(obs_source_t *source)
+{
+	if (!source)
+		return nullptr;
+	obs_data_addref(source->privateSettings);
+	return source->privateSettings;
+}
+
+void obs_source_update(obs_source_t *source, obs_data_t *settings)
+{
+	if (!source)
+		return;
+	obs_data_apply(source->settings, settings);
+	if (source->info->update)
+		source->info->update(source->data, source->settings);
+	source_signal(source, nullptr, "update");
+}
+
+obs_properties_t *obs_source_properties(const obs_source_t *source)
+{
+	if (!source)
+		return nullptr;
+	if (source->info->get_properties2)
+		return source->info->get_properties2(source->data,
+						     source->info->type_data);
+	if (source->info->get_properties)
+		return source->info->get_properties(source->data);
+	return nullptr;
+}
+
+signal_handler_t *obs_source_get_signal_handler(const obs_source_t *source)
+{
+	return source ? source->signals : nullptr;
+}
+
+bool obs_source_active(const obs_source_t *source)
+{
+	return source && source->active > 0;
+}
+
+bool obs_source_showing(const obs_source_t *source)
+{
+	return source && source->showing > 0;
+}
+
+bool obs_source_audio_active(const obs_source_t *source)
+{
+	return source &&
+	       (source->info->output_flags & OBS_SOURCE_AUDIO) != 0;
+}
+
+void obs_source_inc_showing(obs_source_t *source)
+{
+	if (source && source->showing++ == 0)
+		source_signal(source, nullptr, "show");
+}
+
+void obs_source_dec_showing(obs_source_t *source)
+{
+	if (source && --source->showing == 0)
+		source_signal(source, nullptr, "hide");
+}
+
+bool obs_source_muted(const obs_source_t *source)
+{
+	return source && source->muted;
+}
+
+void obs_source_set_muted(obs_source_t *source, bool muted)
+{
+	if (!source || source->muted.exchange(muted) == muted)
+		return;
+	calldata_t cd;
+	calldata_init(&cd);
+	calldata_set_ptr(&cd, "source", source);
+	calldata_set_bool(&cd, "muted", muted);
+	signals_emit(source->signals, "mute", &cd);
+	calldata_free(&cd);
+}
+
+float obs_source_get_volume(const obs_source_t *source)
+{
+	return source ? source->volume.load() : 0.0f;
+}
+
+void obs_source_set_volume(obs_source_t *source, float volume)
+{
+	if (!source)
+		return;
+	source->volume = volume;
+	calldata_t cd;
+	calldata_init(&cd);
+	calldata_set_ptr(&cd, "source", source);
+	calldata_set_float(&cd, "volume", volume);
+	signals_emit(source->signals, "volume", &cd);
+	calldata_free(&cd);
+}
+
+enum obs_monitoring_type
+obs_source_get_monitoring_type(const obs_source_t *source)
+{
+	return source ? (enum obs_monitoring_type)source->monitoringType.load()
+		      : OBS_MONITORING_TYPE_NONE;
+}
+
+void obs_source_set_monitoring_type(obs_source_t *source,
+				    enum obs_monitoring_type type)
+{
+	if (source)
+		source->monitoringType = type;
+}
+
+uint32_t obs_source_get_width(obs_source_t *source)
+{
+	UNUSED_PARAMETER(source);
+	return 0;
+}
+
+uint32_t obs_source_get_height(obs_source_t *source)
+{
+	UNUSED_PARAMETER(source);
+	return 0;
+}
+
+void obs_source_enum_filters(obs_source_t *source,
+			     obs_source_enum_proc_t callback, void *param)
+{
+	if (!source || !callback)
+		return;
+	std::vector<obs_source_t *> filters;
+	{
+		std::lock_guard<std::mutex> lock(source->filterMutex);
+		filters = source->filters;
+	}
+	for (auto filter : filters)
+		callback(source, filter, param);
+}
+
+void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
+{
+	if (!source || !filter || filter->parent)
+		return;
+	filter = obs_source_get_ref(filter);
+	if (!filter)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(source->filterMutex);
+		source->filters.push_back(filter);
+	}
+	filter->parent = source;
+	calldata_t cd;
+	calldata_init(&cd);
+	calldata_set_ptr(&cd, "source", source);
+	calldata_set_ptr(&cd, "filter", filter);
+	signals_emit(source->signals, "filter_add", &cd);
+	calldata_free(&cd);
+}
+
+void obs_source_filter_remove(obs_source_t *source, obs_source_t *filter)
+{
+	if (!source || !filter)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(source->filterMutex);
+		auto it = std::find(source->filters.begin(),
+				    source->filters.end(), filter);
+		if (it == source->filters.end())
+			return;
+		source->filters.erase(it);
+	}
+	calldata_t cd;
+	calldata_init(&cd);
+	calldata_set_ptr(&cd, "source", source);
+	calldata_set_ptr(&cd, "filter", filter);
+	signals_emit(source->signals, "filter_remove", &cd);
+	calldata_free(&cd);
+	filter->parent = nullptr;
+	obs_source_release(filter);
+}
+
+obs_source_t *obs_source_get_filter_by_name(obs_source_t *source,
+					    const char *name)
+{
+	if (!source || !name)
+		return nullptr;
+	std::lock_guard<std::mutex> lock(source->filterMutex);
+	for (auto filter : source->filters) {
+		if (filter->name == name)
+			return obs_source_get_ref(filter);
+	}
+	return nullptr;
+}
+
+obs_source_t *obs_filter_get_parent(const obs_source_t *filter)
+{
+	return filter ? filter->parent : nullptr;
+}
+
+// Nothing produces audio or video, so the callbacks are never called and
+// output goes nowhere.
+void obs_source_add_audio_capture_callback(obs_source_t *source,
+					   obs_source_audio_capture_t callback,
+					   void *param)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(callback);
+	UNUSED_PARAMETER(param);
+}
+
+void obs_source_remove_audio_capture_callback(
+	obs_source_t *source, obs_source_audio_capture_t callback, void *param)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(callback);
+	UNUSED_PARAMETER(param);
+}
+
+void obs_source_output_audio(obs_source_t *source,
+			     const struct obs_source_audio *audio)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(audio);
+}
+
+void obs_source_output_video(obs_source_t *source,
+			     const struct obs_source_frame *frame)
+{
+	UNUSED_PARAMETER(source);
+	UNUSED_PARAMETER(frame);
+}
+
+void obs_source_video_render(obs_source_t *source)
+{
+	UNUSED_PARAMETER(source);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Audio, volmeters and graphics without a pipeline behind them. */
+
+struct audio_output {
+	size_t channels;
+	uint32_t sampleRate;
+};
+
+static audio_t fakeAudio = {2, 48000};
+static std::mutex monitoringMutex;
+static std::string monitoringName = "Default";
+static std::string monitoringId = "default";
+
+audio_t *obs_get_audio(void)
+{
+	return &fakeAudio;
+}
+
+bool obs_get_audio_info(struct obs_audio_info *oai)
+{
+	if (!oai)
+		return false;
+	oai->samples_per_sec = fakeAudio.sampleRate;
+	oai->speakers = SPEAKERS_STEREO;
+	return true;
+}
+
+size_t audio_output_get_channels(const audio_t *audio)
+{
+	return audio ? audio->channels : 0;
+}
+
+uint32_t audio_output_get_sample_rate(const audio_t *audio)
+{
+	return audio ? audio->sampleRate : 0;
+}
+
+void obs_enum_audio_monitoring_devices(obs_enum_audio_device_cb cb,
+				       void *data)
+{
+	if (cb)
+		cb(data, "Fake Monitoring Device", "fake-monitoring");
+}
+
+void obs_get_audio_monitoring_device(const char **name, const char **id)
+{
+	std::lock_guard<std::mutex> lock(monitoringMutex);
+	if (name)
+		*name = monitoringName.c_str();
+	if (id)
+		*id = monitoringId.c_str();
+}
+
+bool obs_set_audio_monitoring_device(const char *name, const char *id)
+{
+	if (!name || !id)
+		return false;
+	std::lock_guard<std::mutex> lock(monitoringMutex);
+	monitoringName = name;
+	monitoringId = id;
+	return true;
+}
+
+float obs_db_to_mul(float db)
+{
+	return isfinite(db) ? powf(10.0f, db / 20.0f) : 0.0f;
+}
+
+float obs_mul_to_db(float mul)
+{
+	return mul == 0.0f ? -INFINITY : 20.0f * log10f(mul);
+}
+
+struct obs_volmeter {
+	enum obs_peak_meter_type peakMeterType = SAMPLE_PEAK_METER;
+	obs_source_t *source = nullptr;
+};
+
+obs_volmeter_t *obs_volmeter_create(enum obs_fader_type type)
+{
+	UNUSED_PARAMETER(type);
+	return new obs_volmeter;
+}
+
+void obs_volmeter_destroy(obs_volmeter_t *volmeter)
+{
+	delete volmeter;
+}
+
+bool obs_volmeter_attach_source(obs_volmeter_t *volmeter,
+				obs_source_t *source)
+{
+	if (!volmeter || !source)
+		return false;
+	volmeter->source = source;
+	return true;
+}
+
+void obs_volmeter_detach_source(obs_volmeter_t *volmeter)
+{
+	if (volmeter)
+		volmeter->source = nullptr;
+}
+
+void obs_volmeter_set_peak_meter_type(obs_volmeter_t *volmeter,
+				      enum obs_peak_meter_type peak_meter_type)
+{
+	if (volmeter)
+		volmeter->peakMeterType = peak_meter_type;
+}
+
+int obs_volmeter_get_nr_channels(obs_volmeter_t *volmeter)
+{
+	return volmeter && volmeter->source ? (int)fakeAudio.channels : 0;
+}
+
+void obs_volmeter_add_callback(obs_volmeter_t *volmeter,
+			       obs_volmeter_updated_t callback, void *param)
+{
+	UNUSED_PARAMETER(volmeter);
+	UNUSED_PARAMETER(callback);
+	UNUSED_PARAMETER(param);
+}
+
+void obs_volmeter_remove_callback(obs_volmeter_t *volmeter,
+				  obs_volmeter_updated_t callback, void *param)
+{
+	UNUSED_PARAMETER(volmeter);
+	UNUSED_PARAMETER(callback);
+	UNUSED_PARAMETER(param);
+}
+
+void obs_add_main_render_callback(void (*draw)(void *param, uint32_t cx,
+					       uint32_t cy),
+				  void *param)
+{
+	UNUSED_PARAMETER(draw);
+	UNUSED_PARAMETER(param);
+}
+
+void obs_remove_main_render_callback(void (*draw)(void *param, uint32_t cx,
+						  uint32_t cy),
+				     void *param)
+{
+	UNUSED_PARAMETER(draw);
+	UNUSED_PARAMETER(param);
+}
+
+void obs_enter_graphics(void) {}
+
+void obs_leave_graphics(void) {}
+
+struct gs_texture_render {
+	int unused;
+};
+
+gs_texrender_t *gs_texrender_create(enum gs_color_format format,
+				    enum gs_zstencil_format zsformat)
+{
+	UNUSED_PARAMETER(format);
+	UNUSED_PARAMETER(zsformat);
+	return new gs_texture_render;
+}
+
+void gs_texrender_destroy(gs_texrender_t *texrender)
+{
+	delete texrender;
+}
+
+bool gs_texrender_begin(gs_texrender_t *texrender, uint32_t cx, uint32_t cy)
+{
+	UNUSED_PARAMETER(texrender);
+	UNUSED_PARAMETER(cx);
+	UNUSED_PARAMETER(cy);
+	return false;
+}
+
+void gs_texrender_end(gs_texrender_t *texrender)
+{
+	UNUSED_PARAMETER(texrender);
+}
+
+void gs_texrender_reset(gs_texrender_t *texrender)
+{
+	UNUSED_PARAMETER(texrender);
+}
+
+void gs_ortho(float left, float right, float top, float bottom, float znear,
+	      float zfar)
+{
+	UNUSED_PARAMETER(left);
+	UNUSED_PARAMETER(right);
+	UNUSED_PARAMETER(top);
+	UNUSED_PARAMETER(bottom);
+	UNUSED_PARAMETER(znear);
+	UNUSED_PARAMETER(zfar);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Config files, read once and kept in memory. */
+
+typedef std::map<std::string, std::map<std::string, std::string>> ConfigMap;
+
+struct config_data {
+	std::string file;
+	ConfigMap sections;
+};
+
+static ConfigMap configOverrides;
+
+static std::string trim(const std::string &str)
+{
+	const size_t start = str.find_first_not_of(" \t\r\n");
+	if (start == std::string::npos)
+		return std::string();
+	const size_t end = str.find_last_not_of(" \t\r\n");
+	return str.substr(start, end - start + 1);
+}
+
+static bool read_ini(const char *file, ConfigMap &sections)
+{
+	FILE *f = os_fopen(file, "rb");
+	if (!f)
+		return false;
+	std::string section;
+	char buffer[4096];
+	while (fgets(buffer, sizeof(buffer), f)) {
+		std::string line = trim(buffer);
+		if (line.empty() || line[0] == ';' || line[0] == '#')
+			continue;
+		if (line[0] == '[') {
+			const size_t close = line.find(']');
+			section = line.substr(1, close == std::string::npos
+							 ? std::string::npos
+							 : close - 1);
+			continue;
+		}
+		const size_t eq = line.find('=');
+		if (eq == std::string::npos || section.empty())
+			continue;
+		sections[section][trim(line.substr(0, eq))] =
+			trim(line.substr(eq + 1));
+	}
+	fclose(f);
+	return true;
+}
+
+void fake_config_override(const char *section, const char *name,
+			  const char *value)
+{
+	configOverrides[section][name] = value;
+}
+
+int config_open(config_t **config, const char *file,
+		enum config_open_type open_type)
+{
+	if (!config)
+		return CONFIG_ERROR;
+	*config = nullptr;
+	auto c = new config_data;
+	c->file = file ? file : "";
+	if (!file || !read_ini(file, c->sections)) {
+		if (open_type != CONFIG_OPEN_ALWAYS) {
+			delete c;
+			return CONFIG_FILENOTFOUND;
+		}
+	}
+	for (const auto &section : configOverrides) {
+		for (const auto &value : section.second)
+			c->sections[section.first][value.first] = value.second;
+	}
+	*config = c;
+	return CONFIG_SUCCESS;
+}
+
+int config_save(config_t *config)
+{
+	return config ? CONFIG_SUCCESS : CONFIG_ERROR;
+}
+
+void config_close(config_t *config)
+{
+	delete config;
+}
+
+static const std::string *config_value(config_t *config, const char *section,
+				       const char *name)
+{
+	if (!config || !section || !name)
+		return nullptr;
+	auto s = config->sections.find(section);
+	if (s == config->sections.end())
+		return nullptr;
+	auto v = s->second.find(name);
+	return v == s->second.end() ? nullptr : &v->second;
+}
+
+const char *config_get_string(config_t *config, const char *section,
+			      const char *name)
+{
+	const std::string *value = config_value(config, section, name);
+	return value ? value->c_str() : nullptr;
+}
+
+int64_t config_get_int(config_t *config, const char *section,
+		       const char *name)
+{
+	const std::string *value = config_value(config, section, name);
+	return value ? strtoll(value->c_str(), nullptr, 10) : 0;
+}
+
+uint64_t config_get_uint(config_t *config, const char *section,
+			 const char *name)
+{
+	const std::string *value = config_value(config, section, name);
+	return value ? strtoull(value->c_str(), nullptr, 10) : 0;
+}
+
+bool config_get_bool(config_t *config, const char *section, const char *name)
+{
+	const std::string *value = config_value(config, section, name);
+	if (!value)
+		return false;
+	return strcasecmp(value->c_str(), "true") == 0 ||
+	       strtoul(value->c_str(), nullptr, 10) != 0;
+}
+
+void config_set_string(config_t *config, const char *section,
+		       const char *name, const char *value)
+{
+	if (config && section && name)
+		config->sections[section][name] = value ? value : "";
+}
+
+void config_set_bool(config_t *config, const char *section, const char *name,
+		     bool value)
+{
+	config_set_string(config, section, name, value ? "true" : "false");
+}
+
+bool config_has_user_value(config_t *config, const char *section,
+			   const char *name)
+{
+	return config_value(config, section, name) != nullptr;
+}
+
+bool config_remove_value(config_t *config, const char *section,
+			 const char *name)
+{
+	if (!config || !section || !name)
+		return false;
+	auto s = config->sections.find(section);
+	return s != config->sections.end() && s->second.erase(name) > 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Module files and locale */
+
+struct text_lookup {
+	std::unordered_map<std::string, std::string> strings;
+};
+
+static bool read_locale(const std::string &file, lookup_t *lookup)
+{
+	ConfigMap sections;
+	FILE *f = os_fopen(file.c_str(), "rb");
+	if (!f)
+		return false;
+	char buffer[4096];
+	while (fgets(buffer, sizeof(buffer), f)) {
+		const std::string line = trim(buffer);
+		const size_t eq = line.find('=');
+		if (line.empty() || line[0] == '#' || line[0] == ';' ||
+		    eq == std::string::npos)
+			continue;
+		std::string value = trim(line.substr(eq + 1));
+		if (value.size() >= 2 && value.front() == '"' &&
+		    value.back() == '"')
+			value = value.substr(1, value.size() - 2);
+		std::string unescaped;
+		for (size_t i = 0; i < value.size(); i++) {
+			if (value[i] == '\\' && i + 1 < value.size() &&
+			    value[i + 1] == 'n') {
+				unescaped += '\n';
+				i++;
+			} else {
+				unescaped += value[i];
+			}
+		}
+		lookup->strings[trim(line.substr(0, eq))] = unescaped;
+	}
+	fclose(f);
+	return true;
+}
+
+lookup_t *obs_module_load_locale(obs_module_t *module,
+				 const char *default_locale, const char *locale)
+{
+	UNUSED_PARAMETER(module);
+	auto lookup = new text_lookup;
+	const std::string dir = dataPath + "/locale/";
+	if (!read_locale(dir + default_locale + ".ini", lookup)) {
+		blog(LOG_WARNING, "fake obs: no %s locale in %s",
+		     default_locale, dir.c_str());
+		delete lookup;
+		return nullptr;
+	}
+	if (locale && strcmp(locale, default_locale) != 0)
+		read_locale(dir + locale + ".ini", lookup);
+	return lookup;
+}
+
+bool text_lookup_getstr(lookup_t *lookup, const char *lookup_val,
+			const char **out)
+{
+	if (!lookup || !lookup_val)
+		return false;
+	auto it = lookup->strings.find(lookup_val);
+	if (it == lookup->strings.end())
+		return false;
+	*out = it->second.c_str();
+	return true;
+}
+
+void text_lookup_destroy(lookup_t *lookup)
+{
+	delete lookup;
+}
+
+static char *path_dup(const std::string &path)
+{
+	char *out = (char *)bmalloc(path.size() + 1);
+	memcpy(out, path.c_str(), path.size() + 1);
+	return out;
+}
+
+char *obs_find_module_file(obs_module_t *module, const char *file)
+{
+	UNUSED_PARAMETER(module);
+	const std::string path = dataPath + "/" + (file ? file : "");
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? path_dup(path) : nullptr;
+}
+
+char *obs_module_get_config_path(obs_module_t *module, const char *file)
+{
+	UNUSED_PARAMETER(module);
+	return path_dup(configPath + "/" + (file ? file : ""));
+}
+
+/* ------------------------------------------------------------------------- */
+
+void fake_obs_startup(const char *data_path, const char *config_path)
+{
+	dataPath = data_path;
+	configPath = config_path;
+	obsSignals = signals_create();
+}
+
+void fake_obs_shutdown()
+{
+	if (const long leaked = liveSources.load())
+		blog(LOG_WARNING, "fake obs: %ld sources not released",
+		     leaked);
+	signals_destroy(obsSignals);
+	obsSignals = nullptr;
+	configOverrides.clear();
+}
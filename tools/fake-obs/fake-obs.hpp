@@ -0,0 +1,29 @@
+#pragma once
+
+#include <obs-frontend-api.h>
+
+class QMainWindow;
+
+// In-repo stand-ins for the parts of libobs and the frontend API the
+// plugin calls, so its sources run headless without OBS. Sources, weak
+// references, signals, obs_data, properties, config files, locale lookup
+// and the threading helpers behave like libobs. There is no audio, video
+// or graphics pipeline: volmeters never report, audio capture callbacks
+// never fire and rendering does nothing.
+
+// Module files and the locale are read from data_path, config paths point
+// into config_path.
+void fake_obs_startup(const char *data_path, const char *config_path);
+void fake_obs_shutdown();
+
+// Applied on top of every config file opened after the call. Config files
+// are never written back.
+void fake_config_override(const char *section, const char *name,
+			  const char *value);
+
+// Warnings and errors logged so far.
+int fake_obs_warnings();
+
+void fake_frontend_startup(QMainWindow *main_window);
+void fake_frontend_shutdown();
+void fake_frontend_event(enum obs_frontend_event event);
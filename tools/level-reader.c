@@ -0,0 +1,108 @@
+/* Prints the levels the Device Switcher dock exports to shared memory,
+ * to check the export or as a starting point for other readers.
+ *
+ *   level-reader [-o] [-i interval_ms]
+ *
+ * -o prints one snapshot and exits, otherwise the levels are printed
+ * every interval, 50 ms by default. Build it with the ENABLE_LEVEL_READER
+ * CMake option or on its own:
+ *
+ *   cc -O2 -I.. level-reader.c -o level-reader -lrt */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../level-export.h"
+
+static void print_levels(struct level_export_header *header)
+{
+	struct level_export_entry *entries = level_export_entries(header);
+	struct level_export_entry entry;
+	for (uint32_t i = 0; i < header->capacity; i++) {
+		if (!level_export_read(&entries[i], &entry) || !entry.name[0] ||
+		    !entry.channels)
+			continue;
+		printf("%-32.*s", LEVEL_EXPORT_NAME_SIZE, entry.name);
+		for (uint32_t ch = 0; ch < entry.channels; ch++)
+			printf(" %6.1f/%6.1f", entry.peak[ch],
+			       entry.magnitude[ch]);
+		printf("\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int once = 0;
+	long interval = 50;
+	int opt;
+	while ((opt = getopt(argc, argv, "oi:")) != -1) {
+		if (opt == 'o') {
+			once = 1;
+		} else if (opt == 'i') {
+			interval = strtol(optarg, NULL, 10);
+		} else {
+			fprintf(stderr, "usage: %s [-o] [-i interval_ms]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (interval <= 0)
+		interval = 50;
+
+	const int fd = shm_open(LEVEL_EXPORT_NAME, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", LEVEL_EXPORT_NAME,
+			strerror(errno));
+		return 1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < LEVEL_EXPORT_SIZE) {
+		fprintf(stderr, "%s: too small\n", LEVEL_EXPORT_NAME);
+		close(fd);
+		return 1;
+	}
+	void *memory = mmap(NULL, LEVEL_EXPORT_SIZE, PROT_READ, MAP_SHARED, fd,
+			    0);
+	close(fd);
+	if (memory == MAP_FAILED) {
+		fprintf(stderr, "%s: %s\n", LEVEL_EXPORT_NAME,
+			strerror(errno));
+		return 1;
+	}
+	struct level_export_header *header = memory;
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) !=
+		    LEVEL_EXPORT_MAGIC ||
+	    header->version != LEVEL_EXPORT_VERSION ||
+	    header->entry_size != sizeof(struct level_export_entry)) {
+		fprintf(stderr, "%s: unknown layout\n", LEVEL_EXPORT_NAME);
+		munmap(memory, LEVEL_EXPORT_SIZE);
+		return 1;
+	}
+
+	const struct timespec wait = {interval / 1000,
+				      (interval % 1000) * 1000000};
+	for (;;) {
+		if (!once)
+			printf("\033[H\033[J");
+		print_levels(header);
+		fflush(stdout);
+		if (once)
+			break;
+		nanosleep(&wait, NULL);
+		if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) !=
+		    LEVEL_EXPORT_MAGIC) {
+			fprintf(stderr, "%s: closed\n", LEVEL_EXPORT_NAME);
+			break;
+		}
+	}
+	munmap(memory, LEVEL_EXPORT_SIZE);
+	return 0;
+}
@@ -0,0 +1,179 @@
+/* Converts the telemetry files the Device Switcher dock records to CSV.
+ *
+ *   telemetry-csv telemetry.3.bin telemetry.2.bin ... telemetry.bin > out.csv
+ *
+ * Pass the files oldest first. Each row has the wall clock time in
+ * seconds, the source name, the event, its value and details. Levels
+ * rows hold the highest peak as value and peak/magnitude of every channel
+ * in dB as details. Build it with the ENABLE_TELEMETRY_CSV CMake option or
+ * on its own:
+ *
+ *   cc -O2 -I.. telemetry-csv.c -o telemetry-csv */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../telemetry.h"
+
+#define MAX_SOURCES 4096
+
+static char *names[MAX_SOURCES];
+
+static const char *source_name(uint32_t source)
+{
+	if (source < MAX_SOURCES && names[source])
+		return names[source];
+	return "";
+}
+
+static void set_source_name(uint32_t source, const uint8_t *name,
+			    uint8_t size)
+{
+	if (source >= MAX_SOURCES)
+		return;
+	free(names[source]);
+	names[source] = malloc(size + 1);
+	if (!names[source])
+		return;
+	memcpy(names[source], name, size);
+	names[source][size] = 0;
+}
+
+static void print_quoted(const char *text, size_t size)
+{
+	putchar('"');
+	for (size_t i = 0; i < size && text[i]; i++) {
+		if (text[i] == '"')
+			putchar('"');
+		putchar(text[i]);
+	}
+	putchar('"');
+}
+
+static double level(int16_t value)
+{
+	return value == TELEMETRY_LEVEL_SILENT ? -INFINITY : value / 100.0;
+}
+
+static uint32_t payload_u32(const uint8_t *payload, uint8_t size)
+{
+	uint32_t value = 0;
+	if (size >= sizeof(value))
+		memcpy(&value, payload, sizeof(value));
+	return value;
+}
+
+static void print_record(const struct telemetry_file_header *header,
+			 const struct telemetry_record *record,
+			 const uint8_t *payload)
+{
+	if (record->type == TELEMETRY_SOURCE) {
+		set_source_name(record->source, payload, record->size);
+		return;
+	}
+	const double time =
+		(header->wall + (double)(int64_t)(record->ts - header->started)) /
+		1e9;
+	printf("%.3f,", time);
+	const char *name = source_name(record->source);
+	print_quoted(name, strlen(name));
+
+	switch (record->type) {
+	case TELEMETRY_LEVELS: {
+		int16_t values[TELEMETRY_PAYLOAD_MAX / 2];
+		const size_t size = record->size < sizeof(values)
+					    ? record->size
+					    : sizeof(values);
+		const int channels = (int)(size / 4);
+		memcpy(values, payload, size);
+		double max = -INFINITY;
+		for (int ch = 0; ch < channels; ch++) {
+			if (level(values[ch * 2]) > max)
+				max = level(values[ch * 2]);
+		}
+		printf(",levels,%.2f,", max);
+		for (int ch = 0; ch < channels; ch++)
+			printf("%s%.2f/%.2f", ch ? " " : "",
+			       level(values[ch * 2]),
+			       level(values[ch * 2 + 1]));
+		printf("\n");
+		break;
+	}
+	case TELEMETRY_SWITCH:
+		printf(",switch,%.3f,\n",
+		       payload_u32(payload, record->size) / 1000.0);
+		break;
+	case TELEMETRY_SWITCH_TIMEOUT:
+		printf(",switch_timeout,,\n");
+		break;
+	case TELEMETRY_RESTART:
+		printf(",restart,%.3f,\n",
+		       payload_u32(payload, record->size) / 1000.0);
+		break;
+	case TELEMETRY_FAILOVER:
+		printf(",failover,,");
+		print_quoted((const char *)payload, record->size);
+		printf("\n");
+		break;
+	case TELEMETRY_FAILBACK:
+		printf(",failback,,\n");
+		break;
+	case TELEMETRY_IDLE:
+		printf(",idle,%u,\n", payload_u32(payload, record->size));
+		break;
+	case TELEMETRY_CLIP: {
+		int16_t peak = TELEMETRY_LEVEL_SILENT;
+		if (record->size >= sizeof(peak))
+			memcpy(&peak, payload, sizeof(peak));
+		printf(",clip,%.2f,\n", level(peak));
+		break;
+	}
+	case TELEMETRY_DROPPED:
+		printf(",dropped,%u,\n", payload_u32(payload, record->size));
+		break;
+	default:
+		printf(",unknown_%u,,\n", record->type);
+		break;
+	}
+}
+
+static int convert(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return 0;
+	}
+	struct telemetry_file_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+	    header.magic != TELEMETRY_MAGIC ||
+	    header.version != TELEMETRY_VERSION) {
+		fprintf(stderr, "%s: not a telemetry file\n", path);
+		fclose(file);
+		return 0;
+	}
+	struct telemetry_record record;
+	uint8_t payload[256];
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		if (record.size && fread(payload, record.size, 1, file) != 1)
+			break; /* cut off while recording */
+		print_record(&header, &record, payload);
+	}
+	fclose(file);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s file...\n", argv[0]);
+		return 2;
+	}
+	printf("time,source,event,value,details\n");
+	int failed = 0;
+	for (int i = 1; i < argc; i++)
+		failed |= !convert(argv[i]);
+	return failed;
+}
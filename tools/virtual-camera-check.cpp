@@ -0,0 +1,162 @@
+/* Drives the virtual camera keeper through scene collection changes in
+ * restart and keep mode, with stub frontend calls and a manual clock, and
+ * checks the stops, starts and downtime it produces. No frontend or
+ * virtual camera device is needed. Build it with the
+ * ENABLE_VIRTUALCAM_CHECK CMake option and run it directly or through
+ * ctest, it exits with 1 when a check fails. */
+
+#include <stdio.h>
+
+#include "../virtual-camera.hpp"
+
+#define MS 1000000ULL
+
+static struct {
+	bool active;
+	int starts;
+	int stops;
+	uint64_t now;
+} cam;
+
+static bool cam_active(void)
+{
+	return cam.active;
+}
+
+static void cam_start(void)
+{
+	cam.starts++;
+}
+
+static void cam_stop(void)
+{
+	cam.stops++;
+}
+
+static uint64_t cam_now(void)
+{
+	return cam.now;
+}
+
+static const VirtualCamOps stubOps = {cam_active, cam_start, cam_stop,
+				      cam_now};
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		fprintf(stderr, "FAIL %s\n", what);
+		failures++;
+	}
+}
+
+static void reset(bool active)
+{
+	cam.active = active;
+	cam.starts = 0;
+	cam.stops = 0;
+	cam.now = 1000 * MS;
+}
+
+// The frontend reports the stop, the keeper starts the camera again and
+// the time until it reports started is the downtime.
+static void restart_mode()
+{
+	reset(true);
+	VirtualCamKeeper keeper(stubOps);
+	keeper.CollectionChanging();
+	cam.now += 100 * MS;
+	keeper.CollectionChanged();
+	check(cam.stops == 1, "restart: stopped on collection change");
+	cam.active = false;
+	cam.now += 200 * MS;
+	keeper.Stopped();
+	check(cam.starts == 1, "restart: started once stopped");
+	cam.active = true;
+	cam.now += 300 * MS;
+	keeper.Started();
+	check(keeper.Downtime().count == 1, "restart: downtime recorded");
+	check(keeper.Downtime().last == 500 * MS,
+	      "restart: downtime from stop to started");
+
+	// A manual stop afterwards stays stopped.
+	cam.active = false;
+	keeper.Stopped();
+	check(cam.starts == 1, "restart: manual stop not restarted");
+	check(keeper.Downtime().count == 1,
+	      "restart: manual stop adds no downtime");
+}
+
+// A start that never reports started must not turn a later manual stop
+// into a restart.
+static void restart_mode_start_lost()
+{
+	reset(true);
+	VirtualCamKeeper keeper(stubOps);
+	keeper.CollectionChanged();
+	cam.active = false;
+	keeper.Stopped();
+	check(cam.starts == 1, "lost start: started once stopped");
+	keeper.Stopped();
+	check(cam.starts == 1, "lost start: later stop not restarted");
+}
+
+static void restart_mode_inactive()
+{
+	reset(false);
+	VirtualCamKeeper keeper(stubOps);
+	keeper.CollectionChanging();
+	keeper.CollectionChanged();
+	keeper.Stopped();
+	check(cam.stops == 0 && cam.starts == 0,
+	      "inactive: camera left alone");
+	check(keeper.Downtime().count == 0, "inactive: no downtime");
+}
+
+// The camera keeps running, the downtime is the collection load.
+static void keep_mode()
+{
+	reset(true);
+	VirtualCamKeeper keeper(stubOps);
+	keeper.SetMode(VirtualCamKeeper::Mode::Keep);
+	keeper.CollectionChanging();
+	cam.now += 250 * MS;
+	keeper.CollectionChanged();
+	check(cam.stops == 0 && cam.starts == 0, "keep: camera not stopped");
+	check(keeper.Downtime().count == 1, "keep: downtime recorded");
+	check(keeper.Downtime().last == 250 * MS,
+	      "keep: downtime from changing to changed");
+
+	cam.active = false;
+	keeper.Stopped();
+	cam.active = true;
+	keeper.Started();
+	check(cam.starts == 0, "keep: manual stop not restarted");
+	check(keeper.Downtime().count == 1,
+	      "keep: manual restart adds no downtime");
+}
+
+static void keep_mode_inactive()
+{
+	reset(false);
+	VirtualCamKeeper keeper(stubOps);
+	keeper.SetMode(VirtualCamKeeper::Mode::Keep);
+	keeper.CollectionChanging();
+	cam.now += 250 * MS;
+	keeper.CollectionChanged();
+	check(keeper.Downtime().count == 0, "keep inactive: no downtime");
+}
+
+int main(void)
+{
+	restart_mode();
+	restart_mode_start_lost();
+	restart_mode_inactive();
+	keep_mode();
+	keep_mode_inactive();
+	if (failures)
+		return 1;
+	printf("virtual camera keeper checks passed\n");
+	return 0;
+}
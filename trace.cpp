@@ -0,0 +1,150 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "obs.h"
+#include "event-queue.hpp"
+#include "plugin-stats.hpp"
+#include "util/platform.h"
+#include "util/profiler.h"
+#include "util/threading.h"
+
+// Roughly 64 MB of events, enough for a long show without growing forever.
+#define TRACE_MAX_EVENTS (2 * 1024 * 1024)
+// Events between two collections, the collector runs every 100 ms.
+#define TRACE_QUEUE_SIZE (64 * 1024)
+
+struct TraceEvent {
+	const char *name;
+	uint32_t tid;
+	uint64_t start;
+	uint64_t duration;
+};
+
+// Scopes end on the audio and capture threads too, so they only push to
+// the lock-free queue and never allocate. The collector thread moves the
+// events to traceEvents, which nothing else touches while tracing.
+static std::atomic<bool> tracing{false};
+static std::unique_ptr<MpscQueue<TraceEvent, TRACE_QUEUE_SIZE>> traceQueue;
+static std::atomic<uint32_t> traceDropped{0};
+static os_event_t *traceStop = nullptr;
+static std::thread traceCollector;
+static std::vector<TraceEvent> traceEvents;
+static std::string traceFile;
+static std::atomic<uint32_t> nextTid{0};
+
+static uint32_t trace_tid()
+{
+	thread_local uint32_t tid = ++nextTid;
+	return tid;
+}
+
+ProfileScope::ProfileScope(const char *name, DurationStat *stat)
+	: name(name),
+	  stat(stat),
+	  start(0)
+{
+	profile_start(name);
+	if (stat || tracing.load(std::memory_order_relaxed))
+		start = os_gettime_ns();
+}
+
+ProfileScope::~ProfileScope()
+{
+	profile_end(name);
+	if (!start)
+		return;
+	const uint64_t duration = os_gettime_ns() - start;
+	if (stat)
+		stat->Add(duration);
+	if (!tracing.load(std::memory_order_relaxed))
+		return;
+	TraceEvent event = {name, trace_tid(), start, duration};
+	if (!traceQueue->TryPush(event))
+		traceDropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void trace_collect()
+{
+	os_set_thread_name("device-switcher: trace");
+	TraceEvent event;
+	for (;;) {
+		const bool stopping = os_event_timedwait(traceStop, 100) == 0;
+		while (traceQueue->Pop(event)) {
+			if (traceEvents.size() < TRACE_MAX_EVENTS)
+				traceEvents.push_back(event);
+			else
+				traceDropped++;
+		}
+		if (stopping)
+			break;
+	}
+}
+
+bool trace_active()
+{
+	return tracing.load(std::memory_order_relaxed);
+}
+
+void trace_start(const char *file)
+{
+	if (tracing)
+		return;
+	if (!traceQueue)
+		traceQueue.reset(new MpscQueue<TraceEvent, TRACE_QUEUE_SIZE>);
+	// Scopes that ended just after the last stop.
+	TraceEvent event;
+	while (traceQueue->Pop(event))
+		;
+	traceDropped = 0;
+	traceFile = file;
+	traceEvents.clear();
+	traceEvents.reserve(64 * 1024);
+	os_event_init(&traceStop, OS_EVENT_TYPE_MANUAL);
+	traceCollector = std::thread(trace_collect);
+	tracing = true;
+	blog(LOG_INFO, "[Device Switcher] tracing to %s", file);
+}
+
+void trace_stop()
+{
+	if (!tracing.exchange(false))
+		return;
+	os_event_signal(traceStop);
+	traceCollector.join();
+	os_event_destroy(traceStop);
+	traceStop = nullptr;
+	std::vector<TraceEvent> events;
+	std::string file;
+	events.swap(traceEvents);
+	file.swap(traceFile);
+	if (const uint32_t dropped = traceDropped.exchange(0))
+		blog(LOG_WARNING, "[Device Switcher] dropped %u trace events",
+		     dropped);
+
+	FILE *f = os_fopen(file.c_str(), "wb");
+	if (!f) {
+		blog(LOG_WARNING, "[Device Switcher] failed to write trace %s",
+		     file.c_str());
+		return;
+	}
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+	for (size_t i = 0; i < events.size(); i++) {
+		const auto &e = events[i];
+		fprintf(f,
+			"%s\n{\"name\":\"%s\",\"cat\":\"device-switcher\","
+			"\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+			"\"dur\":%.3f}",
+			i ? "," : "", e.name, e.tid, e.start / 1000.0,
+			e.duration / 1000.0);
+	}
+	fputs("\n]}\n", f);
+	fclose(f);
+	blog(LOG_INFO, "[Device Switcher] wrote %zu trace events to %s",
+	     events.size(), file.c_str());
+}
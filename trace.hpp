@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+struct DurationStat;
+
+// Wraps a block in an OBS profiler scope. When tracing is enabled the
+// scope is also recorded as a Chrome trace_event, name must be a string
+// literal as both keep the pointer. The duration is added to stat when
+// one is given.
+class ProfileScope {
+	const char *name;
+	DurationStat *stat;
+	uint64_t start;
+
+public:
+	explicit ProfileScope(const char *name, DurationStat *stat = nullptr);
+	~ProfileScope();
+
+	ProfileScope(const ProfileScope &) = delete;
+	ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+// Starts recording scopes, written as trace_event JSON on trace_stop.
+void trace_start(const char *file);
+void trace_stop();
+bool trace_active();
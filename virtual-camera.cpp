@@ -0,0 +1,64 @@
+#include "virtual-camera.hpp"
+
+#include <obs-frontend-api.h>
+
+#include "obs.h"
+#include "util/platform.h"
+
+const VirtualCamOps virtualCamFrontendOps = {
+	obs_frontend_virtualcam_active,
+	obs_frontend_start_virtualcam,
+	obs_frontend_stop_virtualcam,
+	os_gettime_ns,
+};
+
+VirtualCamKeeper::VirtualCamKeeper(const VirtualCamOps &ops) : ops(ops) {}
+
+void VirtualCamKeeper::CollectionChanging()
+{
+	if (mode == Mode::Keep && ops.active())
+		downSince = ops.now();
+}
+
+void VirtualCamKeeper::CollectionChanged()
+{
+	if (mode == Mode::Keep) {
+		if (downSince) {
+			const uint64_t ts = ops.now();
+			downtime.Add(ts - downSince);
+			blog(LOG_INFO,
+			     "[Device Switcher] virtual camera kept, %.1f ms without program content",
+			     (ts - downSince) / 1000000.0);
+			downSince = 0;
+		}
+		return;
+	}
+	if (ops.active()) {
+		downSince = ops.now();
+		restart = true;
+		ops.stop();
+	}
+}
+
+void VirtualCamKeeper::Started()
+{
+	restart = false;
+	if (!downSince || mode == Mode::Keep)
+		return;
+	const uint64_t ts = ops.now();
+	downtime.Add(ts - downSince);
+	blog(LOG_INFO, "[Device Switcher] virtual camera restarted after %.1f ms",
+	     (ts - downSince) / 1000000.0);
+	downSince = 0;
+}
+
+void VirtualCamKeeper::Stopped()
+{
+	// Cleared here as well, a start that never reports back must not
+	// restart the camera after a later manual stop.
+	if (restart) {
+		restart = false;
+		ops.start();
+	} else if (mode == Mode::Restart)
+		downSince = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "plugin-stats.hpp"
+
+// Frontend calls used for the virtual camera, replaceable so the keeper
+// can run without a frontend.
+struct VirtualCamOps {
+	bool (*active)(void);
+	void (*start)(void);
+	void (*stop)(void);
+	uint64_t (*now)(void);
+};
+
+extern const VirtualCamOps virtualCamFrontendOps;
+
+// Keeps the virtual camera running over scene collection changes. In
+// restart mode it is stopped when the collection changed and started
+// again once stopped. In keep mode it stays running and shows the empty
+// program output while the collection loads. Either way the time without
+// program content is recorded as downtime.
+class VirtualCamKeeper {
+public:
+	enum class Mode { Restart, Keep };
+
+	explicit VirtualCamKeeper(const VirtualCamOps &ops =
+					  virtualCamFrontendOps);
+
+	void SetMode(Mode mode) { this->mode = mode; }
+	Mode GetMode() const { return mode; }
+
+	void CollectionChanging();
+	void CollectionChanged();
+	void Started();
+	void Stopped();
+
+	const DurationStat &Downtime() const { return downtime; }
+
+private:
+	const VirtualCamOps &ops;
+	Mode mode = Mode::Restart;
+	bool restart = false;
+	uint64_t downSince = 0;
+	DurationStat downtime;
+};
@@ -1,6 +1,13 @@
 #include "volume-meter.hpp"
 
+#include <obs-module.h>
+#include <QHelpEvent>
+#include <QToolTip>
+
 #include "util/platform.h"
+#include "util/sse-intrin.h"
+#include "plugin-stats.hpp"
+#include "trace.hpp"
 
 #define CLAMP(x, min, max) ((x) < (min) ? (min) : ((x) > (max) ? (max) : (x)))
 
@@ -200,6 +207,7 @@ void VolumeMeter::setPeakMeterType(enum obs_peak_meter_type peakMeterType)
 {
 	if (obs_volmeter)
 		obs_volmeter_set_peak_meter_type(obs_volmeter, peakMeterType);
+	levelEngine.SetTruePeak(levelSlot, peakMeterType == TRUE_PEAK_METER);
 	switch (peakMeterType) {
 	case TRUE_PEAK_METER:
 		// For true-peak meters EBU has defined the Permitted Maximum,
@@ -236,6 +244,13 @@ void VolumeMeter::mousePressEvent(QMouseEvent *event)
 	event->accept();
 }
 
+void VolumeMeter::mouseDoubleClickEvent(QMouseEvent *event)
+{
+	if (loudness)
+		loudness->Reset();
+	event->accept();
+}
+
 void VolumeMeter::wheelEvent(QWheelEvent *event)
 {
 	auto *proxy = focusProxy();
@@ -248,9 +263,14 @@ VolumeMeter::VolumeMeter(QWidget *parent, obs_source_t *source, bool vertical)
 {
 	setAttribute(Qt::WA_OpaquePaintEvent, true);
 
-	obs_volmeter = obs_volmeter_create(OBS_FADER_LOG);
-	obs_volmeter_attach_source(obs_volmeter, source);
-	obs_volmeter_add_callback(obs_volmeter, OBSVolumeLevel, this);
+	if (levelEngine.Enabled())
+		levelSlot = levelEngine.Attach(source);
+	if (levelSlot < 0) {
+		obs_volmeter = obs_volmeter_create(OBS_FADER_LOG);
+		pluginStats.volmeters++;
+		obs_volmeter_attach_source(obs_volmeter, source);
+		obs_volmeter_add_callback(obs_volmeter, OBSVolumeLevel, this);
+	}
 
 	// Use a font that can be rendered small.
 	tickFont = QFont("Arial");
@@ -279,21 +299,32 @@ VolumeMeter::VolumeMeter(QWidget *parent, obs_source_t *source, bool vertical)
 
 	channels = (int)audio_output_get_channels(obs_get_audio());
 	doLayout();
-	updateTimerRef = updateTimer.toStrongRef();
-	if (!updateTimerRef) {
-		updateTimerRef = QSharedPointer<VolumeMeterTimer>::create();
-		updateTimerRef->setTimerType(Qt::PreciseTimer);
-		updateTimerRef->start(16);
-		updateTimer = updateTimerRef;
-	}
-
+	updateTimerRef = SharedTimer();
 	updateTimerRef->AddVolControl(this);
 }
 
+QSharedPointer<VolumeMeterTimer> VolumeMeter::SharedTimer()
+{
+	auto timer = updateTimer.toStrongRef();
+	if (!timer) {
+		timer = QSharedPointer<VolumeMeterTimer>::create();
+		timer->setTimerType(Qt::PreciseTimer);
+		timer->start(16);
+		updateTimer = timer;
+	}
+	return timer;
+}
+
 VolumeMeter::~VolumeMeter()
 {
-	obs_volmeter_remove_callback(obs_volmeter, OBSVolumeLevel, this);
-	obs_volmeter_destroy(obs_volmeter);
+	if (obs_volmeter) {
+		obs_volmeter_remove_callback(obs_volmeter, OBSVolumeLevel,
+					     this);
+		obs_volmeter_destroy(obs_volmeter);
+		pluginStats.volmeters--;
+	}
+	levelEngine.Detach(levelSlot);
+	levelExport.Detach(exportEntry);
 	updateTimerRef->RemoveVolControl(this);
 	delete tickPaintCache;
 }
@@ -315,6 +346,8 @@ void VolumeMeter::setLevels(const float magnitude[MAX_AUDIO_CHANNELS],
 	// In case there are more updates then redraws we must make sure
 	// that the ballistics of peak and hold are recalculated.
 	locker.unlock();
+	levelExport.Write(exportEntry, magnitude, peak, inputPeak);
+	RecordTelemetry(ts, magnitude, showOutputMeter ? peak : inputPeak);
 	calculateBallistics(ts);
 }
 
@@ -346,12 +379,10 @@ inline bool VolumeMeter::detectIdle(uint64_t ts)
 	}
 }
 
-inline void
-VolumeMeter::calculateBallisticsForChannel(int channelNr, uint64_t ts,
-					   qreal timeSinceLastRedraw)
+inline void VolumeMeter::calculateBallisticsForChannel(
+	int channelNr, uint64_t ts, qreal timeSinceLastRedraw, float magnitude,
+	float peak)
 {
-	const float peak = showOutputMeter ? currentPeak[channelNr]
-					   : currentInputPeak[channelNr];
 	if (peak >= displayPeak[channelNr] || isnan(displayPeak[channelNr])) {
 		// Attack of peak is immediate.
 		displayPeak[channelNr] = peak;
@@ -404,14 +435,13 @@ VolumeMeter::calculateBallisticsForChannel(int channelNr, uint64_t ts,
 	if (!isfinite(displayMagnitude[channelNr])) {
 		// The statements in the else-leg do not work with
 		// NaN and infinite displayMagnitude.
-		displayMagnitude[channelNr] = currentMagnitude[channelNr];
+		displayMagnitude[channelNr] = magnitude;
 	} else {
 		// A VU meter will integrate to the new value to 99% in 300 ms.
 		// The calculation here is very simplified and is more accurate
 		// with higher frame-rate.
 		float attack =
-			float((currentMagnitude[channelNr] -
-			       displayMagnitude[channelNr]) *
+			float((magnitude - displayMagnitude[channelNr]) *
 			      (timeSinceLastRedraw / magnitudeIntegrationTime) *
 			      0.99);
 		displayMagnitude[channelNr] =
@@ -420,14 +450,112 @@ VolumeMeter::calculateBallisticsForChannel(int channelNr, uint64_t ts,
 	}
 }
 
+static_assert(MAX_AUDIO_CHANNELS == 8, "channel reduction loads 2x4 floats");
+
+// The loudest of all channels. Channels the source does not have are
+// -inf, so all eight are reduced.
+static inline float LoudestChannel(const float levels[MAX_AUDIO_CHANNELS])
+{
+	__m128 v = _mm_max_ps(_mm_loadu_ps(levels), _mm_loadu_ps(levels + 4));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+	return _mm_cvtss_f32(v);
+}
+
+// The channels of each side in the output speaker layout: L left, R
+// right, B both for the centre channels and - neither for the LFE.
+static void SideMasks(uint32_t masks[2][MAX_AUDIO_CHANNELS])
+{
+	struct obs_audio_info oai = {};
+	obs_get_audio_info(&oai);
+	const char *side;
+	switch (oai.speakers) {
+	case SPEAKERS_MONO:
+		side = "B";
+		break;
+	case SPEAKERS_STEREO:
+		side = "LR";
+		break;
+	case SPEAKERS_2POINT1: // FL FR LFE
+		side = "LR-";
+		break;
+	case SPEAKERS_4POINT0: // FL FR FC RC
+		side = "LRBB";
+		break;
+	case SPEAKERS_4POINT1: // FL FR FC LFE RC
+		side = "LRB-B";
+		break;
+	case SPEAKERS_5POINT1: // FL FR FC LFE RL RR
+		side = "LRB-LR";
+		break;
+	default: // FL FR FC LFE RL RR SL SR
+		side = "LRB-LRLR";
+		break;
+	}
+	for (int ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+		const char c = *side ? *side++ : '-';
+		masks[0][ch] = c == 'L' || c == 'B' ? ~0u : 0u;
+		masks[1][ch] = c == 'R' || c == 'B' ? ~0u : 0u;
+	}
+}
+
+// The loudest channel on each side, channels outside the mask of a side
+// count as silent.
+static inline void LoudestSides(const float levels[MAX_AUDIO_CHANNELS],
+				const uint32_t masks[2][MAX_AUDIO_CHANNELS],
+				float sides[2])
+{
+	const __m128 lo = _mm_loadu_ps(levels);
+	const __m128 hi = _mm_loadu_ps(levels + 4);
+	const __m128 silent = _mm_set1_ps(-M_INFINITE);
+	for (int side = 0; side < 2; side++) {
+		const __m128 mlo = _mm_castsi128_ps(
+			_mm_loadu_si128((const __m128i *)masks[side]));
+		const __m128 mhi = _mm_castsi128_ps(
+			_mm_loadu_si128((const __m128i *)(masks[side] + 4)));
+		__m128 v = _mm_max_ps(
+			_mm_or_ps(_mm_and_ps(mlo, lo),
+				  _mm_andnot_ps(mlo, silent)),
+			_mm_or_ps(_mm_and_ps(mhi, hi),
+				  _mm_andnot_ps(mhi, silent)));
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v,
+						 _MM_SHUFFLE(2, 3, 0, 1)));
+		v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+		sides[side] = _mm_cvtss_f32(v);
+	}
+}
+
 inline void VolumeMeter::calculateBallistics(uint64_t ts,
 					     qreal timeSinceLastRedraw)
 {
 	QMutexLocker locker(&dataMutex);
 
-	for (int channelNr = 0; channelNr < MAX_AUDIO_CHANNELS; channelNr++)
-		calculateBallisticsForChannel(channelNr, ts,
-					      timeSinceLastRedraw);
+	const float *peak = showOutputMeter ? currentPeak : currentInputPeak;
+	float magnitudes[2];
+	float peaks[2];
+	switch (reducedNrAudioChannels) {
+	case 1:
+		calculateBallisticsForChannel(0, ts, timeSinceLastRedraw,
+					      LoudestChannel(currentMagnitude),
+					      LoudestChannel(peak));
+		break;
+	case 2:
+		LoudestSides(currentMagnitude, sideMasks, magnitudes);
+		LoudestSides(peak, sideMasks, peaks);
+		for (int channelNr = 0; channelNr < 2; channelNr++)
+			calculateBallisticsForChannel(channelNr, ts,
+						      timeSinceLastRedraw,
+						      magnitudes[channelNr],
+						      peaks[channelNr]);
+		break;
+	default:
+		for (int channelNr = 0; channelNr < MAX_AUDIO_CHANNELS;
+		     channelNr++)
+			calculateBallisticsForChannel(
+				channelNr, ts, timeSinceLastRedraw,
+				currentMagnitude[channelNr], peak[channelNr]);
+		break;
+	}
 }
 
 void VolumeMeter::paintInputMeter(QPainter &painter, int x, int y, int width,
@@ -703,10 +831,203 @@ void VolumeMeter::paintVMeter(QPainter &painter, int x, int y, int width,
 void VolumeMeter::ShowOutputMeter(bool output)
 {
 	showOutputMeter = output;
+	if (history)
+		history->ShowOutputPeak(output);
+}
+
+void VolumeMeter::EnableLoudness(obs_source_t *source)
+{
+	if (loudness || !source)
+		return;
+	loudness = std::make_unique<LoudnessMeter>(source);
+	doLayout();
+}
+
+void VolumeMeter::SetHistory(std::shared_ptr<LevelRecorder> history_)
+{
+	if (history == history_)
+		return;
+	history = std::move(history_);
+	if (history)
+		history->ShowOutputPeak(showOutputMeter);
+	historyColumns.clear();
+	doLayout();
+}
+
+// Each pixel covers the same number of periods of the ten minutes, newest
+// on the right, clips marked along the top. Only the periods closed since
+// the last paint are copied out of the history.
+void VolumeMeter::paintHistory(QPainter &painter, int y, int width,
+			       int height)
+{
+	const int columns = std::max(width - 5, 1);
+	const int per = (LevelHistory::Length + columns - 1) / columns;
+	const bool rebuild = (int)historyColumns.size() != columns;
+	uint64_t version = 0;
+	int fresh = 0;
+	history->Read([&](const LevelHistory &h) {
+		version = h.Version();
+		fresh = rebuild ? h.Count()
+				: (int)std::min(version - historyVersion,
+						(uint64_t)h.Count());
+		if ((int)historyPeaks.size() < fresh)
+			historyPeaks.resize(fresh);
+		for (int age = 0; age < fresh; age++)
+			historyPeaks[age] = h.MaxPeak(age);
+	});
+	if (rebuild) {
+		historyColumns.assign(columns, 0);
+		historyBucket = version ? (version - 1) / per : 0;
+	}
+	for (int age = fresh - 1; age >= 0; age--) {
+		const uint64_t bucket = (version - 1 - age) / per;
+		if (bucket > historyBucket) {
+			const int shift = (int)std::min(bucket - historyBucket,
+							(uint64_t)columns);
+			std::move(historyColumns.begin() + shift,
+				  historyColumns.end(), historyColumns.begin());
+			std::fill(historyColumns.end() - shift,
+				  historyColumns.end(), 0);
+			historyBucket = bucket;
+		}
+		const uint64_t back = historyBucket - bucket;
+		if (back < (uint64_t)columns) {
+			auto &column = historyColumns[columns - 1 - back];
+			column = std::max(column, historyPeaks[age]);
+		}
+	}
+	historyVersion = version;
+
+	const uint8_t clip = LevelHistory::Encode((float)clipLevel);
+	for (int c = 0; c < columns; c++) {
+		const uint8_t code = historyColumns[c];
+		if (!code)
+			continue;
+		const float db = LevelHistory::Decode(code);
+		const int h = (int)(height * (1.0 - std::min(db, 0.0f) /
+							     minimumLevel));
+		if (h > 0)
+			painter.fillRect(5 + c, y + height - h, 1, h,
+					 code >= clip ? foregroundErrorColor
+						      : foregroundNominalColor);
+		if (code >= clip)
+			painter.fillRect(5 + c, y, 1, 2, clipColor);
+	}
+}
+
+bool VolumeMeter::event(QEvent *event)
+{
+	if (event->type() != QEvent::ToolTip || !history)
+		return QWidget::event(event);
+	int minute, all, last;
+	history->Read([&](const LevelHistory &h) {
+		minute = h.Clips(60 * LevelHistory::Rate, (float)clipLevel);
+		all = h.Clips(LevelHistory::Length, (float)clipLevel);
+		last = h.LastClip((float)clipLevel);
+	});
+	QString text = QString::fromUtf8(obs_module_text("HistoryClips"))
+			       .arg(minute)
+			       .arg(all);
+	if (last >= 0)
+		text += QStringLiteral("\n") +
+			QString::fromUtf8(obs_module_text("HistoryLastClip"))
+				.arg(last / LevelHistory::Rate);
+	QToolTip::showText(static_cast<QHelpEvent *>(event)->globalPos(),
+			   text, this);
+	return true;
+}
+
+void VolumeMeter::SetExportName(const char *name)
+{
+	if (!levelExport.Active())
+		return;
+	if (exportEntry < 0)
+		exportEntry = levelExport.Attach(name);
+	else
+		levelExport.Rename(exportEntry, name);
+}
+
+void VolumeMeter::SetTelemetrySource(uint32_t source)
+{
+	telemetrySource = source;
+}
+
+void VolumeMeter::SetChannelReduction(Channels reduction)
+{
+	channelReduction = reduction;
+	if (needLayoutChange())
+		doLayout();
+}
+
+void VolumeMeter::SetUpdateRate(int hz)
+{
+	// The shared timer ticks every 16 ms, about 60 Hz.
+	const int interval = hz > 0 ? std::max((int)lround(60.0 / hz), 1) : 1;
+	updateTimerRef->RemoveVolControl(this);
+	updateTimerRef->AddVolControl(this, interval);
+}
+
+void VolumeMeter::RecordTelemetry(uint64_t ts,
+				  const float magnitude[MAX_AUDIO_CHANNELS],
+				  const float peak[MAX_AUDIO_CHANNELS])
+{
+	const uint32_t source = telemetrySource.load(std::memory_order_relaxed);
+	if (!source)
+		return;
+	float maxPeak = -M_INFINITE;
+	for (int ch = 0; ch < channels; ch++) {
+		maxPeak = std::max(maxPeak, peak[ch]);
+		if (!telemetryLast || peak[ch] > telemetryPeak[ch])
+			telemetryPeak[ch] = peak[ch];
+		if (!telemetryLast || magnitude[ch] > telemetryMagnitude[ch])
+			telemetryMagnitude[ch] = magnitude[ch];
+	}
+	// One record per clip, not per block over the clip level.
+	if (maxPeak >= clipLevel && !telemetryClipping)
+		telemetry.Clip(source, maxPeak);
+	telemetryClipping = maxPeak >= clipLevel;
+
+	if (!telemetryLast) {
+		telemetryLast = ts;
+	} else if (ts - telemetryLast >= telemetry.LevelInterval()) {
+		telemetry.Levels(source, channels, telemetryPeak,
+				 telemetryMagnitude);
+		telemetryLast = 0;
+	}
+}
+
+static QString FormatLoudness(float lufs)
+{
+	return isfinite(lufs) ? QString::number(lufs, 'f', 1)
+			      : QStringLiteral("-inf");
+}
+
+// Momentary loudness as the bar, short-term as the magnitude marker and
+// integrated as the hold marker, on the same scale as the channels.
+void VolumeMeter::paintLoudness(QPainter &painter, int y, int width)
+{
+	paintHMeter(painter, 5, y, width - 5, 3, loudness->ShortTerm(),
+		    loudness->Momentary(), loudness->Integrated());
+	painter.setFont(tickFont);
+	painter.setPen(majorTickColor);
+	QFontMetrics metrics(tickFont);
+	painter.drawText(5, y + 4 + metrics.ascent(),
+			 QStringLiteral("M %1  S %2  I %3 LUFS")
+				 .arg(FormatLoudness(loudness->Momentary()))
+				 .arg(FormatLoudness(loudness->ShortTerm()))
+				 .arg(FormatLoudness(loudness->Integrated())));
+}
+
+void VolumeMeter::PollLevels()
+{
+	if (levelSlot >= 0 && levelEngine.Read(levelSlot, levelReading))
+		setLevels(levelReading.magnitude, levelReading.peak,
+			  levelReading.inputPeak);
 }
 
 void VolumeMeter::paintEvent(QPaintEvent *event)
 {
+	ProfileScope scope("VolumeMeter::paintEvent", &pluginStats.meterPaint);
 	uint64_t ts = os_gettime_ns();
 	qreal timeSinceLastRedraw = (ts - lastRedrawTime) * 0.000000001;
 
@@ -765,10 +1086,10 @@ void VolumeMeter::paintEvent(QPaintEvent *event)
 	for (int channelNr = 0; channelNr < displayNrAudioChannels;
 	     channelNr++) {
 
-		int channelNrFixed =
-			(displayNrAudioChannels == 1 && channels > 2)
-				? 2
-				: channelNr;
+		int channelNrFixed = (displayNrAudioChannels == 1 &&
+				      channels > 2 && !reducedNrAudioChannels)
+					     ? 2
+					     : channelNr;
 
 		if (vertical)
 			paintVMeter(painter, channelNr * 4, 8, 3, height - 10,
@@ -795,6 +1116,16 @@ void VolumeMeter::paintEvent(QPaintEvent *event)
 					displayInputPeakHold[channelNrFixed]);
 	}
 
+	if (!vertical) {
+		int y = displayNrAudioChannels * 4;
+		if (loudness) {
+			paintLoudness(painter, y, width);
+			y += 4 + 4 + QFontMetrics(tickFont).height();
+		}
+		if (history)
+			paintHistory(painter, y + 1, width, 12);
+	}
+
 	lastRedrawTime = ts;
 }
 
@@ -821,8 +1152,13 @@ inline void VolumeMeter::doLayout()
 		// between channels, but not after the last.
 		// Add 4 pixels for ticks, and space high enough to hold our label in
 		// this font, presuming that digits don't have descenders.
+		// The loudness bar and readout take another row and a line,
+		// the history sparkline 12 pixels.
 		setMinimumSize(130, displayNrAudioChannels * (3 + 1) - 1 + 4 +
-					    metrics.capHeight());
+					    metrics.capHeight() +
+					    (loudness ? 4 + 4 + metrics.height()
+						      : 0) +
+					    (history ? 1 + 12 + 2 : 0));
 	}
 
 	resetLevels();
@@ -830,7 +1166,9 @@ inline void VolumeMeter::doLayout()
 
 bool VolumeMeter::needLayoutChange()
 {
-	int currentNrAudioChannels = obs_volmeter_get_nr_channels(obs_volmeter);
+	int currentNrAudioChannels =
+		obs_volmeter ? obs_volmeter_get_nr_channels(obs_volmeter)
+			     : levelEngine.Channels(levelSlot);
 
 	if (!currentNrAudioChannels) {
 		struct obs_audio_info oai;
@@ -839,8 +1177,22 @@ bool VolumeMeter::needLayoutChange()
 									 : 2;
 	}
 
-	if (displayNrAudioChannels != currentNrAudioChannels) {
+	int reduced = 0;
+	if (channelReduction == Channels::Loudest && currentNrAudioChannels > 1)
+		reduced = 1;
+	else if (channelReduction == Channels::Stereo &&
+		 currentNrAudioChannels > 2)
+		reduced = 2;
+	if (reduced)
+		currentNrAudioChannels = reduced;
+
+	if (displayNrAudioChannels != currentNrAudioChannels ||
+	    reducedNrAudioChannels != reduced) {
 		displayNrAudioChannels = currentNrAudioChannels;
+		QMutexLocker locker(&dataMutex);
+		reducedNrAudioChannels = reduced;
+		if (reduced == 2)
+			SideMasks(sideMasks);
 		return true;
 	}
 
@@ -852,22 +1204,67 @@ void VolumeMeter::OBSVolumeLevel(void *data,
 				 const float peak[MAX_AUDIO_CHANNELS],
 				 const float inputPeak[MAX_AUDIO_CHANNELS])
 {
+	ProfileScope scope("VolumeMeter::OBSVolumeLevel",
+			   &pluginStats.volmeterLevels);
 	VolumeMeter *w = static_cast<VolumeMeter *>(data);
 	w->setLevels(magnitude, peak, inputPeak);
 }
 
-void VolumeMeterTimer::AddVolControl(VolumeMeter *meter)
+void VolumeMeterTimer::AddVolControl(VolumeMeter *meter, int interval)
 {
-	volumeMeters.push_back(meter);
+	volumeMeters[std::max(interval, 1)].push_back(meter);
 }
 
 void VolumeMeterTimer::RemoveVolControl(VolumeMeter *meter)
 {
-	volumeMeters.removeOne(meter);
+	for (auto it = volumeMeters.begin(); it != volumeMeters.end(); ++it) {
+		if (!it.value().removeOne(meter))
+			continue;
+		if (it.value().isEmpty())
+			volumeMeters.erase(it);
+		return;
+	}
+}
+
+void VolumeMeterTimer::AddWidget(QWidget *widget)
+{
+	widgets.push_back(widget);
+}
+
+void VolumeMeterTimer::RemoveWidget(QWidget *widget)
+{
+	widgets.removeOne(widget);
+}
+
+void VolumeMeterTimer::AddRecorder(LevelRecorder *recorder)
+{
+	recorders.push_back(recorder);
+}
+
+void VolumeMeterTimer::RemoveRecorder(LevelRecorder *recorder)
+{
+	recorders.removeOne(recorder);
 }
 
 void VolumeMeterTimer::timerEvent(QTimerEvent *)
 {
-	for (VolumeMeter *meter : volumeMeters)
-		meter->update();
+	ProfileScope scope("VolumeMeterTimer::timerEvent",
+			   &pluginStats.meterTick);
+	const uint64_t ts = os_gettime_ns();
+	if (lastTick)
+		pluginStats.meterInterval.Add(ts - lastTick);
+	lastTick = ts;
+	ticks++;
+	for (LevelRecorder *recorder : recorders)
+		recorder->Poll();
+	for (auto it = volumeMeters.cbegin(); it != volumeMeters.cend(); ++it) {
+		if (ticks % it.key())
+			continue;
+		for (VolumeMeter *meter : it.value()) {
+			meter->PollLevels();
+			meter->update();
+		}
+	}
+	for (QWidget *widget : widgets)
+		widget->update();
 }
@@ -6,16 +6,38 @@
 #include <QTimer>
 #include <QMutex>
 #include <QList>
+#include <QMap>
 #include <QApplication>
 #include <QColor>
 #include <QPainter>
 
 #include "obs.h"
+#include "level-engine.hpp"
+#include "loudness-meter.hpp"
+#include "level-history.hpp"
+#include "level-export.hpp"
+#include "telemetry.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Peak decay profiles in dB/second.
+#define VOLUME_METER_DECAY_FAST 23.53   // 40 dB / 1.7 sec
+#define VOLUME_METER_DECAY_MEDIUM 11.76 // 20 dB / 1.7 sec, Type I PPM
+#define VOLUME_METER_DECAY_SLOW 8.57    // 24 dB / 2.8 sec, Type II PPM
 
 class VolumeMeterTimer;
 
 class VolumeMeter : public QWidget {
 	Q_OBJECT
+
+public:
+	// How multichannel sources are drawn: every channel, one bar of the
+	// loudest channel, or a left/right pair of the loudest channel on
+	// each side.
+	enum class Channels { All, Loudest, Stereo };
+
 	Q_PROPERTY(QColor backgroundNominalColor READ getBackgroundNominalColor
 			   WRITE setBackgroundNominalColor DESIGNABLE true)
 	Q_PROPERTY(QColor backgroundWarningColor READ getBackgroundWarningColor
@@ -68,8 +90,33 @@ private slots:
 	void ClipEnding();
 
 private:
-	obs_volmeter_t *obs_volmeter;
-	bool showOutputMeter;
+	obs_volmeter_t *obs_volmeter = nullptr;
+	// Slot in the shared level table when the level engine meters the
+	// source instead of a volmeter.
+	int levelSlot = -1;
+	LevelReading levelReading;
+	// Entry in the shared memory level export, -1 when not exported.
+	std::atomic<int> exportEntry{-1};
+	// Telemetry source id, 0 when not recorded. The levels are reduced
+	// to the maxima of each telemetry interval.
+	std::atomic<uint32_t> telemetrySource{0};
+	uint64_t telemetryLast = 0;
+	float telemetryPeak[MAX_AUDIO_CHANNELS];
+	float telemetryMagnitude[MAX_AUDIO_CHANNELS];
+	bool telemetryClipping = false;
+	void RecordTelemetry(uint64_t ts,
+			     const float magnitude[MAX_AUDIO_CHANNELS],
+			     const float peak[MAX_AUDIO_CHANNELS]);
+	std::unique_ptr<LoudnessMeter> loudness;
+	// Owned by the row. The columns are the highest peak per pixel of
+	// the sparkline, counted in whole periods so new periods only fold
+	// into the newest column or shift the rest, rebuilt on resize.
+	std::shared_ptr<LevelRecorder> history;
+	std::vector<uint8_t> historyColumns;
+	std::vector<uint8_t> historyPeaks;
+	uint64_t historyVersion = 0;
+	uint64_t historyBucket = 0;
+	bool showOutputMeter = false;
 	static QWeakPointer<VolumeMeterTimer> updateTimer;
 	QSharedPointer<VolumeMeterTimer> updateTimerRef;
 
@@ -78,7 +125,8 @@ private:
 	inline void calculateBallistics(uint64_t ts,
 					qreal timeSinceLastRedraw = 0.0);
 	inline void calculateBallisticsForChannel(int channelNr, uint64_t ts,
-						  qreal timeSinceLastRedraw);
+						  qreal timeSinceLastRedraw,
+						  float magnitude, float peak);
 
 	void paintInputMeter(QPainter &painter, int x, int y, int width,
 			     int height, float peakHold);
@@ -86,6 +134,8 @@ private:
 			 float magnitude, float peak, float peakHold);
 	void paintHTicks(QPainter &painter, int x, int y, int width,
 			 int height);
+	void paintLoudness(QPainter &painter, int y, int width);
+	void paintHistory(QPainter &painter, int y, int width, int height);
 	void paintVMeter(QPainter &painter, int x, int y, int width, int height,
 			 float magnitude, float peak, float peakHold);
 	void paintVTicks(QPainter &painter, int x, int y, int height);
@@ -106,6 +156,13 @@ private:
 
 	QPixmap *tickPaintCache = nullptr;
 	int displayNrAudioChannels = 0;
+	// Channels the ballistics reduce the source to, 0 when every channel
+	// is shown. Written under dataMutex from the UI thread.
+	int reducedNrAudioChannels = 0;
+	// Channels counted on the left and the right side of the stereo
+	// reduction, all bits set for a channel that counts. Written with
+	// reducedNrAudioChannels.
+	uint32_t sideMasks[2][MAX_AUDIO_CHANNELS] = {};
 	float displayMagnitude[MAX_AUDIO_CHANNELS];
 	float displayPeak[MAX_AUDIO_CHANNELS];
 	float displayPeakHold[MAX_AUDIO_CHANNELS];
@@ -138,6 +195,7 @@ private:
 	int channels = 0;
 	bool clipping = false;
 	bool vertical;
+	Channels channelReduction = Channels::All;
 
 public:
 	explicit VolumeMeter(QWidget *parent = nullptr,
@@ -145,6 +203,9 @@ public:
 			     bool vertical = false);
 	~VolumeMeter();
 
+	// The timer all meters repaint on, created by the first user.
+	static QSharedPointer<VolumeMeterTimer> SharedTimer();
+
 	void setLevels(const float magnitude[MAX_AUDIO_CHANNELS],
 		       const float peak[MAX_AUDIO_CHANNELS],
 		       const float inputPeak[MAX_AUDIO_CHANNELS]);
@@ -189,10 +250,26 @@ public:
 	void setInputPeakHoldDuration(qreal v);
 	void setPeakMeterType(enum obs_peak_meter_type peakMeterType);
 	virtual void mousePressEvent(QMouseEvent *event) override;
+	virtual void mouseDoubleClickEvent(QMouseEvent *event) override;
 	virtual void wheelEvent(QWheelEvent *event) override;
 	void ShowOutputMeter(bool output);
+	void PollLevels();
+	// Adds a loudness bar with a LUFS readout below the channels,
+	// double click restarts the integrated loudness.
+	void EnableLoudness(obs_source_t *source);
+	// Shows the ten minutes of levels of history as a sparkline with
+	// clip markers and clip counts in the tooltip.
+	void SetHistory(std::shared_ptr<LevelRecorder> history);
+	// Exports the levels under name when the level export is open.
+	void SetExportName(const char *name);
+	// Records levels and clips under the telemetry source id.
+	void SetTelemetrySource(uint32_t source);
+	void SetChannelReduction(Channels reduction);
+	// Repaints at about hz, in steps of the shared timer interval.
+	void SetUpdateRate(int hz);
 
 protected:
+	bool event(QEvent *event) override;
 	void paintEvent(QPaintEvent *event) override;
 };
 
@@ -202,10 +279,23 @@ class VolumeMeterTimer : public QTimer {
 public:
 	inline VolumeMeterTimer() : QTimer() {}
 
-	void AddVolControl(VolumeMeter *meter);
+	// The meter updates every interval ticks.
+	void AddVolControl(VolumeMeter *meter, int interval = 1);
 	void RemoveVolControl(VolumeMeter *meter);
+	// Other widgets repainted on the meter frame schedule.
+	void AddWidget(QWidget *widget);
+	void RemoveWidget(QWidget *widget);
+	// Level histories fed from the level engine, polled every tick.
+	void AddRecorder(LevelRecorder *recorder);
+	void RemoveRecorder(LevelRecorder *recorder);
 
 protected:
 	void timerEvent(QTimerEvent *event) override;
-	QList<VolumeMeter *> volumeMeters;
+	// Meters grouped by the ticks between their updates, so slow meters
+	// cost nothing on the ticks they skip.
+	QMap<int, QList<VolumeMeter *>> volumeMeters;
+	QList<QWidget *> widgets;
+	QList<LevelRecorder *> recorders;
+	uint64_t lastTick = 0;
+	uint64_t ticks = 0;
 };